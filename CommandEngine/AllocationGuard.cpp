@@ -0,0 +1,72 @@
+#include "AllocationGuard.h"
+#include <atomic>
+#include <execinfo.h>
+#include <stddef.h>
+#include <unistd.h>
+
+// The glibc allocator behind the public names, which this file takes over
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+}
+
+static std::atomic<bool> armed(false);
+static std::atomic<uint32_t> allocationCount(0);
+static std::atomic<uint64_t> allocationBytes(0);
+// Set while this thread prints a report, backtrace may allocate itself
+static thread_local bool reporting = false;
+
+static void trap(size_t size) {
+  if (!armed.load(std::memory_order_relaxed) || reporting) {
+    return;
+  }
+  uint32_t count = allocationCount.fetch_add(1, std::memory_order_relaxed);
+  allocationBytes.fetch_add(size, std::memory_order_relaxed);
+  if (count >= ALLOCATION_GUARD_REPORT_LIMIT) {
+    return;
+  }
+  reporting = true;
+  // No stdio, it can allocate too
+  static const char message[] = "Allocation after init:\n";
+  if (write(STDERR_FILENO, message, sizeof(message) - 1) >= 0) {
+    void *frames[ALLOCATION_GUARD_BACKTRACE_DEPTH];
+    int depth = backtrace(frames, ALLOCATION_GUARD_BACKTRACE_DEPTH);
+    backtrace_symbols_fd(frames, depth, STDERR_FILENO);
+  }
+  reporting = false;
+}
+
+extern "C" void *malloc(size_t size) {
+  trap(size);
+  return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size) {
+  trap(count * size);
+  return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *pointer, size_t size) {
+  trap(size);
+  return __libc_realloc(pointer, size);
+}
+
+void allocationGuardArm() {
+  // The first backtrace loads the unwinder, which allocates, get that over with now
+  void *frame;
+  backtrace(&frame, 1);
+  armed = true;
+}
+
+void allocationGuardDisarm() {
+  armed = false;
+}
+
+uint32_t allocationGuardGetCount() {
+  return allocationCount;
+}
+
+uint64_t allocationGuardGetBytes() {
+  return allocationBytes;
+}
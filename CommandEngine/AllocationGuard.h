@@ -0,0 +1,23 @@
+#ifndef _ALLOCATION_GUARD_H
+#define _ALLOCATION_GUARD_H
+
+#include <stdint.h>
+
+// Allocations reported with a backtrace, the rest are only counted
+#define ALLOCATION_GUARD_REPORT_LIMIT 8
+#define ALLOCATION_GUARD_BACKTRACE_DEPTH 16
+
+/*!
+ * Debug aid for the real-time memory mode, built with -DALLOCATION_GUARD=ON.
+ * Replaces malloc, calloc and realloc (operator new goes through malloc) with versions
+ * that count every call made while the guard is armed, from any thread, and print a
+ * backtrace of the first ALLOCATION_GUARD_REPORT_LIMIT to stderr. Arm it once
+ * everything is initialized, the control path is then expected to never allocate.
+ * Aligned allocations (posix_memalign, aligned_alloc) are not seen.
+ * */
+void allocationGuardArm();
+void allocationGuardDisarm();
+uint32_t allocationGuardGetCount();
+uint64_t allocationGuardGetBytes();
+
+#endif
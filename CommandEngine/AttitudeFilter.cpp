@@ -0,0 +1,54 @@
+#include "AttitudeFilter.h"
+#include "ControlLoop.h"
+#include <cmath>
+
+AttitudeFilter::AttitudeFilter() {
+    this->configure(ATTITUDE_DEFAULT_TIME_CONSTANT, MPU6050_ACCEL_LSB_PER_G, MPU6050_GYRO_LSB_PER_DPS);
+    for (int axis = 0; axis < 3; axis++) {
+        this->gyroBias[axis] = 0.0f;
+    }
+    this->reset();
+}
+
+void AttitudeFilter::configure(float timeConstantSeconds, float accelLsbPerG, float gyroLsbPerDps) {
+    this->timeConstant = timeConstantSeconds;
+    this->accelScale = 1.0f / accelLsbPerG;
+    this->gyroScale = (float)(M_PI / 180) / gyroLsbPerDps;
+}
+
+void AttitudeFilter::setGyroBias(const float *bias) {
+    for (int axis = 0; axis < 3; axis++) {
+        this->gyroBias[axis] = bias[axis];
+    }
+}
+
+void AttitudeFilter::reset() {
+    this->attitude.pitch = 0.0f;
+    this->attitude.roll = 0.0f;
+    this->lastNanos = 0;
+}
+
+void AttitudeFilter::update(const ImuSample *sample) {
+    float ax = sample->accel[0] * this->accelScale;
+    float ay = sample->accel[1] * this->accelScale;
+    float az = sample->accel[2] * this->accelScale;
+    float accelPitch = atan2f(-ax, sqrtf(ay * ay + az * az));
+    float accelRoll = atan2f(ay, az);
+    if (this->lastNanos == 0) {
+        this->attitude.pitch = accelPitch;
+        this->attitude.roll = accelRoll;
+        this->lastNanos = sample->nanos;
+        return;
+    }
+    float dt = (float)(sample->nanos - this->lastNanos) / NANOS_PER_SECOND;
+    this->lastNanos = sample->nanos;
+    float rollRate = (sample->gyro[0] - this->gyroBias[0]) * this->gyroScale;
+    float pitchRate = (sample->gyro[1] - this->gyroBias[1]) * this->gyroScale;
+    float gyroWeight = this->timeConstant / (this->timeConstant + dt);
+    this->attitude.pitch = gyroWeight * (this->attitude.pitch + pitchRate * dt) + (1 - gyroWeight) * accelPitch;
+    this->attitude.roll = gyroWeight * (this->attitude.roll + rollRate * dt) + (1 - gyroWeight) * accelRoll;
+}
+
+Attitude AttitudeFilter::getAttitude() {
+    return this->attitude;
+}
@@ -0,0 +1,52 @@
+#ifndef _ATTITUDE_FILTER_H
+#define _ATTITUDE_FILTER_H
+
+#include <stdint.h>
+#include "ImuSampler.h"
+
+// Seconds, how long the gyro is trusted before the accelerometer pulls the estimate back
+#define ATTITUDE_DEFAULT_TIME_CONSTANT 0.5f
+
+/*!
+ * Pitch and roll of the body, radians. Pitch is nose up, roll is right side down.
+ * */
+struct Attitude {
+    float pitch, roll;
+};
+
+/*!
+ * Complementary filter: the gyro rates are integrated for the short term and the
+ * gravity direction from the accelerometer corrects the drift over timeConstant,
+ *   angle = a * (angle + rate * dt) + (1 - a) * accelAngle,  a = timeConstant / (timeConstant + dt)
+ * Every sample costs the same (two atan2, one square root, one division), whatever
+ * the motion, so draining the ring takes a fixed time per sample. dt comes from the
+ * sample times, samples skipped on a busy bus only make one step longer.
+ * Yaw is not estimated, the accelerometer can not correct it.
+ * */
+class AttitudeFilter {
+private:
+    float timeConstant;
+    float accelScale, gyroScale;
+    float gyroBias[3];
+    Attitude attitude;
+    int64_t lastNanos;
+public:
+    AttitudeFilter();
+    /*!
+     * @param accelLsbPerG accelerometer units per g
+     * @param gyroLsbPerDps gyro units per degree per second
+     * */
+    void configure(float timeConstantSeconds, float accelLsbPerG, float gyroLsbPerDps);
+    /*!
+     * Raw gyro units, subtracted from every sample
+     * */
+    void setGyroBias(const float *bias);
+    /*!
+     * The next sample starts over from the accelerometer alone
+     * */
+    void reset();
+    void update(const ImuSample *sample);
+    Attitude getAttitude();
+};
+
+#endif
@@ -0,0 +1,151 @@
+#include "CPG.h"
+#include <cmath>
+#include <string.h>
+
+HopfCPG::HopfCPG() {
+    this->count = 0;
+    this->omega = 0.0f;
+    this->convergenceRate = CPG_CONVERGENCE_RATE;
+    this->pendingSeconds = 0.0f;
+    this->stepCount = 0;
+    this->droppedSteps = 0;
+    memset(this->state, 0, sizeof(this->state));
+    memset(this->phaseOffset, 0, sizeof(this->phaseOffset));
+    this->setUniformCoupling(CPG_DEFAULT_COUPLING);
+}
+
+void HopfCPG::setCount(int count) {
+    this->count = count;
+    this->rebuildCoupling();
+}
+
+int HopfCPG::getCount() {
+    return this->count;
+}
+
+void HopfCPG::setPhaseOffset(int index, float radians) {
+    this->phaseOffset[index] = radians;
+    this->rebuildCoupling();
+}
+
+void HopfCPG::setCoupling(int i, int j, float gain) {
+    this->couplingGain[i][j] = gain;
+    this->rebuildCoupling();
+}
+
+void HopfCPG::setUniformCoupling(float gain) {
+    for (int i = 0; i < CPG_MAX_OSCILLATORS; i++) {
+        for (int j = 0; j < CPG_MAX_OSCILLATORS; j++) {
+            this->couplingGain[i][j] = (i == j) ? 0.0f : gain;
+        }
+    }
+    this->rebuildCoupling();
+}
+
+void HopfCPG::rebuildCoupling() {
+    for (int i = 0; i < CPG_MAX_OSCILLATORS; i++) {
+        // Once locked, the coupling of oscillator i points along its own state and pushes
+        // its radius out by sum(k_ij) / a. Lowering mu by the same amount keeps r at 1.
+        float gainSum = 0.0f;
+        for (int j = 0; j < this->count; j++) {
+            gainSum += this->couplingGain[i][j];
+        }
+        this->mu[i] = 1.0f - gainSum / this->convergenceRate;
+        for (int j = 0; j < CPG_MAX_OSCILLATORS; j++) {
+            float relativePhase = this->phaseOffset[i] - this->phaseOffset[j];
+            this->couplingCos[i][j] = this->couplingGain[i][j] * cosf(relativePhase);
+            this->couplingSin[i][j] = this->couplingGain[i][j] * sinf(relativePhase);
+        }
+    }
+}
+
+void HopfCPG::setFrequency(float omega) {
+    this->omega = omega;
+}
+
+void HopfCPG::resetToLimitCycle(float phase) {
+    for (int i = 0; i < this->count; i++) {
+        this->state[2 * i] = cosf(phase + this->phaseOffset[i]);
+        this->state[2 * i + 1] = sinf(phase + this->phaseOffset[i]);
+    }
+    this->pendingSeconds = 0.0f;
+}
+
+void HopfCPG::derivative(const float *in, float *out) {
+    for (int i = 0; i < this->count; i++) {
+        float x = in[2 * i], y = in[2 * i + 1];
+        float radial = this->convergenceRate * (this->mu[i] - (x * x + y * y));
+        float dx = radial * x - this->omega * y;
+        float dy = radial * y + this->omega * x;
+        for (int j = 0; j < this->count; j++) {
+            float xj = in[2 * j], yj = in[2 * j + 1];
+            dx += this->couplingCos[i][j] * xj - this->couplingSin[i][j] * yj;
+            dy += this->couplingSin[i][j] * xj + this->couplingCos[i][j] * yj;
+        }
+        out[2 * i] = dx;
+        out[2 * i + 1] = dy;
+    }
+}
+
+void HopfCPG::integrateStep() {
+    const float h = CPG_STEP_SECONDS;
+    const int size = 2 * this->count;
+    // Zeroed past size as well: derivative only reads the first size entries, which
+    // the optimiser can not tell and warns about
+    float k1[2 * CPG_MAX_OSCILLATORS] = {}, k2[2 * CPG_MAX_OSCILLATORS] = {};
+    float k3[2 * CPG_MAX_OSCILLATORS] = {}, k4[2 * CPG_MAX_OSCILLATORS] = {};
+    float temp[2 * CPG_MAX_OSCILLATORS] = {};
+
+    this->derivative(this->state, k1);
+    for (int i = 0; i < size; i++)
+        temp[i] = this->state[i] + 0.5f * h * k1[i];
+    this->derivative(temp, k2);
+    for (int i = 0; i < size; i++)
+        temp[i] = this->state[i] + 0.5f * h * k2[i];
+    this->derivative(temp, k3);
+    for (int i = 0; i < size; i++)
+        temp[i] = this->state[i] + h * k3[i];
+    this->derivative(temp, k4);
+    for (int i = 0; i < size; i++)
+        this->state[i] += (h / 6.0f) * (k1[i] + 2.0f * k2[i] + 2.0f * k3[i] + k4[i]);
+    this->stepCount++;
+}
+
+int HopfCPG::step(float deltaTime) {
+    this->pendingSeconds += deltaTime;
+    int steps = (int)(this->pendingSeconds / CPG_STEP_SECONDS);
+    this->pendingSeconds -= steps * CPG_STEP_SECONDS;
+    if (steps > CPG_MAX_STEPS_PER_TICK) {
+        this->droppedSteps += steps - CPG_MAX_STEPS_PER_TICK;
+        steps = CPG_MAX_STEPS_PER_TICK;
+    }
+    for (int i = 0; i < steps; i++) {
+        this->integrateStep();
+    }
+    return steps;
+}
+
+float HopfCPG::getX(int index) {
+    return this->state[2 * index];
+}
+
+float HopfCPG::getY(int index) {
+    return this->state[2 * index + 1];
+}
+
+void HopfCPG::setState(int index, float x, float y) {
+    this->state[2 * index] = x;
+    this->state[2 * index + 1] = y;
+}
+
+float HopfCPG::getPhase(int index) {
+    return atan2f(this->state[2 * index + 1], this->state[2 * index]);
+}
+
+uint32_t HopfCPG::getStepCount() {
+    return this->stepCount;
+}
+
+uint32_t HopfCPG::getDroppedSteps() {
+    return this->droppedSteps;
+}
@@ -0,0 +1,79 @@
+#ifndef _CPG_H
+#define _CPG_H
+
+#include <stdint.h>
+
+#define CPG_MAX_OSCILLATORS 8
+// Fixed integration step and the most steps one control tick may spend
+#define CPG_STEP_SECONDS 0.001f
+#define CPG_MAX_STEPS_PER_TICK 20
+// How fast the amplitude is pulled back to the limit cycle, 1 / s
+#define CPG_CONVERGENCE_RATE 10.0f
+#define CPG_DEFAULT_COUPLING 2.0f
+
+/*!
+ * Central pattern generator made of coupled Hopf oscillators, see Quadruped_CPG.pdf.
+ *
+ *   dx_i/dt = a (mu_i - r_i^2) x_i - w y_i + sum_j k_ij (cos(t_ij) x_j - sin(t_ij) y_j)
+ *   dy_i/dt = a (mu_i - r_i^2) y_i + w x_i + sum_j k_ij (sin(t_ij) x_j + cos(t_ij) y_j)
+ *
+ * with t_ij = phaseOffset_i - phaseOffset_j and mu_i = 1 - sum_j k_ij / a, which cancels
+ * the outward push of the coupling once locked. Every oscillator converges to a unit circle
+ * rotating at w, locked to the others at the configured offsets. Changing w or the
+ * offsets moves the state continuously instead of jumping, which is what smooths out
+ * speed and gait changes.
+ *
+ * The state of all oscillators is one contiguous array (x0, y0, x1, y1, ...) integrated
+ * with classic RK4 at CPG_STEP_SECONDS. A tick runs at most CPG_MAX_STEPS_PER_TICK
+ * steps, the rest of a long tick is dropped so the CPU cost per tick is bounded.
+ * */
+class HopfCPG {
+private:
+    float state[2 * CPG_MAX_OSCILLATORS];
+    float phaseOffset[CPG_MAX_OSCILLATORS];
+    float couplingGain[CPG_MAX_OSCILLATORS][CPG_MAX_OSCILLATORS];
+    // couplingGain * cos / sin of the relative phase, rebuilt when offsets or gains change
+    float couplingCos[CPG_MAX_OSCILLATORS][CPG_MAX_OSCILLATORS];
+    float couplingSin[CPG_MAX_OSCILLATORS][CPG_MAX_OSCILLATORS];
+    float mu[CPG_MAX_OSCILLATORS];
+    int count;
+    float omega, convergenceRate, pendingSeconds;
+    uint32_t stepCount, droppedSteps;
+    void rebuildCoupling();
+    void derivative(const float *in, float *out);
+    void integrateStep();
+public:
+    HopfCPG();
+    void setCount(int count);
+    int getCount();
+    void setPhaseOffset(int index, float radians);
+    void setCoupling(int i, int j, float gain);
+    /*!
+     * Couples every oscillator to every other with the same gain
+     * */
+    void setUniformCoupling(float gain);
+    /*!
+     * @param omega angular frequency in radians per second, negative runs backwards
+     * */
+    void setFrequency(float omega);
+    /*!
+     * Puts every oscillator on the unit circle at phase + its offset
+     * */
+    void resetToLimitCycle(float phase);
+    /*!
+     * Integrates deltaTime seconds (bounded by CPG_MAX_STEPS_PER_TICK steps).
+     * @return number of RK4 steps run
+     * */
+    int step(float deltaTime);
+    float getX(int index);
+    float getY(int index);
+    /*!
+     * Puts an oscillator back where getX / getY found it, e.g. from a saved state
+     * */
+    void setState(int index, float x, float y);
+    float getPhase(int index);
+    uint32_t getStepCount();
+    uint32_t getDroppedSteps();
+};
+
+#endif
@@ -0,0 +1,306 @@
+#include "CommandReceiver.h"
+#include "ControlLoop.h"
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static uint16_t readLittle16(const uint8_t *data) {
+  return data[0] | (data[1] << 8);
+}
+
+static uint32_t readLittle32(const uint8_t *data) {
+  return readLittle16(data) | ((uint32_t)readLittle16(data + 2) << 16);
+}
+
+static float axisToFloat(int16_t axis) {
+  if (axis < -COMMAND_V2_AXIS_MAX) {
+    axis = -COMMAND_V2_AXIS_MAX;
+  }
+  return (float)axis / COMMAND_V2_AXIS_MAX;
+}
+
+bool commandDecode(const uint8_t *data, int length, CommandFrame *frame) {
+  if (length == COMMAND_SIZE) {
+    memcpy(frame->bytes, data, COMMAND_SIZE);
+    frame->version = COMMAND_VERSION_LEGACY;
+    frame->sequence = 0;
+    frame->senderMicros = 0;
+    frame->velocity = 0;
+    frame->turn = 0;
+    frame->strideLength = 0;
+    frame->strideHeight = 0;
+    return true;
+  }
+  if (length != COMMAND_V2_SIZE || data[0] != COMMAND_V2_MAGIC || data[1] != COMMAND_VERSION_2) {
+    return false;
+  }
+  frame->version = COMMAND_VERSION_2;
+  frame->bytes[1] = data[2];
+  frame->bytes[0] = data[3];
+  frame->sequence = readLittle32(data + 4);
+  frame->senderMicros = readLittle32(data + 8) | ((uint64_t)readLittle32(data + 12) << 32);
+  frame->velocity = axisToFloat((int16_t)readLittle16(data + 16));
+  frame->turn = axisToFloat((int16_t)readLittle16(data + 18));
+  frame->strideLength = data[20];
+  frame->strideHeight = data[21];
+  return true;
+}
+
+CommandReceiver::CommandReceiver()
+    : running(false), wakeRequested(false), pendingState(0), pendingAdjustments(0), receivedCount(0), supersededCount(0),
+      outOfOrderCount(0), staleCount(0), lostCount(0), malformedCount(0) {
+  this->socketFileDescriptor = -1;
+  this->stopFileDescriptor = -1;
+  this->wakeFileDescriptor = -1;
+  this->streamStarted = false;
+  this->lastSequence = 0;
+  this->minimumOffsetNanos = 0;
+  this->previousMinimumOffsetNanos = 0;
+  this->offsetWindowStartNanos = 0;
+}
+
+int CommandReceiver::start(uint16_t port) {
+  this->socketFileDescriptor = socket(AF_INET, SOCK_DGRAM, 0);
+  if (this->socketFileDescriptor < 0) {
+    perror("Unable to open command socket");
+    return -1;
+  }
+
+  // stop() does not depend on traffic, it wakes the thread through its own descriptor
+  this->stopFileDescriptor = eventfd(0, EFD_CLOEXEC);
+  this->wakeFileDescriptor = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (this->stopFileDescriptor < 0 || this->wakeFileDescriptor < 0) {
+    perror("Unable to create the receiver events");
+    return -1;
+  }
+
+  struct sockaddr_in server;
+  memset(&server, 0, sizeof(server));
+  server.sin_addr.s_addr = INADDR_ANY;
+  server.sin_family = AF_INET;
+  server.sin_port = htons(port);
+  if (bind(this->socketFileDescriptor, (struct sockaddr *)&server, sizeof(server)) < 0) {
+    perror("Binding failed\n");
+    return -1;
+  }
+
+  this->running = true;
+  this->receiverThread = std::thread(&CommandReceiver::receiveLoop, this);
+  return 0;
+}
+
+static void signalEvent(int fileDescriptor) {
+  uint64_t one = 1;
+  if (write(fileDescriptor, &one, sizeof(one)) < 0) {
+    perror("Unable to signal an event");
+  }
+}
+
+static void closeDescriptor(int *fileDescriptor) {
+  if (*fileDescriptor >= 0) {
+    close(*fileDescriptor);
+    *fileDescriptor = -1;
+  }
+}
+
+void CommandReceiver::stop() {
+  this->running = false;
+  if (this->receiverThread.joinable()) {
+    signalEvent(this->stopFileDescriptor);
+    this->receiverThread.join();
+  }
+  closeDescriptor(&this->socketFileDescriptor);
+  closeDescriptor(&this->stopFileDescriptor);
+  closeDescriptor(&this->wakeFileDescriptor);
+}
+
+int CommandReceiver::getSocket() {
+  return this->socketFileDescriptor;
+}
+
+int CommandReceiver::getWakeFd() {
+  return this->wakeFileDescriptor;
+}
+
+void CommandReceiver::setWakeOnCommand(bool enabled) {
+  this->wakeRequested = enabled;
+  // Pairs with the fence after publish: either the receiver sees the request or we see its command
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (enabled && this->mailbox.isFresh()) {
+    signalEvent(this->wakeFileDescriptor);
+  }
+}
+
+bool CommandReceiver::takeLatest(CommandFrame *frame) {
+  if (!this->mailbox.take(frame)) {
+    return false;
+  }
+  frame->bytes[1] = this->pendingState.exchange(0, std::memory_order_acquire) |
+                    this->pendingAdjustments.exchange(0, std::memory_order_acquire);
+  return true;
+}
+
+/*!
+ * Byte 1 carries one-shot button presses which must survive their datagram being
+ * superseded. Open/close/move is a 2 bit field where the latest one wins, the stride
+ * and incline bits are independent and accumulate until the control loop takes them.
+ * Must be called before the frame carrying the event is published.
+ */
+void CommandReceiver::latchEvents(uint8_t eventByte) {
+  if ((eventByte & MOVE_PEBBLE) != 0) {
+    this->pendingState.store(eventByte & MOVE_PEBBLE, std::memory_order_release);
+  }
+  uint8_t adjustments = eventByte & ~MOVE_PEBBLE;
+  if (adjustments != 0) {
+    this->pendingAdjustments.fetch_or(adjustments, std::memory_order_release);
+  }
+}
+
+uint32_t CommandReceiver::getReceivedCount() {
+  return this->receivedCount.load(std::memory_order_relaxed);
+}
+
+uint32_t CommandReceiver::getSupersededCount() {
+  return this->supersededCount.load(std::memory_order_relaxed);
+}
+
+uint32_t CommandReceiver::getOutOfOrderCount() {
+  return this->outOfOrderCount.load(std::memory_order_relaxed);
+}
+
+uint32_t CommandReceiver::getStaleCount() {
+  return this->staleCount.load(std::memory_order_relaxed);
+}
+
+uint32_t CommandReceiver::getLostCount() {
+  return this->lostCount.load(std::memory_order_relaxed);
+}
+
+uint32_t CommandReceiver::getMalformedCount() {
+  return this->malformedCount.load(std::memory_order_relaxed);
+}
+
+LatencyHistogram *CommandReceiver::getLatency() {
+  return &this->latency;
+}
+
+/*!
+ * Sequence and staleness checks of a v2 frame, fills in latencyNanos.
+ * The sender clock is unrelated to ours, so latency is measured against the smallest
+ * (receive time - send time) of the last COMMAND_OFFSET_WINDOW_SECONDS or so, i.e. the
+ * fastest recent datagram. Windowed, because the two clocks drift apart: a minimum kept
+ * for the whole stream would make every frame stale after an hour at 100 ppm.
+ * A new sender address or a big step back in the sequence starts a new stream.
+ * @return false if the frame must be dropped
+ */
+bool CommandReceiver::acceptSequenced(CommandFrame *frame) {
+  int64_t offsetNanos = frame->receivedNanos - (int64_t)frame->senderMicros * 1000;
+  int32_t sequenceStep = (int32_t)(frame->sequence - this->lastSequence);
+  bool newSender = frame->sender.sin_addr.s_addr != this->streamSender.sin_addr.s_addr ||
+                   frame->sender.sin_port != this->streamSender.sin_port;
+  if (!this->streamStarted || newSender || sequenceStep < -COMMAND_SEQUENCE_RESTART_WINDOW) {
+    this->streamStarted = true;
+    this->streamSender = frame->sender;
+    this->minimumOffsetNanos = offsetNanos;
+    this->previousMinimumOffsetNanos = offsetNanos;
+    this->offsetWindowStartNanos = frame->receivedNanos;
+  } else if (sequenceStep <= 0) {
+    this->outOfOrderCount.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  } else {
+    this->lostCount.fetch_add(sequenceStep - 1, std::memory_order_relaxed);
+  }
+  this->lastSequence = frame->sequence;
+
+  if (frame->receivedNanos - this->offsetWindowStartNanos >= COMMAND_OFFSET_WINDOW_SECONDS * NANOS_PER_SECOND) {
+    this->previousMinimumOffsetNanos = this->minimumOffsetNanos;
+    this->minimumOffsetNanos = offsetNanos;
+    this->offsetWindowStartNanos = frame->receivedNanos;
+  } else if (offsetNanos < this->minimumOffsetNanos) {
+    this->minimumOffsetNanos = offsetNanos;
+  }
+  int64_t baselineNanos = this->minimumOffsetNanos < this->previousMinimumOffsetNanos ? this->minimumOffsetNanos
+                                                                                      : this->previousMinimumOffsetNanos;
+  frame->latencyNanos = offsetNanos - baselineNanos;
+  this->latency.record(frame->latencyNanos);
+  if (frame->latencyNanos > COMMAND_STALE_MILLISECONDS * NANOS_PER_MILLISECOND) {
+    this->staleCount.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  return true;
+}
+
+void CommandReceiver::receiveLoop() {
+  uint8_t buffers[COMMAND_RECEIVE_BATCH][COMMAND_MAX_SIZE];
+  struct sockaddr_in senders[COMMAND_RECEIVE_BATCH];
+  struct iovec vectors[COMMAND_RECEIVE_BATCH];
+  struct mmsghdr messages[COMMAND_RECEIVE_BATCH];
+
+  struct pollfd events[2];
+  events[0].fd = this->socketFileDescriptor;
+  events[0].events = POLLIN;
+  events[1].fd = this->stopFileDescriptor;
+  events[1].events = POLLIN;
+
+  while (this->running) {
+    if (poll(events, 2, -1) < 0 || (events[1].revents & POLLIN)) {
+      continue;
+    }
+    memset(messages, 0, sizeof(messages));
+    for (int i = 0; i < COMMAND_RECEIVE_BATCH; i++) {
+      vectors[i].iov_base = buffers[i];
+      vectors[i].iov_len = COMMAND_MAX_SIZE;
+      messages[i].msg_hdr.msg_iov = &vectors[i];
+      messages[i].msg_hdr.msg_iovlen = 1;
+      messages[i].msg_hdr.msg_name = &senders[i];
+      messages[i].msg_hdr.msg_namelen = sizeof(senders[i]);
+    }
+
+    // Take whatever is already queued, poll() said there is at least one
+    int count = recvmmsg(this->socketFileDescriptor, messages, COMMAND_RECEIVE_BATCH, MSG_DONTWAIT, NULL);
+    if (count <= 0) {
+      continue;
+    }
+    int64_t receivedNanos = monotonicNanos();
+
+    CommandFrame frame, decoded;
+    int valid = 0;
+    for (int i = 0; i < count; i++) {
+      if ((messages[i].msg_hdr.msg_flags & MSG_TRUNC) ||
+          !commandDecode(buffers[i], messages[i].msg_len, &decoded)) {
+        this->malformedCount.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      }
+      decoded.sender = senders[i];
+      decoded.receivedNanos = receivedNanos;
+      decoded.latencyNanos = 0;
+      if (decoded.version == COMMAND_VERSION_2 && !this->acceptSequenced(&decoded)) {
+        continue;
+      }
+      valid++;
+      this->latchEvents(decoded.bytes[1]);
+      frame = decoded;
+    }
+    if (valid == 0) {
+      continue;
+    }
+
+    // Events travel through the latches, not the frame, so they are applied exactly once
+    frame.bytes[1] = 0;
+
+    uint32_t superseded = valid - 1;
+    if (this->mailbox.publish(frame)) {
+      superseded++;
+    }
+    this->receivedCount.fetch_add(valid, std::memory_order_relaxed);
+    this->supersededCount.fetch_add(superseded, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (this->wakeRequested) {
+      signalEvent(this->wakeFileDescriptor);
+    }
+  }
+}
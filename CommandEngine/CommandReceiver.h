@@ -0,0 +1,127 @@
+#ifndef _COMMAND_RECEIVER_H
+#define _COMMAND_RECEIVER_H
+
+#include <atomic>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <thread>
+#include "commands.h"
+#include "Mailbox.h"
+#include "LoopTiming.h"
+
+#define COMMAND_RECEIVE_BATCH 16
+// v2 datagrams that arrive this much later than the fastest recent one are dropped
+#define COMMAND_STALE_MILLISECONDS 200
+// The fastest datagram is looked for over the last one to two windows, so a sender
+// clock drifting against ours moves the baseline along instead of aging every frame
+#define COMMAND_OFFSET_WINDOW_SECONDS 30
+// A sequence number this far behind the last one means the client restarted
+#define COMMAND_SEQUENCE_RESTART_WINDOW 1000
+
+/*!
+ * One decoded command together with where and when it came from.
+ * Both formats fill bytes with the legacy bitmasks (byte 0 keys, byte 1 events), the
+ * continuous fields are only meaningful for COMMAND_VERSION_2.
+ * */
+struct CommandFrame {
+  uint8_t bytes[COMMAND_SIZE];
+  uint8_t version;
+  uint32_t sequence;
+  uint64_t senderMicros;
+  // -1.0 - 1.0
+  float velocity, turn;
+  // Degrees, 0 keeps the current value
+  uint8_t strideLength, strideHeight;
+  struct sockaddr_in sender;
+  int64_t receivedNanos;
+  // How much later than the fastest recent datagram from this sender it arrived, v2 only
+  int64_t latencyNanos;
+};
+
+/*!
+ * Decodes a legacy or v2 datagram into frame, leaving sender and the times alone.
+ * @return false if the datagram is neither
+ * */
+bool commandDecode(const uint8_t *data, int length, CommandFrame *frame);
+
+/*!
+ * Owns the command socket and a thread that drains it with recvmmsg.
+ * Only the newest command of every batch is handed to the control loop, through a
+ * LatestMailbox, so a backlog of queued datagrams never delays the gait.
+ * The thread sleeps in poll() until a datagram arrives or stop() signals it, there is
+ * no periodic wake up. A control loop that idles can ask to be woken by the next command.
+ * */
+class CommandReceiver {
+private:
+  int socketFileDescriptor;
+  // eventfds: stop() wakes the receiver thread, the receiver wakes an idle control loop
+  int stopFileDescriptor, wakeFileDescriptor;
+  std::thread receiverThread;
+  std::atomic<bool> running, wakeRequested;
+  LatestMailbox<CommandFrame> mailbox;
+  std::atomic<uint8_t> pendingState, pendingAdjustments;
+  std::atomic<uint32_t> receivedCount, supersededCount;
+  std::atomic<uint32_t> outOfOrderCount, staleCount, lostCount, malformedCount;
+  // v2 stream state, only touched by the receiver thread
+  struct sockaddr_in streamSender;
+  bool streamStarted;
+  uint32_t lastSequence;
+  // Smallest (receive time - send time) of the current and of the previous window
+  int64_t minimumOffsetNanos, previousMinimumOffsetNanos;
+  int64_t offsetWindowStartNanos;
+  LatencyHistogram latency;
+  void receiveLoop();
+  void latchEvents(uint8_t eventByte);
+  bool acceptSequenced(CommandFrame *frame);
+public:
+  CommandReceiver();
+  /*!
+   * Binds the UDP port and starts the receiver thread.
+   * @return 0 on success, -1 if the socket could not be set up
+   * */
+  int start(uint16_t port);
+  void stop();
+  /*!
+   * The bound command socket, also used to send telemetry back to clients
+   * */
+  int getSocket();
+  /*!
+   * Called by the control loop once per tick.
+   * @return false if no new command arrived since the last call
+   * */
+  bool takeLatest(CommandFrame *frame);
+  /*!
+   * Readable once a command was published while wake on command is on, see
+   * PeriodicTimer::waitIdle
+   * */
+  int getWakeFd();
+  /*!
+   * Control loop side. While enabled every published command also signals getWakeFd(),
+   * a command that is already waiting when it is enabled signals it at once.
+   * */
+  void setWakeOnCommand(bool enabled);
+  uint32_t getReceivedCount();
+  /*!
+   * Datagrams that were replaced by a newer one before the control loop saw them
+   * */
+  uint32_t getSupersededCount();
+  /*!
+   * v2 datagrams dropped because they were duplicates or older than one already applied
+   * */
+  uint32_t getOutOfOrderCount();
+  /*!
+   * v2 datagrams dropped because they arrived more than COMMAND_STALE_MILLISECONDS late
+   * */
+  uint32_t getStaleCount();
+  /*!
+   * Gaps in the v2 sequence numbers, datagrams that never arrived
+   * */
+  uint32_t getLostCount();
+  uint32_t getMalformedCount();
+  /*!
+   * Arrival latency of v2 datagrams relative to the fastest one, read it after stop()
+   * */
+  LatencyHistogram *getLatency();
+};
+
+#endif
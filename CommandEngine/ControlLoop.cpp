@@ -0,0 +1,137 @@
+#include "ControlLoop.h"
+#include <errno.h>
+#include <malloc.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+void controlLoopDefaultConfig(ControlLoopConfig *config) {
+  config->rateHz = CONTROL_LOOP_RATE_DEFAULT_HZ;
+  config->realtimePriority = CONTROL_LOOP_NO_REALTIME_PRIORITY;
+  config->cpu = CONTROL_LOOP_NO_CPU_AFFINITY;
+}
+
+int controlLoopApplyScheduling(const ControlLoopConfig *config) {
+  int result = 0;
+  if (config->cpu != CONTROL_LOOP_NO_CPU_AFFINITY) {
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(config->cpu, &cpuSet);
+    if (sched_setaffinity(0, sizeof(cpuSet), &cpuSet) < 0) {
+      perror("Unable to pin control loop to cpu");
+      result = -1;
+    }
+  }
+  if (config->realtimePriority != CONTROL_LOOP_NO_REALTIME_PRIORITY) {
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = config->realtimePriority;
+    if (sched_setscheduler(0, SCHED_FIFO, &param) < 0) {
+      perror("Unable to set SCHED_FIFO priority");
+      result = -1;
+    }
+  }
+  return result;
+}
+
+int controlLoopLockMemory() {
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+    perror("Unable to lock memory");
+    return -1;
+  }
+  // Freed memory stays in the heap, and large blocks come from it too instead of mmap
+  mallopt(M_TRIM_THRESHOLD, -1);
+  mallopt(M_MMAP_MAX, 0);
+  return 0;
+}
+
+void controlLoopPrefaultStack() {
+  uint8_t stack[CONTROL_LOOP_STACK_PREFAULT_BYTES];
+  memset(stack, 0, sizeof(stack));
+  // Keeps the compiler from dropping the writes to a buffer nobody reads
+  __asm__ __volatile__("" : : "r"(stack) : "memory");
+}
+
+int64_t monotonicNanos() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)now.tv_sec * NANOS_PER_SECOND + now.tv_nsec;
+}
+
+PeriodicTimer::PeriodicTimer() {
+  this->periodNanos = NANOS_PER_SECOND / CONTROL_LOOP_RATE_DEFAULT_HZ;
+  this->nextWakeNanos = 0;
+  this->scheduledNanos = 0;
+  this->overrunCount = 0;
+}
+
+void PeriodicTimer::start(unsigned int rateHz) {
+  if (rateHz < CONTROL_LOOP_RATE_MIN_HZ)
+    rateHz = CONTROL_LOOP_RATE_MIN_HZ;
+  if (rateHz > CONTROL_LOOP_RATE_MAX_HZ)
+    rateHz = CONTROL_LOOP_RATE_MAX_HZ;
+  this->periodNanos = NANOS_PER_SECOND / rateHz;
+  this->nextWakeNanos = monotonicNanos();
+  this->scheduledNanos = this->nextWakeNanos;
+  this->overrunCount = 0;
+}
+
+int64_t PeriodicTimer::waitNextTick() {
+  this->nextWakeNanos += this->periodNanos;
+
+  struct timespec deadline;
+  deadline.tv_sec = this->nextWakeNanos / NANOS_PER_SECOND;
+  deadline.tv_nsec = this->nextWakeNanos % NANOS_PER_SECOND;
+  // Absolute sleeps can simply be restarted when a signal interrupts them
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+  }
+
+  int64_t now = monotonicNanos();
+  this->scheduledNanos = this->nextWakeNanos;
+  int64_t lateness = now - this->nextWakeNanos;
+  if (lateness >= this->periodNanos) {
+    // Skip the deadlines we slept through but stay on the original phase
+    int64_t missed = lateness / this->periodNanos;
+    this->overrunCount += missed;
+    this->nextWakeNanos += missed * this->periodNanos;
+  }
+  return now;
+}
+
+int64_t PeriodicTimer::waitIdle(int wakeFd, int64_t timeoutNanos) {
+  struct pollfd wake;
+  wake.fd = wakeFd;
+  wake.events = POLLIN;
+  wake.revents = 0;
+  struct timespec timeout;
+  timeout.tv_sec = timeoutNanos / NANOS_PER_SECOND;
+  timeout.tv_nsec = timeoutNanos % NANOS_PER_SECOND;
+  // A negative fd is skipped by ppoll, only the timeout is left then
+  if (ppoll(&wake, 1, &timeout, NULL) > 0 && (wake.revents & POLLIN)) {
+    uint64_t count;
+    if (read(wakeFd, &count, sizeof(count)) < 0) {
+      perror("Unable to drain the wake up event");
+    }
+  }
+
+  int64_t now = monotonicNanos();
+  this->nextWakeNanos = now;
+  this->scheduledNanos = now;
+  return now;
+}
+
+int64_t PeriodicTimer::getScheduledNanos() {
+  return this->scheduledNanos;
+}
+
+int64_t PeriodicTimer::getPeriodNanos() {
+  return this->periodNanos;
+}
+
+uint32_t PeriodicTimer::getOverrunCount() {
+  return this->overrunCount;
+}
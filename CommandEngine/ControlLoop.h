@@ -0,0 +1,91 @@
+#ifndef _CONTROL_LOOP_H
+#define _CONTROL_LOOP_H
+
+#include <stdint.h>
+
+#define CONTROL_LOOP_RATE_MIN_HZ 100
+#define CONTROL_LOOP_RATE_MAX_HZ 1000
+#define CONTROL_LOOP_RATE_DEFAULT_HZ 100
+#define CONTROL_LOOP_NO_REALTIME_PRIORITY 0
+#define CONTROL_LOOP_NO_CPU_AFFINITY -1
+
+// Stack the loop thread has mapped before it starts, see controlLoopPrefaultStack
+#define CONTROL_LOOP_STACK_PREFAULT_BYTES (256 * 1024)
+
+#define NANOS_PER_SECOND 1000000000LL
+#define NANOS_PER_MILLISECOND 1000000LL
+
+/*!
+ * Settings for the fixed rate control loop.
+ * rateHz is clamped to CONTROL_LOOP_RATE_MIN_HZ - CONTROL_LOOP_RATE_MAX_HZ.
+ * realtimePriority is a SCHED_FIFO priority (1 - 99), 0 keeps the default scheduler.
+ * cpu is the core the loop is pinned to, -1 leaves the affinity untouched.
+ * */
+struct ControlLoopConfig {
+  unsigned int rateHz;
+  int realtimePriority;
+  int cpu;
+};
+
+void controlLoopDefaultConfig(ControlLoopConfig *config);
+
+/*!
+ *  @brief  Applies the priority and CPU pinning of config to the calling thread
+ *  @return 0 on success, -1 if any of the requested settings failed
+ */
+int controlLoopApplyScheduling(const ControlLoopConfig *config);
+
+/*!
+ *  @brief  Locks every current and future page of the process into RAM and keeps
+ *  malloc from returning memory to the kernel or serving requests with mmap, so the
+ *  loop does not page fault on memory it already had once it is running
+ *  @return 0 on success, -1 if the pages could not be locked (RLIMIT_MEMLOCK)
+ */
+int controlLoopLockMemory();
+
+/*!
+ *  @brief  Touches CONTROL_LOOP_STACK_PREFAULT_BYTES of the calling thread's stack
+ *  so the pages are mapped (and locked) before the loop first needs them
+ */
+void controlLoopPrefaultStack();
+
+/*!
+ *  @brief  Wall time from CLOCK_MONOTONIC, unaffected by NTP steps
+ */
+int64_t monotonicNanos();
+
+/*!
+ * Wakes the caller at a fixed period on CLOCK_MONOTONIC using absolute deadlines,
+ * so the rate does not drift with the time spent inside a tick.
+ * When a tick overruns, the missed deadlines are skipped (and counted) instead of
+ * being replayed back to back.
+ * */
+class PeriodicTimer {
+private:
+  int64_t periodNanos, nextWakeNanos, scheduledNanos;
+  uint32_t overrunCount;
+public:
+  PeriodicTimer();
+  void start(unsigned int rateHz);
+  /*!
+   * Sleeps until the next deadline.
+   * @return the time the caller actually woke up at, in nanoseconds
+   * */
+  int64_t waitNextTick();
+  /*!
+   * Sleeps until wakeFd becomes readable or timeoutNanos passed, whichever is first,
+   * and drains wakeFd (an eventfd). The period restarts at the wake up, so the next
+   * waitNextTick is a full period later. Returns early on a signal.
+   * @param wakeFd -1 to only wait for the timeout
+   * @return the time the caller actually woke up at, in nanoseconds
+   * */
+  int64_t waitIdle(int wakeFd, int64_t timeoutNanos);
+  /*!
+   * Deadline the last waitNextTick was aiming for. Wake time minus this is the jitter.
+   * */
+  int64_t getScheduledNanos();
+  int64_t getPeriodNanos();
+  uint32_t getOverrunCount();
+};
+
+#endif
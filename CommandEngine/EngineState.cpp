@@ -0,0 +1,111 @@
+#include "EngineState.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*!
+ * Identifies the current boot, empty if the kernel does not tell
+ * */
+static void readBootId(char bootId[ENGINE_STATE_BOOT_ID_BYTES]) {
+  memset(bootId, 0, ENGINE_STATE_BOOT_ID_BYTES);
+  FILE *file = fopen("/proc/sys/kernel/random/boot_id", "r");
+  if (file == NULL) {
+    return;
+  }
+  if (fgets(bootId, ENGINE_STATE_BOOT_ID_BYTES, file) == NULL) {
+    bootId[0] = '\0';
+  }
+  fclose(file);
+}
+
+EngineState::EngineState() {
+  this->file = NULL;
+  this->sameBoot = false;
+}
+
+EngineState::~EngineState() {
+  this->close();
+}
+
+int EngineState::open(const char *path) {
+  this->close();
+  int fd = ::open(path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    perror("Unable to open engine state");
+    return -1;
+  }
+  struct stat status;
+  if (fstat(fd, &status) < 0) {
+    perror("Unable to stat engine state");
+    ::close(fd);
+    return -1;
+  }
+  bool sized = (size_t)status.st_size == sizeof(EngineStateFile);
+  if (!sized && ftruncate(fd, sizeof(EngineStateFile)) < 0) {
+    perror("Unable to size engine state");
+    ::close(fd);
+    return -1;
+  }
+  void *mapping = mmap(NULL, sizeof(EngineStateFile), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    perror("Unable to map engine state");
+    return -1;
+  }
+  this->file = (EngineStateFile *)mapping;
+
+  char bootId[ENGINE_STATE_BOOT_ID_BYTES];
+  readBootId(bootId);
+  if (!sized || memcmp(this->file->magic, ENGINE_STATE_MAGIC, sizeof(this->file->magic)) != 0 ||
+      this->file->version != ENGINE_STATE_VERSION || this->file->servoCount != SERVO_COUNT ||
+      this->file->legCount != LEG_COUNT || this->file->slotSize != sizeof(EngineStateSlot)) {
+    // Nothing usable in there, start over
+    memset(this->file, 0, sizeof(EngineStateFile));
+    memcpy(this->file->magic, ENGINE_STATE_MAGIC, sizeof(this->file->magic));
+    this->file->version = ENGINE_STATE_VERSION;
+    this->file->servoCount = SERVO_COUNT;
+    this->file->legCount = LEG_COUNT;
+    this->file->slotSize = sizeof(EngineStateSlot);
+  }
+  this->sameBoot = bootId[0] != '\0' && memcmp(this->file->bootId, bootId, sizeof(bootId)) == 0;
+  memcpy(this->file->bootId, bootId, sizeof(bootId));
+  return 0;
+}
+
+void EngineState::close() {
+  if (this->file != NULL) {
+    munmap(this->file, sizeof(EngineStateFile));
+    this->file = NULL;
+  }
+}
+
+bool EngineState::isOpen() {
+  return this->file != NULL;
+}
+
+const EngineStateSlot *EngineState::load() {
+  uint64_t saved = __atomic_load_n(&this->file->saved, __ATOMIC_ACQUIRE);
+  if (saved == 0) {
+    return NULL;
+  }
+  return &this->file->slots[(saved - 1) % ENGINE_STATE_SLOT_COUNT];
+}
+
+bool EngineState::isSameBoot() {
+  return this->sameBoot;
+}
+
+void EngineState::save(int64_t nowNanos, GaitControl *gait, CameraServo *camera) {
+  uint64_t saved = this->file->saved;
+  EngineStateSlot *slot = &this->file->slots[saved % ENGINE_STATE_SLOT_COUNT];
+  slot->savedNanos = nowNanos;
+  slot->pwmEpochNanos = servoDriverGetPwmEpochNanos();
+  slot->cameraPosition = camera->getPosition();
+  memcpy(slot->servoTicks, servoPositions, sizeof(slot->servoTicks));
+  gait->saveSnapshot(&slot->gait);
+  // Count the slot only once it is complete, a crash mid save leaves the previous one
+  __atomic_store_n(&this->file->saved, saved + 1, __ATOMIC_RELEASE);
+}
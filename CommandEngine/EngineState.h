@@ -0,0 +1,68 @@
+#ifndef _ENGINE_STATE_H
+#define _ENGINE_STATE_H
+
+#include <stdint.h>
+#include "ServoDriver.h"
+#include "gait.h"
+
+#define ENGINE_STATE_MAGIC "PBLSTAT"
+#define ENGINE_STATE_VERSION 2
+// Two copies, one is written while the other stays complete
+#define ENGINE_STATE_SLOT_COUNT 2
+// /proc/sys/kernel/random/boot_id, CLOCK_MONOTONIC times only compare within one boot
+#define ENGINE_STATE_BOOT_ID_BYTES 40
+
+/*!
+ * Where the engine was at the end of a tick
+ * */
+struct EngineStateSlot {
+  int64_t savedNanos;
+  int64_t pwmEpochNanos;
+  int32_t cameraPosition;
+  uint16_t servoTicks[SERVO_COUNT];
+  GaitSnapshot gait;
+};
+
+struct EngineStateFile {
+  char magic[8];
+  uint32_t version, servoCount, legCount, slotSize;
+  char bootId[ENGINE_STATE_BOOT_ID_BYTES];
+  // Slots saved so far, the newest complete one is (saved - 1) % ENGINE_STATE_SLOT_COUNT
+  volatile uint64_t saved;
+  EngineStateSlot slots[ENGINE_STATE_SLOT_COUNT];
+};
+
+/*!
+ * The engine state kept in a small memory mapped file, so a restarted engine carries
+ * on with the pose and gait of the previous one.
+ * Saving is a copy into the mapping and never a system call, cheap enough for every
+ * tick, and the kernel writes the page back even if the engine crashes. A save goes
+ * into the slot that is not the newest and is only counted once it is complete, so a
+ * crash in the middle of one leaves the previous slot to load.
+ * */
+class EngineState {
+private:
+  EngineStateFile *file;
+  bool sameBoot;
+public:
+  EngineState();
+  ~EngineState();
+  /*!
+   * Maps the file, creating it if it is missing or was written by another build
+   * @return 0 on success, -1 on error
+   * */
+  int open(const char *path);
+  void close();
+  bool isOpen();
+  /*!
+   * The newest complete state, NULL if nothing was saved yet
+   * */
+  const EngineStateSlot *load();
+  /*!
+   * True if the state was saved since the last boot, its CLOCK_MONOTONIC times still count
+   * */
+  bool isSameBoot();
+  void save(int64_t nowNanos, GaitControl *gait, CameraServo *camera);
+};
+
+#endif
@@ -0,0 +1,60 @@
+#include "GaitCache.h"
+#include "Oscillator.h"
+#include "ServoCalibration.h"
+#include <cmath>
+
+GaitCacheStats gaitCacheStats;
+
+ServoTrajectory::ServoTrajectory() {
+    this->invalidate();
+}
+
+void ServoTrajectory::invalidate() {
+    this->valid = false;
+    this->amplitude = this->center = 0.0f;
+    this->phaseShift = 0;
+    // NaN never compares equal, so the first miss starts counting from scratch
+    this->pendingAmplitude = this->pendingCenter = NAN;
+    this->pendingPhaseShift = 0;
+    this->pendingEvaluations = 0;
+}
+
+bool ServoTrajectory::isValid() {
+    return this->valid;
+}
+
+void ServoTrajectory::build(uint8_t channel, GaitCacheStats *stats) {
+    oscillatorInitTable();
+    for (int i = 0; i < GAIT_CACHE_SIZE; i++) {
+        uint32_t phase = (uint32_t)i << (32 - GAIT_CACHE_BITS);
+        this->keyframes[i] = servoAngleToTicks(channel, this->center + this->amplitude * phaseSin(phase + this->phaseShift));
+    }
+    // Interpolation past the last keyframe wraps to the first
+    this->keyframes[GAIT_CACHE_SIZE] = this->keyframes[0];
+    this->valid = true;
+    stats->rebuilds++;
+}
+
+bool ServoTrajectory::evaluate(uint8_t channel, float amplitude, float center, uint32_t phaseShift, uint32_t phase, uint16_t *ticks,
+                               GaitCacheStats *stats) {
+    if (!this->valid || amplitude != this->amplitude || center != this->center || phaseShift != this->phaseShift) {
+        if (amplitude != this->pendingAmplitude || center != this->pendingCenter || phaseShift != this->pendingPhaseShift) {
+            this->pendingAmplitude = amplitude;
+            this->pendingCenter = center;
+            this->pendingPhaseShift = phaseShift;
+            this->pendingEvaluations = 0;
+        }
+        if (++this->pendingEvaluations < GAIT_CACHE_SETTLE_EVALUATIONS) {
+            stats->liveEvaluations++;
+            *ticks = servoAngleToTicks(channel, center + amplitude * phaseSin(phase + phaseShift));
+            return false;
+        }
+        this->amplitude = amplitude;
+        this->center = center;
+        this->phaseShift = phaseShift;
+        this->build(channel, stats);
+    }
+    stats->playbacks++;
+    *ticks = this->sample(phase);
+    return true;
+}
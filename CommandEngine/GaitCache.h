@@ -0,0 +1,76 @@
+#ifndef _GAIT_CACHE_H
+#define _GAIT_CACHE_H
+
+#include <stdint.h>
+
+/*!
+ * One gait cycle of one servo is stored as GAIT_CACHE_SIZE tick keyframes. Playback
+ * interpolates between neighbouring keyframes with GAIT_CACHE_FRACTION_BITS of the
+ * phase, in integers. With 512 keyframes the interpolation error of a 90 tick stride
+ * is below 0.01 ticks, so the output matches the live path to within the rounding of
+ * the keyframes (one tick at most).
+ * */
+#define GAIT_CACHE_BITS 9
+#define GAIT_CACHE_SIZE (1 << GAIT_CACHE_BITS)
+#define GAIT_CACHE_FRACTION_BITS 8
+// Evaluations a new parameter set has to hold for before its keyframes are built
+#define GAIT_CACHE_SETTLE_EVALUATIONS 10
+
+struct GaitCacheStats {
+    uint32_t playbacks, liveEvaluations, rebuilds;
+};
+
+extern GaitCacheStats gaitCacheStats;
+
+/*!
+ * Trajectory of one servo over a gait cycle:
+ *   angle(phase) = center + amplitude * sin(phase + phaseShift)
+ * converted to ticks through the channel's calibration table.
+ *
+ * The keyframes are rebuilt only when the trajectory parameters change, and only once
+ * they have held still for GAIT_CACHE_SETTLE_EVALUATIONS ticks, so a stride that is
+ * still accelerating does not rebuild every tick. Until then the servo is evaluated live, which gives the same
+ * angles.
+ * */
+class ServoTrajectory {
+private:
+    uint16_t keyframes[GAIT_CACHE_SIZE + 1];
+    float amplitude, center;
+    uint32_t phaseShift;
+    bool valid;
+    // Parameters seen on the last miss and for how many evaluations they have held
+    float pendingAmplitude, pendingCenter;
+    uint32_t pendingPhaseShift;
+    int pendingEvaluations;
+    void build(uint8_t channel, GaitCacheStats *stats);
+public:
+    ServoTrajectory();
+    /*!
+     * Ticks at phase straight from the keyframes, only valid after evaluate() returned
+     * true for the current parameters
+     * */
+    inline uint16_t sample(uint32_t phase) {
+        uint32_t index = phase >> (32 - GAIT_CACHE_BITS);
+        int32_t fraction = (phase >> (32 - GAIT_CACHE_BITS - GAIT_CACHE_FRACTION_BITS)) & ((1 << GAIT_CACHE_FRACTION_BITS) - 1);
+        int32_t low = this->keyframes[index];
+        int32_t high = this->keyframes[index + 1];
+        return low + (((high - low) * fraction + (1 << (GAIT_CACHE_FRACTION_BITS - 1))) >> GAIT_CACHE_FRACTION_BITS);
+    }
+    /*!
+     * Drops the keyframes, e.g. after the calibration of the channel changed
+     * */
+    void invalidate();
+    bool isValid();
+    /*!
+     * Ticks of the channel at phase into *ticks, from the keyframes if they were built
+     * for these parameters, live otherwise.
+     * @param phase fixed point phase as used by OscillatorBank, 2^32 is one turn
+     * @param stats counts the playbacks, live evaluations and rebuilds
+     * @return true if the keyframes match the parameters, sample() can be used until
+     * they change
+     * */
+    bool evaluate(uint8_t channel, float amplitude, float center, uint32_t phaseShift, uint32_t phase, uint16_t *ticks,
+                  GaitCacheStats *stats);
+};
+
+#endif
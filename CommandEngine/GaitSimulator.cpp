@@ -0,0 +1,146 @@
+#include "GaitSimulator.h"
+#include "ServoCalibration.h"
+#include <cmath>
+
+GaitSimulator::GaitSimulator() {
+    for (int i = 0; i < LEG_COUNT; i++) {
+        float position = LEG_COUNT_PER_SIDE == 1 ? 0.5f : (float)legPosition(i) / (LEG_COUNT_PER_SIDE - 1);
+        this->hipX[i] = SIMULATOR_BODY_LENGTH_MM * (0.5f - position);
+        this->hipY[i] = (legSide(i) == 0 ? 0.5f : -0.5f) * SIMULATOR_BODY_WIDTH_MM;
+        this->zCenter[i] = 0;
+        this->xCenter[i] = 0;
+    }
+    this->frames = 0;
+    this->clearMetrics();
+}
+
+void GaitSimulator::reset(GaitControl *gait) {
+    for (int i = 0; i < LEG_COUNT; i++) {
+        this->zCenter[i] = gait->getLegZCenter(i);
+        this->xCenter[i] = gait->getLegXCenter(i);
+    }
+    this->frames = 0;
+    this->clearMetrics();
+}
+
+void GaitSimulator::clearMetrics() {
+    this->seconds = 0;
+    this->forward = 0;
+    this->lateral = 0;
+    this->yaw = 0;
+    this->slip = 0;
+    this->travel = 0;
+    this->accelerationSquares = 0;
+    this->accelerationSamples = 0;
+    this->supportSum = 0;
+    this->measuredFrames = 0;
+}
+
+void GaitSimulator::step(const uint16_t *servoTicks, float deltaTime) {
+    float yawDegrees[LEG_COUNT], liftDegrees[LEG_COUNT];
+    for (int i = 0; i < LEG_COUNT; i++) {
+        yawDegrees[i] = servoTicksToAngle(2 * i, servoTicks[2 * i]) - this->zCenter[i];
+        liftDegrees[i] = servoTicksToAngle(2 * i + 1, servoTicks[2 * i + 1]) - this->xCenter[i];
+        if (legSide(i) == 1) {
+            liftDegrees[i] = -liftDegrees[i];
+        }
+    }
+    float strideMm[LEG_COUNT], liftMm[LEG_COUNT];
+    this->kinematics.forward(yawDegrees, liftDegrees, strideMm, liftMm, LEG_COUNT);
+
+    float x[LEG_COUNT], y[LEG_COUNT], lowest = liftMm[0];
+    for (int i = 0; i < LEG_COUNT; i++) {
+        float femur = this->kinematics.getFemur();
+        float reach = this->kinematics.getCoxa() + sqrtf(fmaxf(femur * femur - liftMm[i] * liftMm[i], 0.0f));
+        float outward = sqrtf(fmaxf(reach * reach - strideMm[i] * strideMm[i], 0.0f));
+        x[i] = this->hipX[i] - strideMm[i];
+        y[i] = this->hipY[i] + (legSide(i) == 0 ? outward : -outward);
+        lowest = fminf(lowest, liftMm[i]);
+    }
+    bool touching[LEG_COUNT];
+    for (int i = 0; i < LEG_COUNT; i++) {
+        touching[i] = liftMm[i] - lowest <= SIMULATOR_CONTACT_MM;
+    }
+
+    if (this->frames > 0 && deltaTime > 0) {
+        // Least squares planar motion of the feet that stayed on the ground: each foot
+        // moves by d = -t - w x p in the body frame for a body motion t, w
+        float meanPx = 0, meanPy = 0, meanDx = 0, meanDy = 0;
+        int count = 0;
+        for (int i = 0; i < LEG_COUNT; i++) {
+            if (this->contact[i] && touching[i]) {
+                meanPx += this->footX[i];
+                meanPy += this->footY[i];
+                meanDx += x[i] - this->footX[i];
+                meanDy += y[i] - this->footY[i];
+                count++;
+            }
+        }
+        if (count > 0) {
+            meanPx /= count;
+            meanPy /= count;
+            meanDx /= count;
+            meanDy /= count;
+            float cross = 0, spread = 0;
+            for (int i = 0; i < LEG_COUNT; i++) {
+                if (this->contact[i] && touching[i]) {
+                    float px = this->footX[i] - meanPx, py = this->footY[i] - meanPy;
+                    float dx = x[i] - this->footX[i] - meanDx, dy = y[i] - this->footY[i] - meanDy;
+                    cross += px * dy - py * dx;
+                    spread += px * px + py * py;
+                }
+            }
+            float w = spread > 1e-6f ? -cross / spread : 0.0f;
+            float tx = -meanDx + w * meanPy, ty = -meanDy - w * meanPx;
+            for (int i = 0; i < LEG_COUNT; i++) {
+                if (this->contact[i] && touching[i]) {
+                    float rx = x[i] - this->footX[i] + tx - w * this->footY[i];
+                    float ry = y[i] - this->footY[i] + ty + w * this->footX[i];
+                    this->slip += sqrtf(rx * rx + ry * ry);
+                }
+            }
+            this->forward += tx;
+            this->lateral += ty;
+            this->yaw += w;
+        }
+
+        for (int channel = 0; channel < 2 * LEG_COUNT; channel++) {
+            float angle = channel % 2 == 0 ? yawDegrees[channel / 2] : liftDegrees[channel / 2];
+            float rate = (angle - this->angles[channel]) / deltaTime;
+            this->travel += fabsf(angle - this->angles[channel]);
+            if (this->frames > 1) {
+                float acceleration = (rate - this->angleRates[channel]) / deltaTime;
+                this->accelerationSquares += acceleration * acceleration;
+                this->accelerationSamples++;
+            }
+            this->angleRates[channel] = rate;
+        }
+        this->seconds += deltaTime;
+        this->measuredFrames++;
+        for (int i = 0; i < LEG_COUNT; i++) {
+            this->supportSum += touching[i];
+        }
+    }
+
+    for (int i = 0; i < LEG_COUNT; i++) {
+        this->footX[i] = x[i];
+        this->footY[i] = y[i];
+        this->contact[i] = touching[i];
+        this->angles[2 * i] = yawDegrees[i];
+        this->angles[2 * i + 1] = liftDegrees[i];
+    }
+    this->frames++;
+}
+
+GaitMetrics GaitSimulator::getMetrics() {
+    GaitMetrics metrics;
+    double seconds = this->seconds > 0 ? this->seconds : 1;
+    metrics.forwardSpeed = this->forward / seconds;
+    metrics.lateralSpeed = this->lateral / seconds;
+    metrics.yawRate = this->yaw * (180 / M_PI) / seconds;
+    metrics.slip = this->slip / seconds;
+    metrics.servoTravel = this->travel / seconds;
+    metrics.roughness = this->accelerationSamples > 0 ? sqrt(this->accelerationSquares / this->accelerationSamples) : 0;
+    metrics.support = this->measuredFrames > 0 ? (float)this->supportSum / this->measuredFrames : 0;
+    return metrics;
+}
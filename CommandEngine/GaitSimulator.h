@@ -0,0 +1,84 @@
+#ifndef _GAIT_SIMULATOR_H
+#define _GAIT_SIMULATOR_H
+
+#include <stdint.h>
+#include "LegKinematics.h"
+#include "gait.h"
+
+/*!
+ * Where the hips sit, millimetres. The legs of a side are spread evenly from the front
+ * to the rear end of the body. Set by the build for other bodies.
+ * */
+#ifndef SIMULATOR_BODY_LENGTH_MM
+#define SIMULATOR_BODY_LENGTH_MM 120.0f
+#endif
+#ifndef SIMULATOR_BODY_WIDTH_MM
+#define SIMULATOR_BODY_WIDTH_MM 60.0f
+#endif
+// Feet at most this far (millimetres) above the lowest one carry weight
+#define SIMULATOR_CONTACT_MM 2.0f
+
+/*!
+ * What a gait did over the measured ticks, per second of simulated time
+ * */
+struct GaitMetrics {
+    // Millimetres per second in the body frame, forward and to the left
+    float forwardSpeed, lateralSpeed;
+    // Degrees per second, positive turns left
+    float yawRate;
+    // Millimetres per second the feet in contact slid over the ground, summed over the feet
+    float slip;
+    // Degrees per second the leg servos turned, summed over the servos, an energy proxy
+    float servoTravel;
+    // RMS angular acceleration of the leg servos, degrees per second squared, lower is smoother
+    float roughness;
+    // Feet in contact, on average
+    float support;
+};
+
+/*!
+ * Kinematic and contact model of the body on flat ground, driven by the servo frames
+ * GaitControl writes, so it sees what the servos would get: calibration, tick rounding
+ * and keyframes included.
+ * Every frame the leg servo ticks go back to joint angles through the calibration and
+ * LegKinematics places the feet. The lowest foot is on the ground, every foot within
+ * SIMULATOR_CONTACT_MM of it too. The body moves so that the feet in contact move as
+ * little as possible over the ground: the least squares planar motion (translation and
+ * yaw) of the feet that were in contact on both frames. Whatever the feet still move
+ * after that is slip. There is no dynamics, the body does not tip or sink.
+ * Conventions: a positive yaw angle swings the foot to the rear, a positive lift angle
+ * raises it. The right side is mounted mirrored, its lift servos turn the other way,
+ * which is what makes gaitPatternLag hold in the body frame.
+ * */
+class GaitSimulator {
+private:
+    LegKinematics kinematics;
+    float hipX[LEG_COUNT], hipY[LEG_COUNT];
+    float zCenter[LEG_COUNT], xCenter[LEG_COUNT];
+    float footX[LEG_COUNT], footY[LEG_COUNT];
+    bool contact[LEG_COUNT];
+    float angles[2 * LEG_COUNT], angleRates[2 * LEG_COUNT];
+    // Frames seen since reset, the first one only places the feet
+    uint32_t frames;
+    double seconds, forward, lateral, yaw, slip, travel, accelerationSquares;
+    uint64_t accelerationSamples, supportSum, measuredFrames;
+public:
+    GaitSimulator();
+    /*!
+     * Starts over with the legs of gait, the joint angle zero points are read from it.
+     * Call again when its stride length or height changes.
+     * */
+    void reset(GaitControl *gait);
+    /*!
+     * Starts a new measurement from the current pose, e.g. once the gait has settled
+     * */
+    void clearMetrics();
+    /*!
+     * Advances the model to servoTicks (a whole frame, SERVO_COUNT channels)
+     * @param deltaTime seconds since the previous frame
+     * */
+    void step(const uint16_t *servoTicks, float deltaTime);
+    GaitMetrics getMetrics();
+};
+
+#endif
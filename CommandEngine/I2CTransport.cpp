@@ -0,0 +1,136 @@
+#include "I2CTransport.h"
+#include <fcntl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#ifdef HAVE_PIGPIO
+#include <pigpio.h>
+#endif
+
+// Largest single write the driver issues: register address + 16 channels * 4 bytes
+#define I2C_MAX_WRITE_LENGTH 65
+
+#ifdef HAVE_PIGPIO
+PigpioTransport::PigpioTransport() {
+  this->handle = -1;
+}
+
+int PigpioTransport::open(unsigned int bus, uint8_t address) {
+  // Initialize GPIO library
+  if (gpioInitialise() < 0) {
+    perror("Unable to init GPIO library");
+    return -1;
+  }
+  this->handle = i2cOpen(bus, address, 0);
+  if (this->handle < 0) {
+    perror("Init failed.\n");
+  }
+  return this->handle;
+}
+
+void PigpioTransport::close() {
+  if (this->handle >= 0 && i2cClose(this->handle) != 0) {
+    perror("Unable to close device, not open");
+  }
+  this->handle = -1;
+}
+
+int PigpioTransport::writeDevice(const uint8_t *data, unsigned int length) {
+  return i2cWriteDevice(this->handle, (char *)data, length);
+}
+
+int PigpioTransport::writeByteData(uint8_t reg, uint8_t value) {
+  return i2cWriteByteData(this->handle, reg, value);
+}
+
+int PigpioTransport::readByteData(uint8_t reg) {
+  return i2cReadByteData(this->handle, reg);
+}
+
+int PigpioTransport::readBlockData(uint8_t reg, uint8_t *data, unsigned int length) {
+  return i2cReadI2CBlockData(this->handle, reg, (char *)data, length);
+}
+#endif
+
+LinuxI2CTransport::LinuxI2CTransport() {
+  this->fileDescriptor = -1;
+  this->address = 0;
+}
+
+int LinuxI2CTransport::open(unsigned int bus, uint8_t address) {
+  char path[32];
+  snprintf(path, sizeof(path), "/dev/i2c-%u", bus);
+  this->fileDescriptor = ::open(path, O_RDWR);
+  if (this->fileDescriptor < 0) {
+    perror("Unable to open i2c device");
+    return -1;
+  }
+  this->address = address;
+  return this->fileDescriptor;
+}
+
+void LinuxI2CTransport::close() {
+  if (this->fileDescriptor >= 0) {
+    ::close(this->fileDescriptor);
+  }
+  this->fileDescriptor = -1;
+}
+
+/*!
+ * One I2C_RDWR ioctl: an optional write followed by an optional read with a repeated
+ * start in between, so the register pointer cannot be changed by anyone else.
+ */
+int LinuxI2CTransport::transfer(uint8_t *writeData, unsigned int writeLength, uint8_t *readData, unsigned int readLength) {
+  struct i2c_msg messages[2];
+  int messageCount = 0;
+  if (writeLength > 0) {
+    messages[messageCount].addr = this->address;
+    messages[messageCount].flags = 0;
+    messages[messageCount].len = writeLength;
+    messages[messageCount].buf = writeData;
+    messageCount++;
+  }
+  if (readLength > 0) {
+    messages[messageCount].addr = this->address;
+    messages[messageCount].flags = I2C_M_RD;
+    messages[messageCount].len = readLength;
+    messages[messageCount].buf = readData;
+    messageCount++;
+  }
+  struct i2c_rdwr_ioctl_data request;
+  request.msgs = messages;
+  request.nmsgs = messageCount;
+  return ioctl(this->fileDescriptor, I2C_RDWR, &request);
+}
+
+int LinuxI2CTransport::writeDevice(const uint8_t *data, unsigned int length) {
+  if (length > I2C_MAX_WRITE_LENGTH) {
+    return -1;
+  }
+  uint8_t buffer[I2C_MAX_WRITE_LENGTH];
+  memcpy(buffer, data, length);
+  return this->transfer(buffer, length, NULL, 0);
+}
+
+int LinuxI2CTransport::writeByteData(uint8_t reg, uint8_t value) {
+  uint8_t buffer[2] = {reg, value};
+  return this->transfer(buffer, 2, NULL, 0);
+}
+
+int LinuxI2CTransport::readByteData(uint8_t reg) {
+  uint8_t value;
+  if (this->transfer(&reg, 1, &value, 1) < 0) {
+    return -1;
+  }
+  return value;
+}
+
+int LinuxI2CTransport::readBlockData(uint8_t reg, uint8_t *data, unsigned int length) {
+  if (this->transfer(&reg, 1, data, length) < 0) {
+    return -1;
+  }
+  return length;
+}
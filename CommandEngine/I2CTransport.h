@@ -0,0 +1,72 @@
+#ifndef _I2C_TRANSPORT_H
+#define _I2C_TRANSPORT_H
+
+#include <stdint.h>
+
+#define I2C_TRANSPORT_PIGPIO 0
+#define I2C_TRANSPORT_LINUX 1
+#define I2C_TRANSPORT_SIMULATED 2
+
+/*!
+ * Register level access to one device on an I2C bus.
+ * All calls return a negative value on failure.
+ * */
+class I2CTransport {
+public:
+  virtual ~I2CTransport() {}
+  virtual int open(unsigned int bus, uint8_t address) = 0;
+  virtual void close() = 0;
+  /*!
+   * Writes data as one transaction. The first byte is the register address,
+   * the device auto-increments through the rest if it is configured to.
+   * */
+  virtual int writeDevice(const uint8_t *data, unsigned int length) = 0;
+  virtual int writeByteData(uint8_t reg, uint8_t value) = 0;
+  /*!
+   * @return the register value (0 - 255) or a negative value on failure
+   * */
+  virtual int readByteData(uint8_t reg) = 0;
+  /*!
+   * Reads length consecutive registers starting at reg in one combined transaction.
+   * */
+  virtual int readBlockData(uint8_t reg, uint8_t *data, unsigned int length) = 0;
+};
+
+#ifdef HAVE_PIGPIO
+/*!
+ * Goes through the pigpio library, which needs to run as root and owns the GPIO setup.
+ * */
+class PigpioTransport : public I2CTransport {
+private:
+  int handle;
+public:
+  PigpioTransport();
+  int open(unsigned int bus, uint8_t address);
+  void close();
+  int writeDevice(const uint8_t *data, unsigned int length);
+  int writeByteData(uint8_t reg, uint8_t value);
+  int readByteData(uint8_t reg);
+  int readBlockData(uint8_t reg, uint8_t *data, unsigned int length);
+};
+#endif
+
+/*!
+ * Talks to /dev/i2c-N directly with I2C_RDWR, so there is no daemon in between and
+ * a register read is a single combined write + repeated start + read transaction.
+ * */
+class LinuxI2CTransport : public I2CTransport {
+private:
+  int fileDescriptor;
+  uint8_t address;
+  int transfer(uint8_t *writeData, unsigned int writeLength, uint8_t *readData, unsigned int readLength);
+public:
+  LinuxI2CTransport();
+  int open(unsigned int bus, uint8_t address);
+  void close();
+  int writeDevice(const uint8_t *data, unsigned int length);
+  int writeByteData(uint8_t reg, uint8_t value);
+  int readByteData(uint8_t reg);
+  int readBlockData(uint8_t reg, uint8_t *data, unsigned int length);
+};
+
+#endif
@@ -0,0 +1,85 @@
+#include "IdlePolicy.h"
+#include "ControlLoop.h"
+
+IdlePolicy::IdlePolicy() {
+  this->configure(0, IDLE_DEFAULT_RATE_HZ, IDLE_ACTION_HOLD);
+  for (int i = 0; i < SERVO_COUNT; i++) {
+    this->releasedChannels[i] = false;
+  }
+  this->idle = false;
+  this->lastActivityNanos = 0;
+  this->enteredNanos = 0;
+  this->idleNanos = 0;
+  this->entryCount = 0;
+}
+
+void IdlePolicy::configure(int64_t quietNanos, unsigned int rateHz, int action) {
+  if (rateHz < IDLE_RATE_MIN_HZ)
+    rateHz = IDLE_RATE_MIN_HZ;
+  if (rateHz > IDLE_RATE_MAX_HZ)
+    rateHz = IDLE_RATE_MAX_HZ;
+  this->quietNanos = quietNanos;
+  this->periodNanos = NANOS_PER_SECOND / rateHz;
+  this->action = action;
+}
+
+void IdlePolicy::releaseChannel(int channel) {
+  if (channel >= 0 && channel < SERVO_COUNT) {
+    this->releasedChannels[channel] = true;
+  }
+}
+
+bool IdlePolicy::isEnabled() {
+  return this->quietNanos > 0;
+}
+
+bool IdlePolicy::isIdle() {
+  return this->idle;
+}
+
+int IdlePolicy::getAction() {
+  return this->action;
+}
+
+int64_t IdlePolicy::getPeriodNanos() {
+  return this->periodNanos;
+}
+
+void IdlePolicy::noteActivity(int64_t nowNanos) {
+  this->lastActivityNanos = nowNanos;
+}
+
+bool IdlePolicy::isQuiet(int64_t nowNanos) {
+  return this->isEnabled() && !this->idle && nowNanos - this->lastActivityNanos >= this->quietNanos;
+}
+
+void IdlePolicy::enter(int64_t nowNanos) {
+  this->idle = true;
+  this->enteredNanos = nowNanos;
+  this->entryCount++;
+}
+
+void IdlePolicy::leave(int64_t nowNanos, int64_t wakeLatencyNanos) {
+  this->idle = false;
+  this->idleNanos += nowNanos - this->enteredNanos;
+  this->lastActivityNanos = nowNanos;
+  this->wakeLatency.record(wakeLatencyNanos);
+}
+
+void IdlePolicy::releaseFrame(const uint16_t *ticks, uint16_t *released) {
+  for (int i = 0; i < SERVO_COUNT; i++) {
+    released[i] = this->releasedChannels[i] ? SERVO_TICKS_OFF : ticks[i];
+  }
+}
+
+uint32_t IdlePolicy::getEntryCount() {
+  return this->entryCount;
+}
+
+int64_t IdlePolicy::getIdleNanos(int64_t nowNanos) {
+  return this->idleNanos + (this->idle ? nowNanos - this->enteredNanos : 0);
+}
+
+LatencyHistogram *IdlePolicy::getWakeLatency() {
+  return &this->wakeLatency;
+}
@@ -0,0 +1,74 @@
+#ifndef _IDLE_POLICY_H
+#define _IDLE_POLICY_H
+
+#include <stdint.h>
+#include "LoopTiming.h"
+#include "ServoDriver.h"
+
+// What happens to the servos while parked, each one includes the ones before it
+#define IDLE_ACTION_HOLD 0    /**< no bus traffic, the servos keep their torque */
+#define IDLE_ACTION_RELEASE 1 /**< the chosen channels are turned off, the rest hold */
+#define IDLE_ACTION_SLEEP 2   /**< the boards sleep, every output is off */
+// Loop wake ups per second while idle, when no command arrives
+#define IDLE_DEFAULT_RATE_HZ 2
+#define IDLE_RATE_MIN_HZ 1
+#define IDLE_RATE_MAX_HZ 50
+
+/*!
+ * Decides when the parked robot goes idle and keeps track of it.
+ * The control loop reports every tick whether anything happened (a command arrived, the
+ * gait is walking, a sequence or ramp moved). After quietNanos without any of that the
+ * loop goes idle: nothing is written to the bus, the loop only wakes at periodNanos or
+ * for the next command, and depending on the action channels are released or the boards
+ * put to sleep. The bus side is done by the caller, this only holds the state.
+ * */
+class IdlePolicy {
+private:
+  int64_t quietNanos, periodNanos;
+  int action;
+  bool releasedChannels[SERVO_COUNT];
+  bool idle;
+  int64_t lastActivityNanos, enteredNanos, idleNanos;
+  uint32_t entryCount;
+  LatencyHistogram wakeLatency;
+public:
+  IdlePolicy();
+  /*!
+   * @param quietNanos how long the loop has to be quiet before it goes idle, 0 never
+   * @param rateHz loop rate while idle, clamped to IDLE_RATE_MIN_HZ - IDLE_RATE_MAX_HZ
+   * */
+  void configure(int64_t quietNanos, unsigned int rateHz, int action);
+  /*!
+   * Turns channel off with IDLE_ACTION_RELEASE
+   * */
+  void releaseChannel(int channel);
+  bool isEnabled();
+  bool isIdle();
+  int getAction();
+  int64_t getPeriodNanos();
+  /*!
+   * Something happened on this tick, the quiet period starts over
+   * */
+  void noteActivity(int64_t nowNanos);
+  /*!
+   * @return true if the loop has been quiet long enough to go idle and is not idle yet
+   * */
+  bool isQuiet(int64_t nowNanos);
+  void enter(int64_t nowNanos);
+  /*!
+   * @param wakeLatencyNanos from the arrival of the command that ended it to the tick applying it
+   * */
+  void leave(int64_t nowNanos, int64_t wakeLatencyNanos);
+  /*!
+   * Copies ticks with the released channels set to SERVO_TICKS_OFF
+   * */
+  void releaseFrame(const uint16_t *ticks, uint16_t *released);
+  uint32_t getEntryCount();
+  /*!
+   * Time spent idle, including the current stretch
+   * */
+  int64_t getIdleNanos(int64_t nowNanos);
+  LatencyHistogram *getWakeLatency();
+};
+
+#endif
@@ -0,0 +1,167 @@
+#include "ImuSampler.h"
+#include "ControlLoop.h"
+#include "ServoDriver.h"
+#include "SimulatedMPU6050.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// A transport of its own on the servo bus, at the sensor's address
+#ifdef HAVE_PIGPIO
+static PigpioTransport pigpioImuTransport;
+#endif
+static LinuxI2CTransport linuxImuTransport;
+
+ImuSampler::ImuSampler() : sampleCount(0), droppedCount(0), failedCount(0) {
+  this->transport = NULL;
+  this->periodNanos = NANOS_PER_SECOND / IMU_DEFAULT_RATE_HZ;
+  this->nextSampleNanos = 0;
+  this->readEstimateNanos = 0;
+  memset(this->gyroBias, 0, sizeof(this->gyroBias));
+}
+
+int ImuSampler::open(int transportType, int rateHz) {
+  switch (transportType) {
+  #ifdef HAVE_PIGPIO
+  case I2C_TRANSPORT_PIGPIO:
+    this->transport = &pigpioImuTransport;
+    break;
+  #endif
+  case I2C_TRANSPORT_LINUX:
+    this->transport = &linuxImuTransport;
+    break;
+  case I2C_TRANSPORT_SIMULATED:
+    this->transport = &simulatedImu;
+    break;
+  default:
+    fprintf(stderr, "I2C transport %d is not available in this build\n", transportType);
+    return -1;
+  }
+  if (this->transport->open(PCA9685_I2C_BUS_CHANNEL, MPU6050_I2C_ADDRESS) < 0 ||
+      this->transport->readByteData(MPU6050_WHO_AM_I) != MPU6050_WHO_AM_I_VALUE) {
+    fprintf(stderr, "No MPU-6050 at 0x%02x\n", MPU6050_I2C_ADDRESS);
+    this->close();
+    return -1;
+  }
+  rateHz = rateHz < IMU_MIN_RATE_HZ ? IMU_MIN_RATE_HZ : (rateHz > IMU_MAX_RATE_HZ ? IMU_MAX_RATE_HZ : rateHz);
+  this->transport->writeByteData(MPU6050_PWR_MGMT_1, PWR_MGMT_1_DEVICE_RESET);
+  usleep(MPU6050_RESET_MICROS);
+  // Waking up with a clock source, the rest is only writable while awake
+  if (this->transport->writeByteData(MPU6050_PWR_MGMT_1, PWR_MGMT_1_CLKSEL_PLL_X) < 0 ||
+      this->transport->writeByteData(MPU6050_CONFIG, MPU6050_DLPF_42HZ) < 0 ||
+      this->transport->writeByteData(MPU6050_SMPLRT_DIV, MPU6050_GYRO_OUTPUT_HZ / rateHz - 1) < 0 ||
+      this->transport->writeByteData(MPU6050_GYRO_CONFIG, MPU6050_GYRO_FS_500) < 0 ||
+      this->transport->writeByteData(MPU6050_ACCEL_CONFIG, MPU6050_ACCEL_FS_4G) < 0) {
+    fprintf(stderr, "Unable to configure the MPU-6050\n");
+    this->close();
+    return -1;
+  }
+  this->periodNanos = NANOS_PER_SECOND / rateHz;
+  if (this->measureGyroBias() < 0) {
+    fprintf(stderr, "Unable to read the MPU-6050\n");
+    this->close();
+    return -1;
+  }
+  printf("MPU-6050 at %d Hz, gyro bias %.0f %.0f %.0f\n", rateHz, this->gyroBias[0], this->gyroBias[1],
+         this->gyroBias[2]);
+  this->nextSampleNanos = monotonicNanos();
+  return 0;
+}
+
+void ImuSampler::close() {
+  if (this->transport != NULL) {
+    this->transport->close();
+    this->transport = NULL;
+  }
+}
+
+bool ImuSampler::isOpen() {
+  return this->transport != NULL;
+}
+
+int ImuSampler::readSample(ImuSample *sample) {
+  uint8_t data[MPU6050_SAMPLE_BYTES];
+  if (this->transport->readBlockData(MPU6050_ACCEL_XOUT_H, data, MPU6050_SAMPLE_BYTES) < 0) {
+    return -1;
+  }
+  // The temperature in between (bytes 6 and 7) is not used
+  for (int axis = 0; axis < 3; axis++) {
+    sample->accel[axis] = (int16_t)((data[2 * axis] << 8) | data[2 * axis + 1]);
+    sample->gyro[axis] = (int16_t)((data[8 + 2 * axis] << 8) | data[8 + 2 * axis + 1]);
+  }
+  return 0;
+}
+
+int ImuSampler::measureGyroBias() {
+  float sums[3] = {0, 0, 0};
+  ImuSample sample;
+  for (int i = 0; i < IMU_BIAS_SAMPLES; i++) {
+    usleep(this->periodNanos / 1000);
+    if (this->readSample(&sample) < 0) {
+      return -1;
+    }
+    for (int axis = 0; axis < 3; axis++) {
+      sums[axis] += sample.gyro[axis];
+    }
+  }
+  for (int axis = 0; axis < 3; axis++) {
+    this->gyroBias[axis] = sums[axis] / IMU_BIAS_SAMPLES;
+  }
+  return 0;
+}
+
+int64_t ImuSampler::getNextSampleNanos() {
+  return this->nextSampleNanos;
+}
+
+int64_t ImuSampler::getReadEstimateNanos() {
+  return this->readEstimateNanos;
+}
+
+void ImuSampler::sample(int64_t nowNanos) {
+  ImuSample sample;
+  sample.nanos = nowNanos;
+  int result = this->readSample(&sample);
+  int64_t endNanos = monotonicNanos();
+  this->readTime.record(endNanos - nowNanos);
+  this->readEstimateNanos -= this->readEstimateNanos >> IMU_READ_ESTIMATE_DECAY_SHIFT;
+  if (endNanos - nowNanos > this->readEstimateNanos) {
+    this->readEstimateNanos = endNanos - nowNanos;
+  }
+  this->nextSampleNanos += this->periodNanos;
+  if (this->nextSampleNanos <= endNanos) {
+    this->nextSampleNanos = endNanos + this->periodNanos;
+  }
+  if (result < 0) {
+    this->failedCount.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  this->sampleCount.fetch_add(1, std::memory_order_relaxed);
+  if (!this->ring.push(sample)) {
+    this->droppedCount.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+bool ImuSampler::take(ImuSample *sample) {
+  return this->ring.pop(sample);
+}
+
+const float *ImuSampler::getGyroBias() {
+  return this->gyroBias;
+}
+
+uint32_t ImuSampler::getSampleCount() {
+  return this->sampleCount;
+}
+
+uint32_t ImuSampler::getDroppedCount() {
+  return this->droppedCount;
+}
+
+uint32_t ImuSampler::getFailedCount() {
+  return this->failedCount;
+}
+
+LatencyHistogram *ImuSampler::getReadTime() {
+  return &this->readTime;
+}
@@ -0,0 +1,115 @@
+#ifndef _IMU_SAMPLER_H
+#define _IMU_SAMPLER_H
+
+#include <atomic>
+#include <stdint.h>
+#include "I2CTransport.h"
+#include "LoopTiming.h"
+#include "SampleRing.h"
+
+// REGISTER ADDRESSES
+#define MPU6050_SMPLRT_DIV 0x19   /**< Sample rate divider of the 1 kHz gyro output rate */
+#define MPU6050_CONFIG 0x1A       /**< Digital low pass filter */
+#define MPU6050_GYRO_CONFIG 0x1B  /**< Gyro full scale */
+#define MPU6050_ACCEL_CONFIG 0x1C /**< Accelerometer full scale */
+#define MPU6050_ACCEL_XOUT_H 0x3B /**< First of the 14 measurement registers */
+#define MPU6050_PWR_MGMT_1 0x6B   /**< Reset, sleep and clock source */
+#define MPU6050_WHO_AM_I 0x75     /**< Reads MPU6050_WHO_AM_I_VALUE */
+// PWR_MGMT_1 bits
+#define PWR_MGMT_1_DEVICE_RESET 0x80 /**< Resets every register, clears itself */
+#define PWR_MGMT_1_SLEEP 0x40        /**< Set after power on and reset */
+#define PWR_MGMT_1_CLKSEL_PLL_X 0x01 /**< Clock from the X gyro PLL, more stable than the internal one */
+
+#define MPU6050_I2C_ADDRESS 0x68 /**< AD0 low */
+#define MPU6050_WHO_AM_I_VALUE 0x68
+#define MPU6050_GYRO_OUTPUT_HZ 1000 /**< Gyro output rate with the low pass filter on */
+#define MPU6050_RESET_MICROS 100000
+// ACCEL_XOUT_H - GYRO_ZOUT_L: accelerometer xyz, temperature, gyro xyz, big endian
+#define MPU6050_SAMPLE_BYTES 14
+// The ranges ImuSampler::open sets up: +-4 g, +-500 degrees/s, 42 Hz low pass
+#define MPU6050_ACCEL_FS_4G 0x08
+#define MPU6050_GYRO_FS_500 0x08
+#define MPU6050_DLPF_42HZ 0x03
+#define MPU6050_ACCEL_LSB_PER_G 8192.0f
+#define MPU6050_GYRO_LSB_PER_DPS 65.5f
+
+#define IMU_DEFAULT_RATE_HZ 200
+#define IMU_MAX_RATE_HZ MPU6050_GYRO_OUTPUT_HZ
+// SMPLRT_DIV is 8 bits, the output rate divides by at most 256
+#define IMU_MIN_RATE_HZ ((MPU6050_GYRO_OUTPUT_HZ + 255) / 256)
+// Samples the ring holds, more than a control tick at the lowest loop rate and the highest IMU rate
+#define IMU_RING_SIZE 64
+// Samples averaged for the gyro bias while the robot stands still at startup
+#define IMU_BIAS_SAMPLES 64
+// The read time estimate loses 1/16 of itself per read, see getReadEstimateNanos
+#define IMU_READ_ESTIMATE_DECAY_SHIFT 4
+
+/*!
+ * One reading, raw register values
+ * */
+struct ImuSample {
+  int64_t nanos;
+  int16_t accel[3];
+  int16_t gyro[3];
+};
+
+/*!
+ * Reads an MPU-6050 on the servo bus at a fixed rate into a SampleRing.
+ * The bus side (sample) runs on whichever thread owns the bus, normally the
+ * ServoFrameWriter, which fits the reads in between the servo frames. The control loop
+ * drains the ring with take on every tick. Nothing is allocated after open.
+ * */
+class ImuSampler {
+private:
+  I2CTransport *transport;
+  SampleRing<ImuSample, IMU_RING_SIZE> ring;
+  int64_t periodNanos, nextSampleNanos, readEstimateNanos;
+  float gyroBias[3];
+  std::atomic<uint32_t> sampleCount, droppedCount, failedCount;
+  // Bus side only, read it after the bus thread stopped
+  LatencyHistogram readTime;
+  int readSample(ImuSample *sample);
+  int measureGyroBias();
+public:
+  ImuSampler();
+  /*!
+   * Resets and configures the sensor and measures the gyro bias, the robot has to
+   * stand still for IMU_BIAS_SAMPLES samples. Call before the bus thread starts.
+   * @param transportType one of I2C_TRANSPORT_*, same as the servo driver
+   * @return 0 on success, -1 if the sensor is missing or does not answer
+   * */
+  int open(int transportType, int rateHz);
+  void close();
+  bool isOpen();
+  /*!
+   * Bus side: when the next sample is due, on CLOCK_MONOTONIC
+   * */
+  int64_t getNextSampleNanos();
+  /*!
+   * Bus side: how long a read takes, a decaying maximum like PwmSchedule's flush estimate
+   * */
+  int64_t getReadEstimateNanos();
+  /*!
+   * Bus side: reads one sample into the ring and schedules the next one. Samples that
+   * were missed while the bus was busy are skipped, not caught up on.
+   * */
+  void sample(int64_t nowNanos);
+  /*!
+   * Control loop side, oldest first.
+   * @return false if the ring is empty
+   * */
+  bool take(ImuSample *sample);
+  /*!
+   * Raw gyro units, measured by open
+   * */
+  const float *getGyroBias();
+  uint32_t getSampleCount();
+  /*!
+   * Samples read while the ring was full
+   * */
+  uint32_t getDroppedCount();
+  uint32_t getFailedCount();
+  LatencyHistogram *getReadTime();
+};
+
+#endif
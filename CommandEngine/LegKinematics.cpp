@@ -0,0 +1,79 @@
+#include "LegKinematics.h"
+#include "Oscillator.h"
+#include <cmath>
+
+float kinematicsAsinTable[KINEMATICS_ASIN_TABLE_SIZE + 1];
+bool kinematicsTableReady = false;
+
+void kinematicsInitTable() {
+    if (kinematicsTableReady) {
+        return;
+    }
+    for (int i = 0; i <= KINEMATICS_ASIN_TABLE_SIZE; i++) {
+        kinematicsAsinTable[i] = (float)(asin(0.5 * i / KINEMATICS_ASIN_TABLE_SIZE) * 180 / M_PI);
+    }
+    kinematicsTableReady = true;
+}
+
+static float clampMagnitude(float value, float limit, int *clamped) {
+    if (value > limit) {
+        *clamped = 1;
+        return limit;
+    }
+    if (value < -limit) {
+        *clamped = 1;
+        return -limit;
+    }
+    return value;
+}
+
+LegKinematics::LegKinematics() : LegKinematics(LEG_COXA_MM, LEG_FEMUR_MM) {
+}
+
+LegKinematics::LegKinematics(float coxaMm, float femurMm) {
+    kinematicsInitTable();
+    oscillatorInitTable();
+    this->coxa = coxaMm;
+    this->femur = femurMm;
+    this->inverseFemur = 1.0f / femurMm;
+}
+
+float LegKinematics::getCoxa() {
+    return this->coxa;
+}
+
+float LegKinematics::getFemur() {
+    return this->femur;
+}
+
+int LegKinematics::inverse(const float *strideMm, const float *liftMm, float *yawDegrees, float *liftDegrees, int count) {
+    int unreachable = 0;
+    for (int i = 0; i < count; i++) {
+        int clamped = 0;
+        float liftSin = clampMagnitude(liftMm[i] * this->inverseFemur, 1.0f, &clamped);
+        float liftCos = __builtin_sqrtf(1.0f - liftSin * liftSin);
+        float reach = this->coxa + this->femur * liftCos;
+        float yawSin = clampMagnitude(strideMm[i] / reach, 1.0f, &clamped);
+        liftDegrees[i] = tableAsinDegrees(liftSin);
+        yawDegrees[i] = tableAsinDegrees(yawSin);
+        unreachable += clamped;
+    }
+    return unreachable;
+}
+
+void LegKinematics::forward(const float *yawDegrees, const float *liftDegrees, float *strideMm, float *liftMm, int count) {
+    const float radiansPerDegree = M_PI / 180;
+    for (int i = 0; i < count; i++) {
+        float reach = this->coxa + this->femur * cosf(liftDegrees[i] * radiansPerDegree);
+        strideMm[i] = reach * sinf(yawDegrees[i] * radiansPerDegree);
+        liftMm[i] = this->femur * sinf(liftDegrees[i] * radiansPerDegree);
+    }
+}
+
+float LegKinematics::strideForAngle(float yawDegrees) {
+    return (this->coxa + this->femur) * phaseSin(radiansToPhase(yawDegrees * (float)(M_PI / 180)));
+}
+
+float LegKinematics::liftForAngle(float liftDegrees) {
+    return this->femur * phaseSin(radiansToPhase(liftDegrees * (float)(M_PI / 180)));
+}
@@ -0,0 +1,95 @@
+#ifndef _LEG_KINEMATICS_H
+#define _LEG_KINEMATICS_H
+
+#include <stdint.h>
+
+/*!
+ * Leg geometry, millimetres. The Z servo turns the leg about a vertical axis, the X
+ * servo sits LEG_COXA_MM out from that axis and lifts a LEG_FEMUR_MM link ending in
+ * the foot. Set by the build for other legs.
+ * */
+#ifndef LEG_COXA_MM
+#define LEG_COXA_MM 20.0f
+#endif
+#ifndef LEG_FEMUR_MM
+#define LEG_FEMUR_MM 45.0f
+#endif
+
+/*!
+ * Arcsine comes from a table over [0, 0.5] with linear interpolation, larger arguments
+ * go through asin(v) = 90 - 2 asin(sqrt((1 - v) / 2)) so the table never sees the steep
+ * end near 1. The interpolation error is below (0.5 / 256)^2 / 8 * 0.77 = 3.7e-7 radians,
+ * twice that through the identity, around 5e-5 mm at the foot.
+ * */
+#define KINEMATICS_ASIN_TABLE_BITS 8
+#define KINEMATICS_ASIN_TABLE_SIZE (1 << KINEMATICS_ASIN_TABLE_BITS)
+#define KINEMATICS_MAX_ERROR_MM 1e-3f
+
+// Degrees, one extra entry so interpolation never reads past the end
+extern float kinematicsAsinTable[KINEMATICS_ASIN_TABLE_SIZE + 1];
+
+void kinematicsInitTable();
+
+/*!
+ * Arcsine in degrees, value in -1 - 1
+ * */
+inline float tableAsinDegrees(float value) {
+    float magnitude = value < 0 ? -value : value;
+    bool steep = magnitude > 0.5f;
+    if (steep) {
+        magnitude = __builtin_sqrtf((1.0f - magnitude) * 0.5f);
+    }
+    float position = magnitude * (2 * KINEMATICS_ASIN_TABLE_SIZE);
+    int index = (int)position;
+    if (index >= KINEMATICS_ASIN_TABLE_SIZE) {
+        index = KINEMATICS_ASIN_TABLE_SIZE - 1;
+    }
+    float low = kinematicsAsinTable[index];
+    float degrees = low + (kinematicsAsinTable[index + 1] - low) * (position - index);
+    if (steep) {
+        degrees = 90.0f - 2 * degrees;
+    }
+    return value < 0 ? -degrees : degrees;
+}
+
+/*!
+ * Two link analytic inverse kinematics for all legs at once.
+ * Foot positions are relative to the neutral pose (both servos at their open position,
+ * leg straight out): stride is along the body (the direction a positive Z angle moves
+ * the foot), lift is up (a positive X angle). Joint angles are degrees from the open
+ * position, what Leg::moveLegTo_Z / moveLegTo_X take.
+ *   lift   = femur * sin(liftAngle)
+ *   reach  = coxa + femur * cos(liftAngle)
+ *   stride = reach * sin(yawAngle)
+ * The foot moves on a sphere around the lift axis and the lift axis on a circle around
+ * the yaw axis, so the solution is closed form: one square root and two table arcsines
+ * per leg. Struct of arrays, like the OscillatorBank.
+ * */
+class LegKinematics {
+private:
+    float coxa, femur;
+    float inverseFemur;
+public:
+    LegKinematics();
+    LegKinematics(float coxaMm, float femurMm);
+    float getCoxa();
+    float getFemur();
+    /*!
+     * Solves count legs. A target out of reach is moved to the nearest point the leg
+     * can reach, at the same lift if possible.
+     * @return the number of targets that were out of reach
+     * */
+    int inverse(const float *strideMm, const float *liftMm, float *yawDegrees, float *liftDegrees, int count);
+    /*!
+     * The foot positions of count legs. libm trig, for checks and setup, not the tick.
+     * */
+    void forward(const float *yawDegrees, const float *liftDegrees, float *strideMm, float *liftMm, int count);
+    /*!
+     * The foot travel (mm from neutral) of a joint space stride or height in degrees,
+     * with the other joint at its open position
+     * */
+    float strideForAngle(float yawDegrees);
+    float liftForAngle(float liftDegrees);
+};
+
+#endif
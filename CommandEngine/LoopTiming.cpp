@@ -0,0 +1,149 @@
+#include "LoopTiming.h"
+#include <string.h>
+
+static const char *phaseNames[TIMING_PHASE_COUNT] = {
+    "receive",
+    "interpret",
+    "gait",
+    "i2c write",
+    "tick",
+    "wakeup jitter",
+    "imu filter"};
+
+LatencyHistogram::LatencyHistogram() {
+  this->reset();
+}
+
+int LatencyHistogram::bucketIndex(uint32_t value) {
+  if (value < HISTOGRAM_SUB_BUCKET_COUNT) {
+    return value;
+  }
+  int exponent = 31 - __builtin_clz(value);
+  int shift = exponent - HISTOGRAM_SUB_BUCKET_BITS;
+  return (shift + 1) * HISTOGRAM_SUB_BUCKET_COUNT + ((value >> shift) & (HISTOGRAM_SUB_BUCKET_COUNT - 1));
+}
+
+uint32_t LatencyHistogram::bucketUpperBound(int index) {
+  if (index < HISTOGRAM_SUB_BUCKET_COUNT) {
+    return index;
+  }
+  int shift = index / HISTOGRAM_SUB_BUCKET_COUNT - 1;
+  uint64_t subBucket = HISTOGRAM_SUB_BUCKET_COUNT + (index % HISTOGRAM_SUB_BUCKET_COUNT);
+  uint64_t upper = ((subBucket + 1) << shift) - 1;
+  return upper > UINT32_MAX ? UINT32_MAX : (uint32_t)upper;
+}
+
+void LatencyHistogram::record(int64_t nanos) {
+  uint32_t value;
+  if (nanos < 0) {
+    value = 0;
+  } else if (nanos > UINT32_MAX) {
+    value = UINT32_MAX;
+  } else {
+    value = (uint32_t)nanos;
+  }
+  this->buckets[bucketIndex(value)]++;
+  this->count++;
+  this->sum += value;
+  if (value < this->min)
+    this->min = value;
+  if (value > this->max)
+    this->max = value;
+}
+
+void LatencyHistogram::reset() {
+  memset(this->buckets, 0, sizeof(this->buckets));
+  this->count = 0;
+  this->sum = 0;
+  this->min = UINT32_MAX;
+  this->max = 0;
+}
+
+uint64_t LatencyHistogram::getCount() {
+  return this->count;
+}
+
+uint32_t LatencyHistogram::getMin() {
+  return this->count == 0 ? 0 : this->min;
+}
+
+uint32_t LatencyHistogram::getMax() {
+  return this->max;
+}
+
+uint32_t LatencyHistogram::getMean() {
+  return this->count == 0 ? 0 : (uint32_t)(this->sum / this->count);
+}
+
+uint32_t LatencyHistogram::getPercentile(double fraction) {
+  if (this->count == 0) {
+    return 0;
+  }
+  uint64_t target = (uint64_t)(fraction * this->count);
+  if (target >= this->count) {
+    target = this->count - 1;
+  }
+  uint64_t seen = 0;
+  for (int i = 0; i < HISTOGRAM_BUCKET_COUNT; i++) {
+    seen += this->buckets[i];
+    if (seen > target) {
+      uint32_t upper = bucketUpperBound(i);
+      return upper > this->max ? this->max : upper;
+    }
+  }
+  return this->max;
+}
+
+LoopTiming::LoopTiming() {
+  this->periodNanos = 0;
+  this->deadlineMisses = 0;
+}
+
+void LoopTiming::setPeriod(int64_t periodNanos) {
+  this->periodNanos = periodNanos;
+}
+
+void LoopTiming::record(int phase, int64_t nanos) {
+  this->phases[phase].record(nanos);
+}
+
+void LoopTiming::recordTick(int64_t busyNanos) {
+  this->phases[TIMING_PHASE_TICK].record(busyNanos);
+  if (this->periodNanos > 0 && busyNanos > this->periodNanos) {
+    this->deadlineMisses++;
+  }
+}
+
+LatencyHistogram *LoopTiming::getPhase(int phase) {
+  return &this->phases[phase];
+}
+
+uint32_t LoopTiming::getDeadlineMisses() {
+  return this->deadlineMisses;
+}
+
+void LoopTiming::print(FILE *stream) {
+  fprintf(stream, "%-14s %10s %9s %9s %9s %9s %9s %9s (us)\n",
+          "phase", "count", "min", "mean", "p50", "p99", "p99.9", "max");
+  for (int i = 0; i < TIMING_PHASE_COUNT; i++) {
+    LatencyHistogram *histogram = &this->phases[i];
+    fprintf(stream, "%-14s %10llu %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n",
+            phaseNames[i],
+            (unsigned long long)histogram->getCount(),
+            histogram->getMin() / 1000.0,
+            histogram->getMean() / 1000.0,
+            histogram->getPercentile(0.5) / 1000.0,
+            histogram->getPercentile(0.99) / 1000.0,
+            histogram->getPercentile(0.999) / 1000.0,
+            histogram->getMax() / 1000.0);
+  }
+  fprintf(stream, "deadline misses: %u\n", this->deadlineMisses);
+  fflush(stream);
+}
+
+void LoopTiming::reset() {
+  for (int i = 0; i < TIMING_PHASE_COUNT; i++) {
+    this->phases[i].reset();
+  }
+  this->deadlineMisses = 0;
+}
@@ -0,0 +1,74 @@
+#ifndef _LOOP_TIMING_H
+#define _LOOP_TIMING_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Log-linear buckets: values below 2^HISTOGRAM_SUB_BUCKET_BITS get one bucket each,
+// every power of two above that is split into 2^HISTOGRAM_SUB_BUCKET_BITS buckets (~6% wide)
+#define HISTOGRAM_SUB_BUCKET_BITS 4
+#define HISTOGRAM_SUB_BUCKET_COUNT (1 << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_BUCKET_COUNT ((32 - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKET_COUNT)
+
+#define TIMING_PHASE_RECEIVE 0
+#define TIMING_PHASE_INTERPRET 1
+#define TIMING_PHASE_GAIT 2
+#define TIMING_PHASE_I2C_WRITE 3
+#define TIMING_PHASE_TICK 4
+#define TIMING_PHASE_WAKEUP_JITTER 5
+#define TIMING_PHASE_IMU 6
+#define TIMING_PHASE_COUNT 7
+
+/*!
+ * Fixed size latency histogram in nanoseconds. Recording is a couple of shifts and an
+ * increment, nothing is allocated after construction.
+ * Not thread safe, record and read from the same thread.
+ * */
+class LatencyHistogram {
+private:
+  uint32_t buckets[HISTOGRAM_BUCKET_COUNT];
+  uint64_t count, sum;
+  uint32_t min, max;
+  static int bucketIndex(uint32_t value);
+  static uint32_t bucketUpperBound(int index);
+public:
+  LatencyHistogram();
+  void record(int64_t nanos);
+  void reset();
+  uint64_t getCount();
+  uint32_t getMin();
+  uint32_t getMax();
+  uint32_t getMean();
+  /*!
+   * @param fraction 0.0 - 1.0, e.g. 0.999 for p99.9
+   * @return upper bound of the bucket holding that percentile
+   * */
+  uint32_t getPercentile(double fraction);
+};
+
+/*!
+ * Per phase timing of the control loop. Each tick is split into receive, IMU filter,
+ * interpret, gait and I2C write phases, plus the total busy time of the tick and how late the
+ * tick started compared to its deadline.
+ * */
+class LoopTiming {
+private:
+  LatencyHistogram phases[TIMING_PHASE_COUNT];
+  int64_t periodNanos;
+  uint32_t deadlineMisses;
+public:
+  LoopTiming();
+  void setPeriod(int64_t periodNanos);
+  void record(int phase, int64_t nanos);
+  /*!
+   * Records the total busy time of a tick and counts it as a miss if it did not fit
+   * in one period.
+   * */
+  void recordTick(int64_t busyNanos);
+  LatencyHistogram *getPhase(int phase);
+  uint32_t getDeadlineMisses();
+  void print(FILE *stream);
+  void reset();
+};
+
+#endif
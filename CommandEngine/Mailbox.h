@@ -0,0 +1,61 @@
+#ifndef _MAILBOX_H
+#define _MAILBOX_H
+
+#include <atomic>
+#include <stdint.h>
+
+#define MAILBOX_SLOT_COUNT 3
+#define MAILBOX_INDEX_MASK 0x03
+#define MAILBOX_FRESH_BIT 0x04
+
+/*!
+ * Wait-free single producer / single consumer mailbox that only keeps the newest value.
+ * Triple buffered: the producer owns one slot, the consumer owns one slot and the
+ * third is handed over through a single atomic exchange, so neither side ever waits
+ * for the other and the consumer can never see a half written value.
+ * Only one thread may call publish and only one thread may call take.
+ * */
+template <typename T>
+class LatestMailbox {
+private:
+  T slots[MAILBOX_SLOT_COUNT];
+  std::atomic<uint8_t> middle;
+  uint8_t back, front;
+public:
+  LatestMailbox() : middle(1), back(0), front(2) {
+  }
+
+  /*!
+   * Producer side. Replaces whatever the consumer has not taken yet.
+   * @return true if an unread value was overwritten
+   * */
+  bool publish(const T &value) {
+    this->slots[this->back] = value;
+    uint8_t previous = this->middle.exchange(this->back | MAILBOX_FRESH_BIT, std::memory_order_acq_rel);
+    this->back = previous & MAILBOX_INDEX_MASK;
+    return (previous & MAILBOX_FRESH_BIT) != 0;
+  }
+
+  /*!
+   * Consumer side, whether take would return a value. Does not take it.
+   * */
+  bool isFresh() {
+    return (this->middle.load(std::memory_order_acquire) & MAILBOX_FRESH_BIT) != 0;
+  }
+
+  /*!
+   * Consumer side.
+   * @return false if nothing new was published since the last take
+   * */
+  bool take(T *value) {
+    if ((this->middle.load(std::memory_order_relaxed) & MAILBOX_FRESH_BIT) == 0) {
+      return false;
+    }
+    uint8_t previous = this->middle.exchange(this->front, std::memory_order_acq_rel);
+    this->front = previous & MAILBOX_INDEX_MASK;
+    *value = this->slots[this->front];
+    return true;
+  }
+};
+
+#endif
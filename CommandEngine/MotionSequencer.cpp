@@ -0,0 +1,62 @@
+#include "MotionSequencer.h"
+
+MotionSequencer::MotionSequencer() {
+    this->nowNanos = 0;
+    for (int i = 0; i < MOTION_SEQUENCER_SLOTS; i++) {
+        this->active[i] = false;
+    }
+}
+
+int MotionSequencer::start(MotionStep step, void *context) {
+    for (int i = 0; i < MOTION_SEQUENCER_SLOTS; i++) {
+        if (!this->active[i]) {
+            MotionTask *task = &this->tasks[i];
+            task->step = step;
+            task->context = context;
+            task->line = 0;
+            task->counter = 0;
+            task->nowNanos = this->nowNanos;
+            // Due on whatever tick comes next
+            task->wakeNanos = this->nowNanos;
+            this->active[i] = true;
+            return i;
+        }
+    }
+    return MOTION_TASK_NONE;
+}
+
+void MotionSequencer::cancel(int id) {
+    if (id >= 0 && id < MOTION_SEQUENCER_SLOTS) {
+        this->active[id] = false;
+    }
+}
+
+bool MotionSequencer::isRunning(int id) {
+    return id >= 0 && id < MOTION_SEQUENCER_SLOTS && this->active[id];
+}
+
+bool MotionSequencer::isBusy() {
+    for (int i = 0; i < MOTION_SEQUENCER_SLOTS; i++) {
+        if (this->active[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MotionSequencer::tick(int64_t nowNanos) {
+    this->nowNanos = nowNanos;
+    bool ran = false;
+    for (int i = 0; i < MOTION_SEQUENCER_SLOTS; i++) {
+        MotionTask *task = &this->tasks[i];
+        if (!this->active[i] || task->wakeNanos > nowNanos) {
+            continue;
+        }
+        task->nowNanos = nowNanos;
+        if (task->step(task) == SEQUENCE_DONE) {
+            this->active[i] = false;
+        }
+        ran = true;
+    }
+    return ran;
+}
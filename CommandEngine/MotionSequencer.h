@@ -0,0 +1,95 @@
+#ifndef _MOTION_SEQUENCER_H
+#define _MOTION_SEQUENCER_H
+
+#include <stdint.h>
+
+#define MOTION_SEQUENCER_SLOTS 8
+#define MOTION_TASK_NONE -1
+
+#define SEQUENCE_WAITING 0
+#define SEQUENCE_DONE 1
+
+/*!
+ * State of one running sequence. A sequence is a plain function that is called again
+ * every time it is resumed and jumps back to where it yielded (protothread style, the
+ * C++11 stand in for a coroutine):
+ *
+ *   int openSequence(MotionTask *task) {
+ *       Thing *thing = (Thing *)task->context;
+ *       SEQUENCE_BEGIN(task);
+ *       thing->firstStep();
+ *       SEQUENCE_WAIT_FOR(task, 100 * NANOS_PER_MILLISECOND);
+ *       thing->secondStep();
+ *       SEQUENCE_END(task);
+ *   }
+ *
+ * Locals do not survive a yield, anything that has to goes into the context or the
+ * counter. A sequence must not use switch statements across yields.
+ * */
+struct MotionTask {
+    int (*step)(MotionTask *task);
+    void *context;
+    // Where to resume, 0 is the start
+    int line;
+    // Free for the sequence, e.g. a loop counter
+    int counter;
+    // Time of the tick the sequence is running in, and when it wants to run next
+    int64_t nowNanos, wakeNanos;
+};
+
+typedef int (*MotionStep)(MotionTask *task);
+
+#define SEQUENCE_BEGIN(task) switch ((task)->line) { case 0:
+#define SEQUENCE_END(task) } (task)->line = 0; return SEQUENCE_DONE
+/*!
+ * Yields until the tick at or after nanos (CLOCK_MONOTONIC)
+ * */
+#define SEQUENCE_WAIT_UNTIL(task, nanos) \
+    do { \
+        (task)->wakeNanos = (nanos); \
+        (task)->line = __LINE__; \
+        return SEQUENCE_WAITING; \
+        case __LINE__:; \
+    } while (0)
+#define SEQUENCE_WAIT_FOR(task, nanos) SEQUENCE_WAIT_UNTIL(task, (task)->nowNanos + (nanos))
+/*!
+ * Yields one tick at a time while condition holds, e.g. until another sequence is done
+ * */
+#define SEQUENCE_WAIT_WHILE(task, condition) \
+    do { \
+        (task)->line = __LINE__; \
+        case __LINE__: \
+        if (condition) { \
+            (task)->wakeNanos = (task)->nowNanos; \
+            return SEQUENCE_WAITING; \
+        } \
+    } while (0)
+
+/*!
+ * Runs multi step motions from the control loop without blocking it. Sequences are
+ * resumed by tick() once their wake up time has come, so a wait costs nothing but a
+ * comparison per tick. Tasks live in a fixed table, starting one never allocates.
+ * */
+class MotionSequencer {
+private:
+    MotionTask tasks[MOTION_SEQUENCER_SLOTS];
+    bool active[MOTION_SEQUENCER_SLOTS];
+    int64_t nowNanos;
+public:
+    MotionSequencer();
+    /*!
+     * Queues a sequence, its first step runs on the next tick()
+     * @return task id, MOTION_TASK_NONE if every slot is busy
+     * */
+    int start(MotionStep step, void *context);
+    void cancel(int id);
+    bool isRunning(int id);
+    bool isBusy();
+    /*!
+     * Resumes every sequence that is due at nowNanos
+     * @return true if any sequence ran, i.e. servo positions may have changed
+     * */
+    bool tick(int64_t nowNanos);
+};
+
+#endif
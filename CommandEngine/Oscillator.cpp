@@ -0,0 +1,72 @@
+#include "Oscillator.h"
+#include <cmath>
+
+float oscillatorSineTable[OSCILLATOR_TABLE_SIZE + 1];
+bool oscillatorTableReady = false;
+
+void oscillatorInitTable() {
+    if (oscillatorTableReady) {
+        return;
+    }
+    for (int i = 0; i <= OSCILLATOR_TABLE_SIZE; i++) {
+        oscillatorSineTable[i] = (float)sin((2 * M_PI * i) / OSCILLATOR_TABLE_SIZE);
+    }
+    oscillatorTableReady = true;
+}
+
+OscillatorBank::OscillatorBank() {
+    oscillatorInitTable();
+    this->count = 0;
+    for (int i = 0; i < OSCILLATOR_MAX_COUNT; i++) {
+        this->phase[i] = 0;
+        this->phaseOffset[i] = 0;
+        this->direction[i] = 0;
+        this->sinOut[i] = 0.0f;
+        this->cosOut[i] = 1.0f;
+    }
+}
+
+void OscillatorBank::setCount(int count) {
+    this->count = count;
+}
+
+int OscillatorBank::getCount() {
+    return this->count;
+}
+
+void OscillatorBank::setOscillator(int index, float phaseOffsetRadians, int direction) {
+    this->phaseOffset[index] = radiansToPhase(phaseOffsetRadians);
+    this->direction[index] = direction;
+}
+
+void OscillatorBank::setDirection(int index, int direction) {
+    this->direction[index] = direction;
+}
+
+void OscillatorBank::advance(float deltaPhaseRadians) {
+    // Two's complement wrap around is exactly the modulo 2 pi we want
+    uint32_t delta = radiansToPhase(deltaPhaseRadians);
+    for (int i = 0; i < this->count; i++) {
+        this->phase[i] += delta * (uint32_t)this->direction[i];
+    }
+}
+
+void OscillatorBank::evaluate() {
+    for (int i = 0; i < this->count; i++) {
+        uint32_t offsetPhase = this->phase[i] + this->phaseOffset[i];
+        this->sinOut[i] = phaseSin(offsetPhase);
+        this->cosOut[i] = phaseCos(offsetPhase);
+    }
+}
+
+uint32_t OscillatorBank::getPhase(int index) {
+    return this->phase[index];
+}
+
+uint32_t OscillatorBank::getOffsetPhase(int index) {
+    return this->phase[index] + this->phaseOffset[index];
+}
+
+void OscillatorBank::setPhase(int index, uint32_t phase) {
+    this->phase[index] = phase;
+}
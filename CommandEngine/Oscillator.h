@@ -0,0 +1,87 @@
+#ifndef _OSCILLATOR_H
+#define _OSCILLATOR_H
+
+#include <stdint.h>
+
+/*!
+ * Phases are unsigned 32 bit fixed point fractions of a turn: 2^32 is 2 pi, so
+ * accumulating wraps for free and keeps full precision no matter how long the robot
+ * has been walking.
+ * Sine comes from a 1024 entry table with linear interpolation. The interpolation
+ * error is below (2 pi / 1024)^2 / 8 = 4.7e-6, i.e. under 5e-4 degrees on a
+ * 90 degree stride, far below one step of the servo calibration tables.
+ * */
+#define OSCILLATOR_TABLE_BITS 10
+#define OSCILLATOR_TABLE_SIZE (1 << OSCILLATOR_TABLE_BITS)
+#define OSCILLATOR_FRACTION_BITS (32 - OSCILLATOR_TABLE_BITS)
+#define OSCILLATOR_QUARTER_TURN 0x40000000u
+#define OSCILLATOR_MAX_ERROR 4.8e-6f
+#define OSCILLATOR_MAX_COUNT 8
+
+// One extra entry so interpolation never needs to wrap the index
+extern float oscillatorSineTable[OSCILLATOR_TABLE_SIZE + 1];
+
+void oscillatorInitTable();
+
+/*!
+ * Radians to phase units, wrapping. Negative angles map to the equivalent positive phase.
+ * */
+inline uint32_t radiansToPhase(float radians) {
+    const double phasePerRadian = 4294967296.0 / 6.283185307179586;
+    return (uint32_t)(int64_t)(radians * phasePerRadian);
+}
+
+inline float phaseToRadians(uint32_t phase) {
+    return phase * (6.283185307179586f / 4294967296.0f);
+}
+
+inline float phaseSin(uint32_t phase) {
+    uint32_t index = phase >> OSCILLATOR_FRACTION_BITS;
+    float fraction = (phase & ((1u << OSCILLATOR_FRACTION_BITS) - 1)) * (1.0f / (1u << OSCILLATOR_FRACTION_BITS));
+    float low = oscillatorSineTable[index];
+    return low + (oscillatorSineTable[index + 1] - low) * fraction;
+}
+
+inline float phaseCos(uint32_t phase) {
+    return phaseSin(phase + OSCILLATOR_QUARTER_TURN);
+}
+
+/*!
+ * Phase accumulators for all legs, advanced and evaluated in one call.
+ * Struct of arrays so the per leg loops are straight line code over contiguous data.
+ * */
+class OscillatorBank {
+private:
+    uint32_t phase[OSCILLATOR_MAX_COUNT];
+    uint32_t phaseOffset[OSCILLATOR_MAX_COUNT];
+    int32_t direction[OSCILLATOR_MAX_COUNT];
+    int count;
+public:
+    float sinOut[OSCILLATOR_MAX_COUNT];
+    float cosOut[OSCILLATOR_MAX_COUNT];
+
+    OscillatorBank();
+    void setCount(int count);
+    int getCount();
+    /*!
+     * @param direction 1 forward, -1 backward, 0 holds the phase (disabled leg)
+     * */
+    void setOscillator(int index, float phaseOffsetRadians, int direction);
+    void setDirection(int index, int direction);
+    /*!
+     * Adds deltaPhaseRadians times each oscillator's direction to its phase
+     * */
+    void advance(float deltaPhaseRadians);
+    /*!
+     * Fills sinOut and cosOut with the offset phase of every oscillator
+     * */
+    void evaluate();
+    uint32_t getPhase(int index);
+    /*!
+     * Phase plus the oscillator's offset, what evaluate() takes the sine of
+     * */
+    uint32_t getOffsetPhase(int index);
+    void setPhase(int index, uint32_t phase);
+};
+
+#endif
@@ -0,0 +1,66 @@
+#include "PwmSchedule.h"
+#include "ControlLoop.h"
+
+PwmSchedule::PwmSchedule() {
+  this->configure(0, NANOS_PER_SECOND / 50, PWM_SCHEDULE_DEFAULT_GUARD_MICROS * 1000LL);
+}
+
+void PwmSchedule::configure(int64_t epochNanos, int64_t periodNanos, int64_t guardNanos) {
+  this->epochNanos = epochNanos;
+  this->periodNanos = periodNanos;
+  this->guardNanos = guardNanos;
+  // Pessimistic until the first flush was measured
+  this->flushEstimateNanos = periodNanos / 4;
+  this->onTimeCount = 0;
+  this->lateCount = 0;
+}
+
+void PwmSchedule::setEpoch(int64_t epochNanos) {
+  this->epochNanos = epochNanos;
+}
+
+int64_t PwmSchedule::nextBoundary(int64_t nanos) {
+  int64_t sinceEpoch = nanos - this->epochNanos;
+  int64_t periods = sinceEpoch / this->periodNanos;
+  // Division truncates towards zero, step back for times before the epoch
+  if (sinceEpoch < 0 && sinceEpoch % this->periodNanos != 0) {
+    periods--;
+  }
+  return this->epochNanos + (periods + 1) * this->periodNanos;
+}
+
+int64_t PwmSchedule::planStart(int64_t nowNanos, int64_t *boundaryNanos) {
+  int64_t lead = this->flushEstimateNanos + this->guardNanos;
+  // A flush that can not make the coming boundary any more aims for the one after
+  int64_t boundary = this->nextBoundary(nowNanos + lead);
+  *boundaryNanos = boundary;
+  return boundary - lead;
+}
+
+void PwmSchedule::recordFlush(int64_t boundaryNanos, int64_t endNanos, int64_t flushNanos) {
+  if (endNanos <= boundaryNanos) {
+    this->onTimeCount++;
+  } else {
+    this->lateCount++;
+  }
+  this->flushEstimateNanos -= this->flushEstimateNanos >> PWM_SCHEDULE_ESTIMATE_DECAY_SHIFT;
+  if (flushNanos > this->flushEstimateNanos) {
+    this->flushEstimateNanos = flushNanos;
+  }
+}
+
+int64_t PwmSchedule::getPeriodNanos() {
+  return this->periodNanos;
+}
+
+int64_t PwmSchedule::getFlushEstimateNanos() {
+  return this->flushEstimateNanos;
+}
+
+uint32_t PwmSchedule::getOnTimeCount() {
+  return this->onTimeCount;
+}
+
+uint32_t PwmSchedule::getLateCount() {
+  return this->lateCount;
+}
@@ -0,0 +1,62 @@
+#ifndef _PWM_SCHEDULE_H
+#define _PWM_SCHEDULE_H
+
+#include <stdint.h>
+
+// Left between the end of a flush and the period boundary for bus and scheduler jitter
+#define PWM_SCHEDULE_DEFAULT_GUARD_MICROS 300
+// Every flush lowers the flush time estimate by 1 / 2^PWM_SCHEDULE_ESTIMATE_DECAY_SHIFT
+// of itself, a slower flush raises it at once
+#define PWM_SCHEDULE_ESTIMATE_DECAY_SHIFT 4
+
+/*!
+ * Plans I2C flushes against the PWM period of the PCA9685.
+ * The chip latches new LEDn values at the end of a period, so a frame that finishes
+ * just before a boundary takes effect right away while one that finishes just after
+ * waits a whole period. Given where a period started and how long it is, the schedule
+ * picks the latest time a flush can start and still end guardNanos before the next
+ * boundary, so every written frame takes effect after the same, short delay.
+ * The flush time is not known up front, it is estimated from the flushes recorded
+ * so far: a slow flush raises the estimate at once, fast ones lower it slowly.
+ * */
+class PwmSchedule {
+private:
+  int64_t epochNanos, periodNanos, guardNanos, flushEstimateNanos;
+  uint32_t onTimeCount, lateCount;
+public:
+  PwmSchedule();
+  /*!
+   * @param epochNanos a time a PWM period started at, on CLOCK_MONOTONIC
+   * @param periodNanos length of one PWM period
+   * */
+  void configure(int64_t epochNanos, int64_t periodNanos, int64_t guardNanos);
+  /*!
+   * The boards restarted their PWM periods (a wake up), keeps the flush estimate and counts
+   * */
+  void setEpoch(int64_t epochNanos);
+  /*!
+   * First period boundary after nanos
+   * */
+  int64_t nextBoundary(int64_t nanos);
+  /*!
+   * When to start a flush that is ready at nowNanos, never earlier than nowNanos
+   * @param boundaryNanos set to the boundary the flush is aiming for
+   * */
+  int64_t planStart(int64_t nowNanos, int64_t *boundaryNanos);
+  /*!
+   * Feeds back a flush that ended at endNanos after taking flushNanos, aimed at boundaryNanos
+   * */
+  void recordFlush(int64_t boundaryNanos, int64_t endNanos, int64_t flushNanos);
+  int64_t getPeriodNanos();
+  int64_t getFlushEstimateNanos();
+  /*!
+   * Flushes that ended before the boundary they aimed for
+   * */
+  uint32_t getOnTimeCount();
+  /*!
+   * Flushes that ran past their boundary, those took effect one period later
+   * */
+  uint32_t getLateCount();
+};
+
+#endif
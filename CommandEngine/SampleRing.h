@@ -0,0 +1,55 @@
+#ifndef _SAMPLE_RING_H
+#define _SAMPLE_RING_H
+
+#include <atomic>
+#include <stdint.h>
+
+/*!
+ * Wait-free single producer / single consumer queue of every value, in order, unlike
+ * LatestMailbox which only keeps the newest. SIZE is a power of two. The indices run
+ * freely and are masked on access, so full and empty never need a spare slot to tell
+ * apart. A full ring rejects the new value, the producer counts it as dropped.
+ * Only one thread may call push and only one thread may call pop.
+ * */
+template <typename T, uint32_t SIZE>
+class SampleRing {
+private:
+  static_assert((SIZE & (SIZE - 1)) == 0, "ring size has to be a power of two");
+  T slots[SIZE];
+  // Apart, so the producer and the consumer do not write the same cache line
+  alignas(64) std::atomic<uint32_t> head;
+  alignas(64) std::atomic<uint32_t> tail;
+public:
+  SampleRing() : head(0), tail(0) {
+  }
+
+  /*!
+   * Producer side.
+   * @return false if the ring is full, the value was not stored
+   * */
+  bool push(const T &value) {
+    uint32_t head = this->head.load(std::memory_order_relaxed);
+    if (head - this->tail.load(std::memory_order_acquire) == SIZE) {
+      return false;
+    }
+    this->slots[head & (SIZE - 1)] = value;
+    this->head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /*!
+   * Consumer side.
+   * @return false if the ring is empty
+   * */
+  bool pop(T *value) {
+    uint32_t tail = this->tail.load(std::memory_order_relaxed);
+    if (this->head.load(std::memory_order_acquire) == tail) {
+      return false;
+    }
+    *value = this->slots[tail & (SIZE - 1)];
+    this->tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+};
+
+#endif
@@ -0,0 +1,113 @@
+#include "ServoCalibration.h"
+#include <stdio.h>
+#include <string.h>
+
+uint16_t calibrationTable[SERVO_COUNT][CALIBRATION_TABLE_SIZE];
+ServoCalibration calibrations[SERVO_COUNT];
+bool calibrationCompiled = false;
+
+/*!
+ *  @brief  Precomputes the angle -> tick table of one channel, so nothing but a
+ *  lookup is left for the control loop.
+ */
+void compileChannel(uint8_t channel) {
+  ServoCalibration *calibration = &calibrations[channel];
+  float ticksPerDegree = ((float)calibration->maxTicks - calibration->minTicks) / SERVO_MAX_ANGLE;
+  for (int step = 0; step < CALIBRATION_TABLE_SIZE; step++) {
+    float angle = (float)step / CALIBRATION_STEPS_PER_DEGREE;
+    if (calibration->direction == CALIBRATION_DIRECTION_REVERSED) {
+      angle = SERVO_MAX_ANGLE - angle;
+    }
+    angle += calibration->trimDegrees;
+    if (angle < 0)
+      angle = 0;
+    if (angle > SERVO_MAX_ANGLE)
+      angle = SERVO_MAX_ANGLE;
+    int ticks = (int)(calibration->minTicks + ticksPerDegree * angle + 0.5f);
+    if (ticks > PCA9685_MAX_PWM)
+      ticks = PCA9685_MAX_PWM;
+    calibrationTable[channel][step] = ticks;
+  }
+}
+
+void servoCalibrationLoadDefaults() {
+  for (int i = 0; i < SERVO_COUNT; i++) {
+    calibrations[i].minTicks = SG90_MIN;
+    calibrations[i].maxTicks = SG90_MAX;
+    calibrations[i].trimDegrees = 0;
+    calibrations[i].direction = CALIBRATION_DIRECTION_NORMAL;
+    compileChannel(i);
+  }
+  calibrationCompiled = true;
+}
+
+int servoCalibrationLoad(const char *path) {
+  servoCalibrationLoadDefaults();
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    perror("Unable to open servo calibration");
+    return -1;
+  }
+
+  char line[128];
+  int lineNumber = 0;
+  int result = 0;
+  while (fgets(line, sizeof(line), file) != NULL) {
+    lineNumber++;
+    char *comment = strchr(line, '#');
+    if (comment != NULL) {
+      *comment = '\0';
+    }
+    int channel, direction, board, output;
+    unsigned int minTicks, maxTicks;
+    float trim;
+    int fields = sscanf(line, "%d %u %u %f %d %d %d", &channel, &minTicks, &maxTicks, &trim, &direction, &board,
+                        &output);
+    if (fields <= 0) {
+      continue;
+    }
+    if ((fields != 5 && fields != 7) || channel < 0 || channel >= SERVO_COUNT || minTicks > PCA9685_MAX_PWM ||
+        maxTicks > PCA9685_MAX_PWM ||
+        (direction != CALIBRATION_DIRECTION_NORMAL && direction != CALIBRATION_DIRECTION_REVERSED) ||
+        (fields == 7 && (board < 0 || board >= PCA9685_MAX_BOARDS || output < 0 || output >= PCA9685_CHANNEL_COUNT))) {
+      fprintf(stderr, "%s:%d: expected \"channel minTicks maxTicks trimDegrees direction [board output]\"\n", path,
+              lineNumber);
+      result = -1;
+      continue;
+    }
+    if (fields == 7) {
+      servoDriverMapChannel(channel, board, output);
+    }
+    ServoCalibration calibration;
+    calibration.minTicks = minTicks;
+    calibration.maxTicks = maxTicks;
+    calibration.trimDegrees = trim;
+    calibration.direction = direction;
+    servoCalibrationSet(channel, calibration);
+  }
+  fclose(file);
+  return result;
+}
+
+void servoCalibrationSet(uint8_t channel, ServoCalibration calibration) {
+  calibrations[channel] = calibration;
+  compileChannel(channel);
+}
+
+ServoCalibration servoCalibrationGet(uint8_t channel) {
+  return calibrations[channel];
+}
+
+float servoTicksToAngle(uint8_t channel, uint16_t ticks) {
+  ServoCalibration *calibration = &calibrations[channel];
+  float ticksPerDegree = ((float)calibration->maxTicks - calibration->minTicks) / SERVO_MAX_ANGLE;
+  float angle = (ticks - (float)calibration->minTicks) / ticksPerDegree - calibration->trimDegrees;
+  if (calibration->direction == CALIBRATION_DIRECTION_REVERSED) {
+    angle = SERVO_MAX_ANGLE - angle;
+  }
+  return angle;
+}
+
+bool servoCalibrationIsCompiled() {
+  return calibrationCompiled;
+}
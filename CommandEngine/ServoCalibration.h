@@ -0,0 +1,64 @@
+#ifndef _SERVO_CALIBRATION_H
+#define _SERVO_CALIBRATION_H
+
+#include <stdint.h>
+#include "ServoDriver.h"
+
+// Resolution of the angle -> tick tables. 8 steps per degree is finer than one
+// PCA9685 tick for every servo range that fits in a 50 Hz frame.
+#define CALIBRATION_STEPS_PER_DEGREE 8
+#define CALIBRATION_TABLE_SIZE (SERVO_MAX_ANGLE * CALIBRATION_STEPS_PER_DEGREE + 1)
+#define CALIBRATION_DIRECTION_NORMAL 1
+#define CALIBRATION_DIRECTION_REVERSED -1
+
+/*!
+ * Mechanical calibration of one servo channel.
+ * minTicks and maxTicks are the LEDn_OFF values for 0 and 180 degrees, trimDegrees is
+ * added to every commanded angle and direction mirrors the angle for servos that are
+ * mounted the other way round.
+ * */
+struct ServoCalibration {
+  uint16_t minTicks, maxTicks;
+  float trimDegrees;
+  int direction;
+};
+
+extern uint16_t calibrationTable[SERVO_COUNT][CALIBRATION_TABLE_SIZE];
+
+/*!
+ *  @brief  Resets every channel to the SG90_MIN - SG90_MAX range and rebuilds the tables
+ */
+void servoCalibrationLoadDefaults();
+
+/*!
+ *  @brief  Loads per channel calibration from a text file and rebuilds the tables.
+ *  One line per channel: "channel minTicks maxTicks trimDegrees direction [board output]",
+ *  '#' starts a comment. Channels that are not listed keep the default range. The
+ *  optional board and output wire the channel, see servoDriverMapChannel.
+ *  @return 0 on success, -1 if the file could not be read or has a bad line
+ */
+int servoCalibrationLoad(const char *path);
+
+void servoCalibrationSet(uint8_t channel, ServoCalibration calibration);
+ServoCalibration servoCalibrationGet(uint8_t channel);
+/*!
+ *  @brief  The commanded angle (0 - 180 degrees) ticks stand for, the inverse of
+ *  servoAngleToTicks without its clamping and rounding. For simulation, not the loop.
+ */
+float servoTicksToAngle(uint8_t channel, uint16_t ticks);
+bool servoCalibrationIsCompiled();
+
+/*!
+ * Angle (0 - 180 degrees) to LEDn_OFF ticks for a channel, a table lookup at
+ * 1 / CALIBRATION_STEPS_PER_DEGREE degree resolution.
+ * */
+inline uint16_t servoAngleToTicks(uint8_t channel, float angle) {
+  int index = (int)(angle * CALIBRATION_STEPS_PER_DEGREE + 0.5f);
+  if (index < 0)
+    index = 0;
+  if (index >= CALIBRATION_TABLE_SIZE)
+    index = CALIBRATION_TABLE_SIZE - 1;
+  return calibrationTable[channel][index];
+}
+
+#endif
@@ -1,52 +1,285 @@
 #include "ServoDriver.h"
+#include "ControlLoop.h"
+#include "ServoCalibration.h"
+#include "SimulatedPCA9685.h"
 #include <stdio.h>
 #include <unistd.h> // For C file functions
-#ifndef TEST_MODE
-#include <pigpio.h>
-#endif
+#include <algorithm>
+#include <atomic>
 #include <cstring>
 #include <iostream>
 
 using namespace std;
 
+static_assert(SERVO_COUNT <= PCA9685_MAX_BOARDS * PCA9685_CHANNEL_COUNT, "more servos than the boards have outputs");
+
+// One transport per board, the last one of each array talks to the ALLCALL address
+#ifdef HAVE_PIGPIO
+PigpioTransport pigpioTransports[PCA9685_MAX_BOARDS + 1];
+#endif
+LinuxI2CTransport linuxI2CTransports[PCA9685_MAX_BOARDS + 1];
+SimulatedPCA9685 simulatedControllers[PCA9685_MAX_BOARDS];
+SimulatedAllCall simulatedAllCall;
+I2CTransport *transports[PCA9685_MAX_BOARDS];
+I2CTransport *allCallTransport = NULL;
+int transportType = I2C_TRANSPORT_DEFAULT;
 int controllerFileDescriptor = -1;
 uint32_t _oscillator_freq = FREQUENCY_OSCILLATOR;
 
+uint8_t boardAddresses[PCA9685_MAX_BOARDS];
+// 0 until servoDriverSetBoards, servoDriverInit then picks the default
+int boardCount = 0;
+bool allCallRequested = false;
+// Explicit mappings, board is SERVO_CHANNEL_UNMAPPED for channels that fill in
+#define SERVO_CHANNEL_UNMAPPED 0xFF
+ServoChannelMapping requestedMap[SERVO_COUNT] = {};
+bool requestedMapInitialized = false;
+// Resolved by servoDriverInit
+ServoChannelMapping channelMap[SERVO_COUNT];
+// Logical channel on each output, SERVO_CHANNEL_UNMAPPED for unused outputs
+uint8_t boardChannels[PCA9685_MAX_BOARDS][PCA9685_CHANNEL_COUNT];
+
+// Last pulse width written to each servo channel
+uint16_t shadowPwm[SERVO_COUNT];
+bool shadowValid[SERVO_COUNT];
+ServoDriverBusStats busStats;
+// LEDn_ON of each servo channel, fixed from servoDriverInit on. All 0 without staggering.
+bool staggerRequested = false;
+uint16_t onTicks[SERVO_COUNT];
+// The PWM period the boards were last started with, the epoch is 0 while unknown.
+// Atomic, wakeup() moves it on the writer thread while the loop saves it every tick.
+uint8_t pwmPrescale = 0;
+std::atomic<int64_t> pwmEpochNanos(0);
+bool warmStartRequested = false;
+bool warmStarted = false;
+// TEST_MODE builds print every flushed frame when asked to
+bool printFrames = false;
+// Channels whose pulse the warm start read back from the boards
+bool channelReadBack[SERVO_COUNT];
+
+static void initializeRequestedMap() {
+  if (requestedMapInitialized) {
+    return;
+  }
+  for (int i = 0; i < SERVO_COUNT; i++) {
+    requestedMap[i].board = SERVO_CHANNEL_UNMAPPED;
+    requestedMap[i].output = SERVO_CHANNEL_UNMAPPED;
+  }
+  requestedMapInitialized = true;
+}
+
+/*!
+ *  @brief  Fills channelMap and boardChannels from the requested mappings, channels
+ *  without one take the next free output in board order.
+ *  @return 0 on success, -1 if two channels share an output or a board does not exist
+ */
+static int resolveChannelMap() {
+  initializeRequestedMap();
+  memset(boardChannels, SERVO_CHANNEL_UNMAPPED, sizeof(boardChannels));
+  for (int i = 0; i < SERVO_COUNT; i++) {
+    ServoChannelMapping mapping = requestedMap[i];
+    if (mapping.board == SERVO_CHANNEL_UNMAPPED) {
+      continue;
+    }
+    if (mapping.board >= boardCount || mapping.output >= PCA9685_CHANNEL_COUNT ||
+        boardChannels[mapping.board][mapping.output] != SERVO_CHANNEL_UNMAPPED) {
+      fprintf(stderr, "Servo channel %d: board %d output %d is missing or already taken\n", i, mapping.board,
+              mapping.output);
+      return -1;
+    }
+    boardChannels[mapping.board][mapping.output] = i;
+    channelMap[i] = mapping;
+  }
+  int next = 0;
+  for (int i = 0; i < SERVO_COUNT; i++) {
+    if (requestedMap[i].board != SERVO_CHANNEL_UNMAPPED) {
+      continue;
+    }
+    while (next < boardCount * PCA9685_CHANNEL_COUNT &&
+           boardChannels[next / PCA9685_CHANNEL_COUNT][next % PCA9685_CHANNEL_COUNT] != SERVO_CHANNEL_UNMAPPED) {
+      next++;
+    }
+    if (next == boardCount * PCA9685_CHANNEL_COUNT) {
+      fprintf(stderr, "Servo channel %d: no free output left on %d boards\n", i, boardCount);
+      return -1;
+    }
+    channelMap[i].board = next / PCA9685_CHANNEL_COUNT;
+    channelMap[i].output = next % PCA9685_CHANNEL_COUNT;
+    boardChannels[channelMap[i].board][channelMap[i].output] = i;
+  }
+  return 0;
+}
+
+/*!
+ *  @brief  Spreads the pulse starts of the servo channels evenly over the part of
+ *  the period every pulse fits in, so no pulse wraps past the period boundary.
+ */
+static void assignOnTicks() {
+  uint16_t longestPulse = 0;
+  for (int i = 0; i < SERVO_COUNT; i++) {
+    ServoCalibration calibration = servoCalibrationGet(i);
+    longestPulse = max(longestPulse, max(calibration.minTicks, calibration.maxTicks));
+  }
+  int spread = PCA9685_MAX_PWM + 1 - longestPulse;
+  for (int i = 0; i < SERVO_COUNT; i++) {
+    onTicks[i] = staggerRequested && spread > 0 ? spread * i / SERVO_COUNT : 0;
+  }
+}
+
+/*!
+ *  @brief  Prescale setPWMFreq programs for a frequency
+ */
+static uint8_t prescaleForFrequency(float freq) {
+  // Range output modulation frequency is dependant on oscillator
+  if (freq < 1)
+    freq = 1;
+  if (freq > 3500)
+    freq = 3500; // Datasheet limit is 3052=50MHz/(4*4096)
+
+  float prescaleval = ((_oscillator_freq / (freq * 4096.0)) + 0.5) - 1;
+  if (prescaleval < PCA9685_PRESCALE_MIN)
+    prescaleval = PCA9685_PRESCALE_MIN;
+  if (prescaleval > PCA9685_PRESCALE_MAX)
+    prescaleval = PCA9685_PRESCALE_MAX;
+  return (uint8_t)prescaleval;
+}
+
+/*!
+ *  @brief  Checks whether every board is still running as servoDriverInit left it
+ *  (awake, auto-increment, servo prescale) and if so takes over the pulses they are
+ *  putting out: servoPositions and the shadow copy are filled from the LEDn registers.
+ *  A channel whose LEDn_ON is not the one it would get is rewritten on the next flush.
+ *  @return false if a board needs the full configuration, nothing is changed then
+ */
+static bool readBackBoards() {
+  uint8_t prescale = prescaleForFrequency(PCA9685_SERVO_FREQUENCY);
+  uint8_t ledRegisters[PCA9685_MAX_BOARDS][PCA9685_CHANNEL_COUNT * 4];
+  for (int board = 0; board < boardCount; board++) {
+    int mode1 = transports[board]->readByteData(PCA9685_MODE1);
+    int boardPrescale = transports[board]->readByteData(PCA9685_PRESCALE);
+    if (mode1 < 0 || boardPrescale != prescale || (mode1 & (MODE1_SLEEP | MODE1_EXTCLK)) != 0 ||
+        (mode1 & MODE1_AI) == 0 || (allCallTransport != NULL && (mode1 & MODE1_ALLCAL) == 0)) {
+      return false;
+    }
+    for (int offset = 0; offset < (int)sizeof(ledRegisters[board]); offset += PCA9685_BLOCK_READ_MAX) {
+      if (transports[board]->readBlockData(PCA9685_LED0_ON_L + offset, &ledRegisters[board][offset],
+                                           PCA9685_BLOCK_READ_MAX) < 0) {
+        return false;
+      }
+    }
+  }
+  for (int i = 0; i < SERVO_COUNT; i++) {
+    const uint8_t *led = &ledRegisters[channelMap[i].board][4 * channelMap[i].output];
+    uint16_t on = led[0] | (led[1] << 8), off = led[2] | (led[3] << 8);
+    // Bit 12 is full on / full off, not a pulse the servo can be at
+    if (((on | off) & 0x1000) != 0 || off == on) {
+      shadowValid[i] = false;
+      channelReadBack[i] = false;
+      continue;
+    }
+    channelReadBack[i] = true;
+    servoPositions[i] = (off - on) & PCA9685_MAX_PWM;
+    shadowPwm[i] = servoPositions[i];
+    shadowValid[i] = on == onTicks[i];
+  }
+  pwmPrescale = prescale;
+  pwmEpochNanos.store(0, std::memory_order_relaxed);
+  return true;
+}
+
+void servoDriverPowerUpPose(uint16_t *frame) {
+  for (int i = 0; i < SERVO_COUNT; i++) {
+    frame[i] = servoAngleToTicks(i, 1);
+  }
+  frame[SERVO_COUNT - 1] = servoAngleToTicks(SERVO_COUNT - 1, 90);
+}
+
 /*!
  *  @brief  Setups the I2C interface and hardware
  *  @param  prescale
  *          Sets External Clock (Optional)
  */
 int servoDriverInit(uint8_t prescale) {
+  if (!servoCalibrationIsCompiled()) {
+    servoCalibrationLoadDefaults();
+  }
   // Init servo position array
-  servoPositions = new char[SERVO_COUNT];
-  for (int i = 0; i < SERVO_COUNT; i++) {
-	  servoPositions[i] = 1;
+  servoDriverPowerUpPose(servoPositions);
+
+  if (boardCount == 0) {
+    uint8_t addresses[PCA9685_MAX_BOARDS];
+    int count = (SERVO_COUNT + PCA9685_CHANNEL_COUNT - 1) / PCA9685_CHANNEL_COUNT;
+    for (int board = 0; board < count; board++) {
+      addresses[board] = PCA9685_I2C_ADDRESS + board;
+    }
+    servoDriverSetBoards(addresses, count);
   }
-  servoPositions[SERVO_COUNT - 1] = 90u;
-  //memset(servoPositions, 0, sizeof(uint8_t) * SERVO_COUNT);
-  #ifndef TEST_MODE
-  // Initialize GPIO library
-  if (gpioInitialise() < 0) {
-    perror("Unable to init GPIO library");
+  if (resolveChannelMap() < 0) {
+    return -1;
   }
-  
-  prescale = 0;
-  // Load file descriptor
-  controllerFileDescriptor = i2cOpen(PCA9685_I2C_BUS_CHANNEL, PCA9685_I2C_ADDRESS, 0);
-  if (controllerFileDescriptor < 0) {
-    perror("Init failed.\n");
+  assignOnTicks();
+
+  I2CTransport *allCall = NULL;
+  for (int board = 0; board < boardCount; board++) {
+    switch (transportType) {
+    #ifdef HAVE_PIGPIO
+    case I2C_TRANSPORT_PIGPIO:
+      transports[board] = &pigpioTransports[board];
+      allCall = &pigpioTransports[PCA9685_MAX_BOARDS];
+      break;
+    #endif
+    case I2C_TRANSPORT_LINUX:
+      transports[board] = &linuxI2CTransports[board];
+      allCall = &linuxI2CTransports[PCA9685_MAX_BOARDS];
+      break;
+    case I2C_TRANSPORT_SIMULATED:
+      transports[board] = &simulatedControllers[board];
+      simulatedAllCall.attach(simulatedControllers, boardCount);
+      allCall = &simulatedAllCall;
+      break;
+    default:
+      fprintf(stderr, "I2C transport %d is not available in this build\n", transportType);
+      return -1;
+    }
   }
+
+  #ifndef TEST_MODE
+  prescale = 0;
   #endif
-  printf("Init success\n");
+  // Load file descriptors
+  for (int board = 0; board < boardCount; board++) {
+    int fileDescriptor = transports[board]->open(PCA9685_I2C_BUS_CHANNEL, boardAddresses[board]);
+    if (fileDescriptor < 0) {
+      fprintf(stderr, "Init failed for the board at 0x%02x\n", boardAddresses[board]);
+      return fileDescriptor;
+    }
+    if (board == 0) {
+      controllerFileDescriptor = fileDescriptor;
+    }
+  }
+  allCallTransport = NULL;
+  if (allCallRequested) {
+    if (allCall->open(PCA9685_I2C_BUS_CHANNEL, PCA9685_ALLCALL_ADDRESS) < 0) {
+      fprintf(stderr, "Unable to open the ALLCALL address, configuring the boards one by one\n");
+    } else {
+      allCallTransport = allCall;
+    }
+  }
+  printf("Init success, %d board%s%s\n", boardCount, boardCount == 1 ? "" : "s",
+         allCallTransport != NULL ? " via ALLCALL" : "");
 
+  warmStarted = warmStartRequested && prescale == 0 && readBackBoards();
+  if (warmStarted) {
+    printf("Boards already configured, keeping their outputs\n");
+    return controllerFileDescriptor;
+  }
   reset();
 
   if (prescale != 0) {
     setExtClk(prescale);
   } else {
     // set a default frequency
-    setPWMFreq(50);
+    setPWMFreq(PCA9685_SERVO_FREQUENCY);
   }
   // set the default internal frequency
   setOscillatorFrequency(FREQUENCY_OSCILLATOR);
@@ -54,44 +287,141 @@ int servoDriverInit(uint8_t prescale) {
 }
 
 /*!
- * Released control on the i2c device. Call before program exit.
+ * Released control on the i2c devices. Call before program exit.
  * */
 void servoDriverDeInit(unsigned int fd) {
-  #ifndef TEST_MODE
-  if (i2cClose(fd) != 0) {
-    perror("Unable to close device, not open");
+  for (int board = 0; board < boardCount; board++) {
+    if (transports[board] != NULL) {
+      transports[board]->close();
+      transports[board] = NULL;
+    }
+  }
+  if (allCallTransport != NULL) {
+    allCallTransport->close();
+    allCallTransport = NULL;
   }
-  #else
+  #ifdef TEST_MODE
   cout << "Servo driver deinit success." << '\n';
   #endif
 }
 
+/*!
+ *  @brief  Chooses how the PCA9685 is reached, call before servoDriverInit
+ *  @param  type One of the I2C_TRANSPORT_* values
+ */
+void servoDriverSelectTransport(int type) {
+  transportType = type;
+}
+
+int servoDriverSetBoards(const uint8_t *addresses, int count) {
+  if (count < 1 || count > PCA9685_MAX_BOARDS) {
+    return -1;
+  }
+  for (int board = 0; board < count; board++) {
+    boardAddresses[board] = addresses[board];
+  }
+  boardCount = count;
+  return 0;
+}
+
+int servoDriverGetBoardCount() {
+  return boardCount;
+}
+
+void servoDriverMapChannel(uint8_t channel, uint8_t board, uint8_t output) {
+  initializeRequestedMap();
+  requestedMap[channel].board = board;
+  requestedMap[channel].output = output;
+}
 
 /*!
- *  @brief  Sends a reset command to the PCA9685 chip over I2C
+ *  @brief  Where a channel is wired, valid after servoDriverInit
+ */
+ServoChannelMapping servoDriverGetMapping(uint8_t channel) {
+  return channelMap[channel];
+}
+
+void servoDriverUseAllCall(bool enabled) {
+  allCallRequested = enabled;
+}
+
+I2CTransport *servoDriverGetTransport() {
+  return transports[0];
+}
+
+I2CTransport *servoDriverGetBoardTransport(int board) {
+  return transports[board];
+}
+
+/*!
+ *  @brief  The boards a configuration sequence runs on: all of them at once through
+ *  ALLCALL, or each in turn. Reads of PCA9685_ALLCALL_BOARD go to the first board,
+ *  all boards are configured identically.
+ *  @return number of entries written to targets
+ */
+static int configurationTargets(int targets[PCA9685_MAX_BOARDS]) {
+  if (allCallTransport != NULL) {
+    targets[0] = PCA9685_ALLCALL_BOARD;
+    return 1;
+  }
+  for (int board = 0; board < boardCount; board++) {
+    targets[board] = board;
+  }
+  return boardCount;
+}
+
+/*!
+ *  @brief  MODE1 bits to keep set in every write, a board stops answering ALLCALL
+ *  once its ALLCALL bit is cleared
+ */
+static uint8_t mode1Keep() {
+  return allCallTransport != NULL ? MODE1_ALLCAL : 0;
+}
+
+/*!
+ *  @brief  Sends a reset command to every PCA9685 over I2C
  */
 void reset() {
-  write8(PCA9685_MODE1, MODE1_RESTART);
+  int targets[PCA9685_MAX_BOARDS];
+  int targetCount = configurationTargets(targets);
+  for (int i = 0; i < targetCount; i++) {
+    write8(targets[i], PCA9685_MODE1, MODE1_RESTART | mode1Keep());
+  }
+  servoDriverInvalidateShadow();
   //sleep(10);
 }
 
 /*!
- *  @brief  Puts board into sleep mode
+ *  @brief  Puts the boards into sleep mode
  */
 void servoDriverSleep() {
-  uint8_t awake = read8(PCA9685_MODE1);
-  uint8_t sleep = awake | MODE1_SLEEP; // set sleep bit high
-  write8(PCA9685_MODE1, sleep);
+  int targets[PCA9685_MAX_BOARDS];
+  int targetCount = configurationTargets(targets);
+  for (int i = 0; i < targetCount; i++) {
+    uint8_t awake = read8(targets[i], PCA9685_MODE1) | mode1Keep();
+    uint8_t sleep = (awake & ~MODE1_RESTART) | MODE1_SLEEP; // set sleep bit high
+    write8(targets[i], PCA9685_MODE1, sleep);
+  }
   //sleep(5); // wait until cycle ends for sleep to be active
 }
 
 /*!
- *  @brief  Wakes board from sleep
+ *  @brief  Wakes the boards from sleep
  */
 void wakeup() {
-  uint8_t sleep = read8(PCA9685_MODE1);
-  uint8_t wakeup = sleep & ~MODE1_SLEEP; // set sleep bit low
-  write8(PCA9685_MODE1, wakeup);
+  int targets[PCA9685_MAX_BOARDS];
+  int targetCount = configurationTargets(targets);
+  for (int i = 0; i < targetCount; i++) {
+    uint8_t sleep = read8(targets[i], PCA9685_MODE1) | mode1Keep();
+    uint8_t wakeup = sleep & ~(MODE1_SLEEP | MODE1_RESTART); // set sleep bit low
+    write8(targets[i], PCA9685_MODE1, wakeup);
+    usleep(PCA9685_OSCILLATOR_STARTUP_MICROS);
+    // The outputs stay off until RESTART is written, they come back with the old LEDn values
+    write8(targets[i], PCA9685_MODE1, wakeup | MODE1_RESTART);
+    if (i == 0) {
+      pwmEpochNanos.store(monotonicNanos(), std::memory_order_relaxed);
+    }
+  }
 }
 
 /*!
@@ -100,19 +430,28 @@ void wakeup() {
  *          Configures the prescale value to be used by the external clock
  */
 void setExtClk(uint8_t prescale) {
-  uint8_t oldmode = read8(PCA9685_MODE1);
-  uint8_t newmode = (oldmode & ~MODE1_RESTART) | MODE1_SLEEP; // sleep
-  write8(PCA9685_MODE1, newmode);                             // go to sleep, turn off internal oscillator
+  int targets[PCA9685_MAX_BOARDS];
+  int targetCount = configurationTargets(targets);
+  for (int i = 0; i < targetCount; i++) {
+    int board = targets[i];
+    uint8_t oldmode = read8(board, PCA9685_MODE1) | mode1Keep();
+    uint8_t newmode = (oldmode & ~MODE1_RESTART) | MODE1_SLEEP; // sleep
+    write8(board, PCA9685_MODE1, newmode);                      // go to sleep, turn off internal oscillator
 
-  // This sets both the SLEEP and EXTCLK bits of the MODE1 register to switch to
-  // use the external clock.
-  write8(PCA9685_MODE1, (newmode |= MODE1_EXTCLK));
+    // This sets both the SLEEP and EXTCLK bits of the MODE1 register to switch to
+    // use the external clock.
+    write8(board, PCA9685_MODE1, (newmode |= MODE1_EXTCLK));
 
-  write8(PCA9685_PRESCALE, prescale); // set the prescaler
+    write8(board, PCA9685_PRESCALE, prescale); // set the prescaler
 
-  //sleep(5);
-  // clear the SLEEP bit to start
-  write8(PCA9685_MODE1, (newmode & ~MODE1_SLEEP) | MODE1_RESTART | MODE1_AI);
+    //sleep(5);
+    // clear the SLEEP bit to start
+    write8(board, PCA9685_MODE1, (newmode & ~MODE1_SLEEP) | MODE1_RESTART | MODE1_AI);
+    if (i == 0) {
+      pwmEpochNanos.store(monotonicNanos() + PCA9685_OSCILLATOR_STARTUP_MICROS * 1000LL, std::memory_order_relaxed);
+    }
+  }
+  pwmPrescale = prescale;
 }
 
 /*!
@@ -120,27 +459,26 @@ void setExtClk(uint8_t prescale) {
  *  @param  freq Floating point frequency that we will attempt to match
  */
 void setPWMFreq(float freq) {
-  // Range output modulation frequency is dependant on oscillator
-  if (freq < 1)
-    freq = 1;
-  if (freq > 3500)
-    freq = 3500; // Datasheet limit is 3052=50MHz/(4*4096)
-
-  float prescaleval = ((_oscillator_freq / (freq * 4096.0)) + 0.5) - 1;
-  if (prescaleval < PCA9685_PRESCALE_MIN)
-    prescaleval = PCA9685_PRESCALE_MIN;
-  if (prescaleval > PCA9685_PRESCALE_MAX)
-    prescaleval = PCA9685_PRESCALE_MAX;
-  uint8_t prescale = (uint8_t)prescaleval;
+  uint8_t prescale = prescaleForFrequency(freq);
 
-  uint8_t oldmode = read8(PCA9685_MODE1);
-  uint8_t newmode = (oldmode & ~MODE1_RESTART) | MODE1_SLEEP; // sleep
-  write8(PCA9685_MODE1, newmode);                             // go to sleep
-  write8(PCA9685_PRESCALE, prescale);                         // set the prescaler
-  write8(PCA9685_MODE1, oldmode);
-  //sleep(5);
-  // This sets the MODE1 register to turn on auto increment.
-  write8(PCA9685_MODE1, oldmode | MODE1_RESTART | MODE1_AI);
+  int targets[PCA9685_MAX_BOARDS];
+  int targetCount = configurationTargets(targets);
+  for (int i = 0; i < targetCount; i++) {
+    int board = targets[i];
+    uint8_t oldmode = read8(board, PCA9685_MODE1) | mode1Keep();
+    uint8_t newmode = (oldmode & ~MODE1_RESTART) | MODE1_SLEEP; // sleep
+    write8(board, PCA9685_MODE1, newmode);                      // go to sleep
+    write8(board, PCA9685_PRESCALE, prescale);                  // set the prescaler
+    write8(board, PCA9685_MODE1, oldmode);
+    //sleep(5);
+    // This sets the MODE1 register to turn on auto increment. Through ALLCALL every
+    // board restarts its PWM period on the same STOP condition.
+    write8(board, PCA9685_MODE1, oldmode | MODE1_RESTART | MODE1_AI);
+    if (i == 0) {
+      pwmEpochNanos.store(monotonicNanos() + PCA9685_OSCILLATOR_STARTUP_MICROS * 1000LL, std::memory_order_relaxed);
+    }
+  }
+  pwmPrescale = prescale;
 }
 
 /*!
@@ -151,96 +489,210 @@ void setPWMFreq(float freq) {
  *  @param  totempole Totempole if true, open drain if false.
  */
 void setOutputMode(uint8_t totempole) {
-  uint8_t oldmode = read8(PCA9685_MODE2);
-  uint8_t newmode;
-  if (totempole) {
-    newmode = oldmode | MODE2_OUTDRV;
-  } else {
-    newmode = oldmode & ~MODE2_OUTDRV;
+  int targets[PCA9685_MAX_BOARDS];
+  int targetCount = configurationTargets(targets);
+  for (int i = 0; i < targetCount; i++) {
+    uint8_t oldmode = read8(targets[i], PCA9685_MODE2);
+    uint8_t newmode;
+    if (totempole) {
+      newmode = oldmode | MODE2_OUTDRV;
+    } else {
+      newmode = oldmode & ~MODE2_OUTDRV;
+    }
+    write8(targets[i], PCA9685_MODE2, newmode);
   }
-  write8(PCA9685_MODE2, newmode);
 }
 
 /*!
- *  @brief  Reads set Prescale from PCA9685
+ *  @brief  Reads set Prescale from the first PCA9685
  *  @return prescale value
  */
 uint8_t readPrescale(void) {
-  return read8(PCA9685_PRESCALE);
+  return read8(0, PCA9685_PRESCALE);
+}
+
+/*!
+ *  @brief  Board and output of a pin number: servo channels go through the channel
+ *  map, higher numbers are the outputs of the first board.
+ */
+static ServoChannelMapping pinMapping(uint8_t num) {
+  if (num < SERVO_COUNT) {
+    return channelMap[num];
+  }
+  ServoChannelMapping mapping = {0, (uint8_t)(num % PCA9685_CHANNEL_COUNT)};
+  return mapping;
 }
 
 /*!
  *  @brief  Gets the PWM output of one of the PCA9685 pins
- *  @param  num One of the PWM output pins, from 0 to 15
+ *  @param  num A servo channel, or one of the first board's outputs from SERVO_COUNT to 15
  *  @return requested PWM output value
  */
 uint8_t getPWM(uint8_t num) {
-  return read8(PCA9685_LED0_ON_L + 4 * num);
+  ServoChannelMapping mapping = pinMapping(num);
+  return read8(mapping.board, PCA9685_LED0_ON_L + 4 * mapping.output);
 }
 
 /*!
  *  @brief  Sets the PWM output of one of the PCA9685 pins
- *  @param  num One of the PWM output pins, from 0 to 15
+ *  @param  num A servo channel, or one of the first board's outputs from SERVO_COUNT to 15
  *  @param  on At what point in the 4096-part cycle to turn the PWM output ON
  *  @param  off At what point in the 4096-part cycle to turn the PWM output OFF
  */
 void setPWM(uint8_t num, uint16_t on, uint16_t off) {
-  // Leave this as uint8_t even if compiler warns
-  char toWrite[5] = {
-      (PCA9685_LED0_ON_L + 4 * num),
-      on,
-      on >> 8,
-      off,
-      off >> 8};
-  // write(controllerFileDescriptor, toWrite, 5);
-  #ifndef TEST_MODE
-  i2cWriteDevice(controllerFileDescriptor, toWrite, 5);
-  #endif
+  ServoChannelMapping mapping = pinMapping(num);
+  uint8_t toWrite[5] = {
+      (uint8_t)(PCA9685_LED0_ON_L + 4 * mapping.output),
+      (uint8_t)on,
+      (uint8_t)(on >> 8),
+      (uint8_t)off,
+      (uint8_t)(off >> 8)};
+  transports[mapping.board]->writeDevice(toWrite, 5);
+  busStats.bytesWritten += 5;
+  busStats.transactions++;
+  busStats.channelsWritten++;
+  // Written behind the back of the shadow copy
+  if (num < SERVO_COUNT) {
+    shadowValid[num] = false;
+  }
 }
 
-void servoDriverWriteCommands() {
-  int bytesToWrite = ((SERVO_COUNT) * 4) + 1;   //
-  char toWrite[bytesToWrite];
-  toWrite[0] = PCA9685_LED0_ON_L;
-  
+/*!
+ *  @brief  Forgets what was last written, the next servoDriverWriteCommands
+ *  rewrites every channel including the LEDn_ON registers.
+ */
+void servoDriverInvalidateShadow() {
   for (int i = 0; i < SERVO_COUNT; i++) {
-    uint16_t servoPwm = (((SG90_MAX - SG90_MIN) / (180 - 0)) * (unsigned int)servoPositions[i]) + SG90_MIN;
-    #ifdef TEST_MODE
-    cout << (unsigned int)servoPositions[i] << '\t';
-    #endif
-    int index = 1 + (i * 4);
-    toWrite[index] = 0;
-    toWrite[index + 1] = 0 >> 8;
-    toWrite[index + 2] = servoPwm;
-    toWrite[index + 3] = servoPwm >> 8;
-    // cout << '\r' ;
-  }
-  
-
-  // Left for example
-  // uint16_t wheel4Pwm = (controlCommand.motorY2 * 1.0 / 255) * PCA9685_MAX_PWM;
-  // uint16_t wheel4D1 = (controlCommand.motorY2D1 == 1) ? PCA9685_MAX_PWM : 0;
-  // uint16_t wheel4D2 = (controlCommand.motorY2D2 == 1) ? PCA9685_MAX_PWM : 0;
-  
-  #ifndef TEST_MODE
-  i2cWriteDevice(controllerFileDescriptor, toWrite, bytesToWrite);
-  #else
-  cout << '\n';
+    shadowValid[i] = false;
+  }
+}
+
+ServoDriverBusStats servoDriverGetBusStats() {
+  return busStats;
+}
+
+void servoDriverStaggerOutputs(bool enabled) {
+  staggerRequested = enabled;
+}
+
+uint16_t servoDriverGetOnTicks(uint8_t channel) {
+  return onTicks[channel];
+}
+
+int64_t servoDriverGetPwmPeriodNanos() {
+  return (int64_t)(pwmPrescale + 1) * (PCA9685_MAX_PWM + 1) * NANOS_PER_SECOND / _oscillator_freq;
+}
+
+int64_t servoDriverGetPwmEpochNanos() {
+  return pwmEpochNanos.load(std::memory_order_relaxed);
+}
+
+void servoDriverSetPwmEpochNanos(int64_t epochNanos) {
+  pwmEpochNanos.store(epochNanos, std::memory_order_relaxed);
+}
+
+void servoDriverWarmStart(bool enabled) {
+  warmStartRequested = enabled;
+}
+
+bool servoDriverIsWarm() {
+  return warmStarted;
+}
+
+bool servoDriverIsReadBack(uint8_t channel) {
+  return warmStarted && channelReadBack[channel];
+}
+
+void servoDriverPrintFrames(bool enabled) {
+  printFrames = enabled;
+}
+
+/*!
+ *  @brief  Flushes a frame of ticks, one per servo channel, to the controllers.
+ *  Only channels that changed since the last flush are sent. The changed channels are
+ *  sorted onto their boards as a bit mask of outputs, each run of adjacent changed
+ *  outputs is one auto-increment burst to that board, starting at the LEDn_OFF_L
+ *  register of the first output as the LEDn_ON registers never change. LEDn_OFF is
+ *  the channel's LEDn_ON plus the pulse width. Boards without
+ *  a change cost nothing, so the traffic follows the number of changed channels.
+ *  A run holding a channel that was never written (or invalidated) is sent in full.
+ */
+void servoDriverWriteFrame(const uint16_t *servoPwm) {
+  uint16_t dirtyOutputs[PCA9685_MAX_BOARDS] = {};
+  uint16_t unknownOutputs[PCA9685_MAX_BOARDS] = {};
+  #ifdef TEST_MODE
+  if (printFrames) {
+    for (int i = 0; i < SERVO_COUNT; i++) {
+      cout << servoPwm[i] << '\t';
+    }
+    cout << '\n';
+  }
   #endif
+  for (int i = 0; i < SERVO_COUNT; i++) {
+    if (!shadowValid[i] || shadowPwm[i] != servoPwm[i]) {
+      uint16_t bit = 1 << channelMap[i].output;
+      dirtyOutputs[channelMap[i].board] |= bit;
+      if (!shadowValid[i]) {
+        unknownOutputs[channelMap[i].board] |= bit;
+      }
+    }
+  }
+
+  // Worst case is a full board: register address + 4 bytes per output
+  uint8_t toWrite[(PCA9685_CHANNEL_COUNT * 4) + 1];
+  for (int board = 0; board < boardCount; board++) {
+    uint32_t dirty = dirtyOutputs[board];
+    while (dirty != 0) {
+      int first = __builtin_ctz(dirty);
+      int end = first;
+      while (end < PCA9685_CHANNEL_COUNT && (dirty & (1u << end))) {
+        end++;
+      }
+      uint32_t run = ((1u << end) - 1) & ~((1u << first) - 1);
+      bool fullWrite = (unknownOutputs[board] & run) != 0;
+
+      int bytesToWrite = 0;
+      if (fullWrite) {
+        toWrite[bytesToWrite++] = PCA9685_LED0_ON_L + 4 * first;
+      } else {
+        toWrite[bytesToWrite++] = PCA9685_LED0_OFF_L + 4 * first;
+      }
+      for (int output = first; output < end; output++) {
+        int channel = boardChannels[board][output];
+        uint16_t on = onTicks[channel];
+        uint16_t off = servoPwm[channel] == SERVO_TICKS_OFF ? SERVO_TICKS_OFF : on + servoPwm[channel];
+        if (output != first || fullWrite) {
+          toWrite[bytesToWrite++] = on;
+          toWrite[bytesToWrite++] = on >> 8;
+        }
+        toWrite[bytesToWrite++] = off;
+        toWrite[bytesToWrite++] = off >> 8;
+        shadowPwm[channel] = servoPwm[channel];
+        shadowValid[channel] = true;
+      }
+
+      transports[board]->writeDevice(toWrite, bytesToWrite);
+      busStats.bytesWritten += bytesToWrite;
+      busStats.transactions++;
+      busStats.channelsWritten += end - first;
+      dirty &= ~run;
+    }
+  }
+  busStats.flushes++;
+}
+
+void servoDriverWriteCommands() {
+  servoDriverWriteFrame(servoPositions);
 }
 
 /*!
  * Gives a more intuitive interface to setPwm function.
  * Valid only for 180 degree commonly used servos.
  * Tested with the SG90 small 9g servo.
- * Accepts values 0 - 180 (inclusive)
+ * Accepts values 0 - 180 (inclusive), converted with the channel's calibration.
  */
-void setPos(uint8_t servoNum, uint8_t position) {
-  if (position > (uint8_t)180)
-    position = (uint8_t)180;
-
-  uint16_t correspondingPwm = (((SG90_MAX - SG90_MIN) / (180 - 0)) * position) + SG90_MIN;
-  setPWM(servoNum, 0, correspondingPwm);
+void setPos(uint8_t servoNum, float position) {
+  setPWM(servoNum, 0, servoAngleToTicks(servoNum, position));
 }
 
 /*!
@@ -300,18 +752,19 @@ void setOscillatorFrequency(uint32_t freq) {
 }
 
 /******************* Low level I2C interface */
-uint8_t read8(uint8_t addr) {
-  #ifdef TEST_MODE
-  return 0;
-  #else
-  return i2cReadByteData(controllerFileDescriptor, addr);
-  #endif
+uint8_t read8(int board, uint8_t addr) {
+  I2CTransport *transport = board == PCA9685_ALLCALL_BOARD ? transports[0] : transports[board];
+  int value = transport->readByteData(addr);
+  if (value < 0) {
+    perror("Unable to read byte");
+    return 0;
+  }
+  return value;
 }
 
-void write8(uint8_t addr, uint8_t value) {
-  #ifndef TEST_MODE
-  if (i2cWriteByteData(controllerFileDescriptor, addr, value) < 0) {
+void write8(int board, uint8_t addr, uint8_t value) {
+  I2CTransport *transport = board == PCA9685_ALLCALL_BOARD ? allCallTransport : transports[board];
+  if (transport->writeByteData(addr, value) < 0) {
     perror("Unable to write byte");
   }
-  #endif
 }
@@ -2,6 +2,7 @@
 #define _SERVO_DRIVER_H
 
 #include <stdint.h>
+#include "I2CTransport.h"
 
 // REGISTER ADDRESSES
 #define PCA9685_MODE1 0x00      /**< Mode Register 1 */
@@ -39,9 +40,25 @@
 #define MODE2_OCH 0x08    /**< Outputs change on ACK vs STOP */
 #define MODE2_INVRT 0x10  /**< Output logic state inverted */
 
+#ifdef TEST_MODE
+#define I2C_TRANSPORT_DEFAULT I2C_TRANSPORT_SIMULATED
+#elif defined(HAVE_PIGPIO)
+#define I2C_TRANSPORT_DEFAULT I2C_TRANSPORT_PIGPIO
+#else
+#define I2C_TRANSPORT_DEFAULT I2C_TRANSPORT_LINUX
+#endif
+
 #define PCA9685_I2C_BUS_CHANNEL 1
 #define PCA9685_I2C_ADDRESS 0x40      /**< Default PCA9685 I2C Slave Address */
+#define PCA9685_ALLCALL_ADDRESS 0x70  /**< Power on LED All Call address (ALLCALLADR 0xE0) */
+#define PCA9685_CHANNEL_COUNT 16      /**< PWM outputs per board */
+#define PCA9685_MAX_BOARDS 4
+// Board number that addresses every board at once, see servoDriverUseAllCall
+#define PCA9685_ALLCALL_BOARD -1
 #define FREQUENCY_OSCILLATOR 25000000 /**< Int. osc. frequency in datasheet */
+#define PCA9685_OSCILLATOR_STARTUP_MICROS 500 /**< Oscillator start after clearing SLEEP */
+#define PCA9685_SERVO_FREQUENCY 50    /**< PWM frequency servoDriverInit sets up */
+#define PCA9685_BLOCK_READ_MAX 32     /**< Longest register block read, the SMBus limit */
 
 #define PCA9685_PRESCALE_MIN 3   /**< minimum prescale value */
 #define PCA9685_PRESCALE_MAX 255 /**< maximum prescale value */
@@ -54,15 +71,76 @@
 
 #define MOTOR_MAX_SPEED 255
 #define SERVO_MAX_ANGLE 180
+// Two per leg plus the camera servos, set by the build for other robot variants
+#ifndef SERVO_COUNT
 #define SERVO_COUNT 9
+#endif
 
 // This is for the writing to controller part. Users should not modify directly.
-extern char *servoPositions;
+// Holds LEDn_OFF ticks per servo, see servoAngleToTicks in ServoCalibration.h
+extern uint16_t *servoPositions;
+// A frame value that turns the output fully off (LEDn_OFF bit 12), the servo holds no torque
+#define SERVO_TICKS_OFF 4096
+
+/*!
+ * Running totals of I2C traffic generated by the driver.
+ * A flush is one call to servoDriverWriteCommands, a transaction is one bus write
+ * to one board.
+ * */
+struct ServoDriverBusStats {
+  uint64_t bytesWritten;
+  uint64_t channelsWritten;
+  uint32_t transactions;
+  uint32_t flushes;
+};
+
+/*!
+ * Where a logical servo channel (an index into servoPositions) is wired: a board and
+ * one of its PWM outputs.
+ * */
+struct ServoChannelMapping {
+  uint8_t board;
+  uint8_t output;
+};
 
+void servoDriverSelectTransport(int type);
+/*!
+ *  @brief  Sets the I2C addresses of the boards, call before servoDriverInit.
+ *  Defaults to as many boards from PCA9685_I2C_ADDRESS up as SERVO_COUNT needs.
+ *  @return 0 on success, -1 if the count is out of range
+ */
+int servoDriverSetBoards(const uint8_t *addresses, int count);
+int servoDriverGetBoardCount();
+/*!
+ *  @brief  Wires a logical channel to an output of a board, call before servoDriverInit.
+ *  Channels that are not mapped fill the boards in order, 16 to a board.
+ */
+void servoDriverMapChannel(uint8_t channel, uint8_t board, uint8_t output);
+ServoChannelMapping servoDriverGetMapping(uint8_t channel);
+/*!
+ *  @brief  Sends the configuration of every board (mode, prescale, restart) as one
+ *  write to PCA9685_ALLCALL_ADDRESS, so the boards restart their PWM periods together.
+ *  Call before servoDriverInit. No board may use PCA9685_ALLCALL_ADDRESS as its own address.
+ */
+void servoDriverUseAllCall(bool enabled);
+/*!
+ *  @brief  The transport of the first board, NULL before init
+ */
+I2CTransport *servoDriverGetTransport();
+I2CTransport *servoDriverGetBoardTransport(int board);
+/*!
+ *  @brief  Fills frame with the pose servoDriverInit starts from: the legs at 1 degree,
+ *  the camera centered. Needs the calibration loaded.
+ */
+void servoDriverPowerUpPose(uint16_t *frame);
 int servoDriverInit(uint8_t prescale);
 void servoDriverDeInit(unsigned int fd);
 void reset();
 void servoDriverSleep();
+/*!
+ *  @brief  Wakes the boards from sleep and restarts their PWM channels with the
+ *  LEDn values they had, a new run of PWM periods starts (servoDriverGetPwmEpochNanos)
+ */
 void wakeup();
 void setExtClk(uint8_t prescale);
 void setPWMFreq(float freq);
@@ -71,15 +149,69 @@ uint8_t getPWM(uint8_t num);
 void setPWM(uint8_t num, uint16_t on, uint16_t off);
 void setPin(uint8_t num, uint16_t val, uint8_t invert);
 uint8_t readPrescale(void);
-void setPos(uint8_t servoNum, uint8_t position);
+void setPos(uint8_t servoNum, float position);
 
-// Write multiple PWM pins at the same time
+// Write multiple PWM pins at the same time, skipping the ones that did not change
 void servoDriverWriteCommands();
+/*!
+ *  @brief  Same as servoDriverWriteCommands for a frame other than servoPositions.
+ *  The shadow copy and bus stats are not locked, flush from one thread at a time.
+ */
+void servoDriverWriteFrame(const uint16_t *ticks);
+void servoDriverInvalidateShadow();
+ServoDriverBusStats servoDriverGetBusStats();
+/*!
+ *  @brief  Starts the servo pulses at evenly spread LEDn_ON ticks instead of all at
+ *  tick 0, so the servos do not all draw their inrush current at once. Call before
+ *  servoDriverInit, the offsets follow the calibration loaded at that point.
+ */
+void servoDriverStaggerOutputs(bool enabled);
+uint16_t servoDriverGetOnTicks(uint8_t channel);
+/*!
+ *  @brief  Length of a PWM period from the prescale and getOscillatorFrequency,
+ *  set the measured oscillator frequency of the boards for an exact period
+ */
+int64_t servoDriverGetPwmPeriodNanos();
+/*!
+ *  @brief  When the first board (or all of them through ALLCALL) started the current
+ *  run of PWM periods, on CLOCK_MONOTONIC. Boards configured one by one start their
+ *  periods a configuration sequence apart. Safe to read from any thread, the writer
+ *  thread moves it when it wakes the boards.
+ */
+int64_t servoDriverGetPwmEpochNanos();
+/*!
+ *  @brief  Restores an epoch saved by an earlier run, a warm start does not restart
+ *  the PWM periods and can not see where they started
+ */
+void servoDriverSetPwmEpochNanos(int64_t epochNanos);
+/*!
+ *  @brief  Lets servoDriverInit read back MODE1, PRESCALE and the LEDn registers
+ *  and leave boards that are still configured alone: no reset, no restart of the
+ *  oscillator, and servoPositions holds the pulses the boards are putting out instead
+ *  of the default pose. Call before servoDriverInit.
+ */
+void servoDriverWarmStart(bool enabled);
+/*!
+ *  @brief  True if servoDriverInit took over already configured boards
+ */
+bool servoDriverIsWarm();
+/*!
+ *  @brief  True if the warm start took the channel's pulse over from its board. Not for
+ *  channels that were fully off (e.g. released while idle) or fully on, those still
+ *  hold the default pose.
+ */
+bool servoDriverIsReadBack(uint8_t channel);
+/*!
+ *  @brief  TEST_MODE builds: prints every frame servoDriverWriteFrame flushes to stdout.
+ *  Off by default, the benchmarks flush every tick. No effect in other builds.
+ */
+void servoDriverPrintFrames(bool enabled);
 
 void setOscillatorFrequency(uint32_t freq);
 uint32_t getOscillatorFrequency(void);
 
-uint8_t read8(uint8_t addr);
-void write8(uint8_t addr, uint8_t d);
+// board is a board number or PCA9685_ALLCALL_BOARD
+uint8_t read8(int board, uint8_t addr);
+void write8(int board, uint8_t addr, uint8_t d);
 
 #endif
@@ -0,0 +1,200 @@
+#include "ServoFrameWriter.h"
+#include "ControlLoop.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+ServoFrameWriter::ServoFrameWriter()
+    : running(false), publishedCount(0), supersededCount(0), writtenCount(0), idleRequested(false),
+      sleepRequested(false) {
+  sem_init(&this->frameReady, 0, 0);
+  memset(&this->publishing, 0, sizeof(this->publishing));
+  memset(&this->writing, 0, sizeof(this->writing));
+  this->realtimePriority = CONTROL_LOOP_NO_REALTIME_PRIORITY;
+  this->alignToPwm = false;
+  this->imu = NULL;
+  this->boardsAsleep = false;
+}
+
+ServoFrameWriter::~ServoFrameWriter() {
+  this->stop();
+  sem_destroy(&this->frameReady);
+}
+
+void ServoFrameWriter::alignToPwmPeriod(int64_t guardNanos) {
+  this->pwmSchedule.configure(servoDriverGetPwmEpochNanos(), servoDriverGetPwmPeriodNanos(), guardNanos);
+  this->alignToPwm = true;
+}
+
+void ServoFrameWriter::attachImu(ImuSampler *imu) {
+  this->imu = imu;
+}
+
+void ServoFrameWriter::start(int realtimePriority) {
+  this->realtimePriority = realtimePriority;
+  this->running = true;
+  this->writerThread = std::thread(&ServoFrameWriter::writeLoop, this);
+}
+
+void ServoFrameWriter::stop() {
+  if (!this->writerThread.joinable()) {
+    return;
+  }
+  this->running = false;
+  sem_post(&this->frameReady);
+  this->writerThread.join();
+}
+
+void ServoFrameWriter::publish(const uint16_t *ticks, int64_t nowNanos) {
+  memcpy(this->publishing.ticks, ticks, sizeof(this->publishing.ticks));
+  this->publishing.sequence = this->publishedCount.fetch_add(1, std::memory_order_relaxed);
+  this->publishing.publishedNanos = nowNanos;
+  if (this->mailbox.publish(this->publishing)) {
+    this->supersededCount.fetch_add(1, std::memory_order_relaxed);
+  }
+  // One post per frame, the writer drains the surplus without flushing
+  sem_post(&this->frameReady);
+}
+
+void ServoFrameWriter::setIdle(bool idle, bool sleepBoards) {
+  this->idleRequested = idle;
+  this->sleepRequested = sleepBoards;
+  // Out of a long wait, the writer finds no frame and picks up the new state
+  sem_post(&this->frameReady);
+}
+
+void ServoFrameWriter::applyPowerState() {
+  bool sleep = this->sleepRequested;
+  if (sleep == this->boardsAsleep) {
+    return;
+  }
+  if (sleep) {
+    servoDriverSleep();
+  } else {
+    wakeup();
+    this->pwmSchedule.setEpoch(servoDriverGetPwmEpochNanos());
+  }
+  this->boardsAsleep = sleep;
+}
+
+static struct timespec nanosToTimespec(int64_t nanos) {
+  struct timespec time;
+  time.tv_sec = nanos / NANOS_PER_SECOND;
+  time.tv_nsec = nanos % NANOS_PER_SECOND;
+  return time;
+}
+
+int ServoFrameWriter::waitForFrame() {
+  while (true) {
+    if (this->imu == NULL || this->idleRequested) {
+      return sem_wait(&this->frameReady);
+    }
+    // Returns at once with a frame pending, the frame goes before a sample that is due
+    struct timespec due = nanosToTimespec(this->imu->getNextSampleNanos());
+    if (sem_clockwait(&this->frameReady, CLOCK_MONOTONIC, &due) == 0) {
+      return 0;
+    }
+    if (errno != ETIMEDOUT) {
+      return -1;
+    }
+    this->imu->sample(monotonicNanos());
+  }
+}
+
+void ServoFrameWriter::sampleImuUntil(int64_t limitNanos) {
+  if (this->imu == NULL) {
+    return;
+  }
+  while (true) {
+    int64_t dueNanos = this->imu->getNextSampleNanos();
+    int64_t nowNanos = monotonicNanos();
+    int64_t startNanos = dueNanos > nowNanos ? dueNanos : nowNanos;
+    if (startNanos + this->imu->getReadEstimateNanos() > limitNanos) {
+      return;
+    }
+    struct timespec due = nanosToTimespec(dueNanos);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) == EINTR) {
+    }
+    this->imu->sample(monotonicNanos());
+  }
+}
+
+void ServoFrameWriter::writeLoop() {
+  // Same priority as the loop: the loop sleeps while the bus is busy and the other way round
+  ControlLoopConfig config;
+  controlLoopDefaultConfig(&config);
+  config.realtimePriority = this->realtimePriority;
+  controlLoopApplyScheduling(&config);
+
+  bool stopping = false;
+  while (!stopping) {
+    if (this->waitForFrame() < 0) {
+      if (errno != EINTR) {
+        perror("Servo writer wait failed");
+        return;
+      }
+      continue;
+    }
+    // Read after the wait, so a frame published right before stop() is still written
+    stopping = !this->running;
+    this->applyPowerState();
+    if (!this->mailbox.take(&this->writing)) {
+      continue;
+    }
+    int64_t boundaryNanos = 0;
+    if (this->alignToPwm && !stopping) {
+      int64_t slotNanos = this->pwmSchedule.planStart(monotonicNanos(), &boundaryNanos);
+      this->sampleImuUntil(slotNanos);
+      struct timespec slot = nanosToTimespec(slotNanos);
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &slot, NULL) == EINTR) {
+      }
+      // Whatever the loop published while we waited is newer and still makes the boundary
+      this->mailbox.take(&this->writing);
+    }
+    int64_t startNanos = monotonicNanos();
+    this->handoffLatency.record(startNanos - this->writing.publishedNanos);
+    servoDriverWriteFrame(this->writing.ticks);
+    int64_t endNanos = monotonicNanos();
+    this->flushTime.record(endNanos - startNanos);
+    if (boundaryNanos != 0) {
+      this->pwmSchedule.recordFlush(boundaryNanos, endNanos, endNanos - startNanos);
+      if (endNanos <= boundaryNanos) {
+        this->boundaryMargin.record(boundaryNanos - endNanos);
+      }
+    }
+    this->writtenCount.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+uint32_t ServoFrameWriter::getPublishedCount() {
+  return this->publishedCount;
+}
+
+uint32_t ServoFrameWriter::getSupersededCount() {
+  return this->supersededCount;
+}
+
+uint32_t ServoFrameWriter::getWrittenCount() {
+  return this->writtenCount;
+}
+
+LatencyHistogram *ServoFrameWriter::getHandoffLatency() {
+  return &this->handoffLatency;
+}
+
+LatencyHistogram *ServoFrameWriter::getFlushTime() {
+  return &this->flushTime;
+}
+
+LatencyHistogram *ServoFrameWriter::getBoundaryMargin() {
+  return &this->boundaryMargin;
+}
+
+bool ServoFrameWriter::isAlignedToPwm() {
+  return this->alignToPwm;
+}
+
+PwmSchedule *ServoFrameWriter::getPwmSchedule() {
+  return &this->pwmSchedule;
+}
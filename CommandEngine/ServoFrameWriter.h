@@ -0,0 +1,117 @@
+#ifndef _SERVO_FRAME_WRITER_H
+#define _SERVO_FRAME_WRITER_H
+
+#include <atomic>
+#include <semaphore.h>
+#include <stdint.h>
+#include <thread>
+#include "ImuSampler.h"
+#include "Mailbox.h"
+#include "LoopTiming.h"
+#include "PwmSchedule.h"
+#include "ServoDriver.h"
+
+/*!
+ * A complete set of servo ticks as the control loop left it at the end of a tick
+ * */
+struct ServoFrame {
+  uint16_t ticks[SERVO_COUNT];
+  uint32_t sequence;
+  int64_t publishedNanos;
+};
+
+/*!
+ * Moves the I2C flush off the control loop.
+ * The loop publishes a copy of servoPositions once the tick is complete, a dedicated
+ * thread takes the newest published frame from a LatestMailbox and writes it with
+ * servoDriverWriteFrame. The loop never waits for the bus, it computes the next tick
+ * while the previous one is still being written, and as a frame is only handed over
+ * whole the bus can never see a leg with one servo from one tick and one from the next.
+ * When the bus falls behind, frames the writer did not get to are skipped, never queued.
+ * With PWM alignment the writer holds a frame until the last moment that still makes
+ * the next PWM period boundary, then writes the newest frame published by then.
+ * While the writer runs it owns the driver, nothing else may flush or set PWM.
+ * With an ImuSampler attached the writer owns the sensor too and reads it in the gaps
+ * between frames: a frame that is waiting always goes first, and while an aligned frame
+ * waits for its slot only the reads that end before the slot are made.
+ * */
+class ServoFrameWriter {
+private:
+  std::thread writerThread;
+  std::atomic<bool> running;
+  LatestMailbox<ServoFrame> mailbox;
+  sem_t frameReady;
+  ServoFrame publishing, writing;
+  std::atomic<uint32_t> publishedCount, supersededCount, writtenCount;
+  // Only touched by the writer thread, read them after stop()
+  LatencyHistogram handoffLatency, flushTime, boundaryMargin;
+  int realtimePriority;
+  bool alignToPwm;
+  PwmSchedule pwmSchedule;
+  ImuSampler *imu;
+  // Requested by the loop, carried out by the writer thread between frames
+  std::atomic<bool> idleRequested, sleepRequested;
+  bool boardsAsleep;
+  void writeLoop();
+  // Puts the boards to sleep or wakes them as sleepRequested says
+  void applyPowerState();
+  // Waits for a frame, reading the IMU whenever a sample falls due in the meantime
+  int waitForFrame();
+  // Reads the IMU samples that fall due and end before limitNanos
+  void sampleImuUntil(int64_t limitNanos);
+public:
+  ServoFrameWriter();
+  ~ServoFrameWriter();
+  /*!
+   * Times every flush against the PWM period of the boards, call after servoDriverInit
+   * (and setOscillatorFrequency) and before start
+   * @param guardNanos how long before the boundary a flush has to end
+   * */
+  void alignToPwmPeriod(int64_t guardNanos);
+  /*!
+   * Reads imu on the writer thread, call after imu->open and before start
+   * */
+  void attachImu(ImuSampler *imu);
+  /*!
+   * Starts the writer thread.
+   * @param realtimePriority SCHED_FIFO priority of the writer, 0 keeps the default scheduler
+   * */
+  void start(int realtimePriority);
+  /*!
+   * Writes the last published frame if it is still pending and joins the thread
+   * */
+  void stop();
+  /*!
+   * Control loop side, copies ticks and wakes the writer. Never blocks.
+   * */
+  void publish(const uint16_t *ticks, int64_t nowNanos);
+  /*!
+   * Control loop side. While idle the writer stops reading the IMU and only wakes up for
+   * frames, with sleepBoards it also puts the boards to sleep until the loop leaves idle.
+   * Frames published meanwhile are still written, a sleeping board keeps them for its wake up.
+   * */
+  void setIdle(bool idle, bool sleepBoards);
+  uint32_t getPublishedCount();
+  /*!
+   * Frames replaced by a newer one before the writer took them
+   * */
+  uint32_t getSupersededCount();
+  uint32_t getWrittenCount();
+  /*!
+   * Time from publish until the writer started the flush
+   * */
+  LatencyHistogram *getHandoffLatency();
+  /*!
+   * Time servoDriverWriteFrame took
+   * */
+  LatencyHistogram *getFlushTime();
+  /*!
+   * How long before the boundary it aimed for each aligned flush ended, late ones are
+   * not in here, see getPwmSchedule()->getLateCount()
+   * */
+  LatencyHistogram *getBoundaryMargin();
+  bool isAlignedToPwm();
+  PwmSchedule *getPwmSchedule();
+};
+
+#endif
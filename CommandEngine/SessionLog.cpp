@@ -0,0 +1,174 @@
+#include "SessionLog.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(sizeof(SessionLogHeader) <= SESSION_LOG_HEADER_BYTES, "session log header does not fit its page");
+
+SessionLog::SessionLog() {
+  this->header = NULL;
+  this->records = NULL;
+  this->mappedBytes = 0;
+}
+
+SessionLog::~SessionLog() {
+  this->close();
+}
+
+int SessionLog::create(const char *path, uint32_t capacity, int rateHz, int phaseSource, bool keyframeCache,
+                       int gaitPattern, bool footSpace) {
+  this->close();
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    perror("Unable to create session log");
+    return -1;
+  }
+  size_t bytes = SESSION_LOG_HEADER_BYTES + (size_t)capacity * sizeof(SessionRecord);
+  if (ftruncate(fd, bytes) < 0) {
+    perror("Unable to size session log");
+    ::close(fd);
+    return -1;
+  }
+  // Populated up front so the control loop never takes a page fault on a new page
+  void *mapping = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    perror("Unable to map session log");
+    return -1;
+  }
+  this->mappedBytes = bytes;
+  this->header = (SessionLogHeader *)mapping;
+  this->records = (SessionRecord *)((uint8_t *)mapping + SESSION_LOG_HEADER_BYTES);
+
+  memset(this->header, 0, sizeof(SessionLogHeader));
+  memcpy(this->header->magic, SESSION_LOG_MAGIC, sizeof(this->header->magic));
+  this->header->version = SESSION_LOG_VERSION;
+  this->header->recordSize = sizeof(SessionRecord);
+  this->header->capacity = capacity;
+  this->header->servoCount = SERVO_COUNT;
+  this->header->written = 0;
+  this->header->rateHz = rateHz;
+  this->header->phaseSource = phaseSource;
+  this->header->keyframeCache = keyframeCache;
+  this->header->gaitPattern = gaitPattern;
+  this->header->footSpace = footSpace;
+  for (int i = 0; i < SERVO_COUNT; i++) {
+    this->header->calibrations[i] = servoCalibrationGet(i);
+  }
+  return 0;
+}
+
+int SessionLog::openForReplay(const char *path) {
+  this->close();
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    perror("Unable to open session log");
+    return -1;
+  }
+  struct stat status;
+  if (fstat(fd, &status) < 0 || (size_t)status.st_size < SESSION_LOG_HEADER_BYTES) {
+    fprintf(stderr, "%s: not a session log\n", path);
+    ::close(fd);
+    return -1;
+  }
+  void *mapping = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    perror("Unable to map session log");
+    return -1;
+  }
+  this->mappedBytes = status.st_size;
+  this->header = (SessionLogHeader *)mapping;
+  this->records = (SessionRecord *)((uint8_t *)mapping + SESSION_LOG_HEADER_BYTES);
+
+  if (memcmp(this->header->magic, SESSION_LOG_MAGIC, sizeof(this->header->magic)) != 0 ||
+      this->header->version != SESSION_LOG_VERSION || this->header->recordSize != sizeof(SessionRecord) ||
+      this->header->servoCount != SERVO_COUNT ||
+      SESSION_LOG_HEADER_BYTES + (size_t)this->header->capacity * sizeof(SessionRecord) > this->mappedBytes) {
+    fprintf(stderr, "%s: not a session log of this build\n", path);
+    this->close();
+    return -1;
+  }
+  return 0;
+}
+
+void SessionLog::close() {
+  if (this->header != NULL) {
+    munmap(this->header, this->mappedBytes);
+    this->header = NULL;
+    this->records = NULL;
+    this->mappedBytes = 0;
+  }
+}
+
+bool SessionLog::isOpen() {
+  return this->header != NULL;
+}
+
+void SessionLog::append(int64_t tickNanos, float deltaTime, const CommandFrame *command, const Attitude *attitude,
+                        bool written) {
+  uint64_t index = this->header->written;
+  SessionRecord *record = &this->records[index % this->header->capacity];
+  record->tickNanos = tickNanos;
+  record->deltaTime = deltaTime;
+  record->flags = (command != NULL ? SESSION_RECORD_COMMAND : 0) | (attitude != NULL ? SESSION_RECORD_ATTITUDE : 0) |
+                  (written ? SESSION_RECORD_WRITTEN : 0);
+  if (command != NULL) {
+    record->version = command->version;
+    record->keys = command->bytes[0];
+    record->events = command->bytes[1];
+    record->sequence = command->sequence;
+    record->senderMicros = command->senderMicros;
+    record->velocity = command->velocity;
+    record->turn = command->turn;
+    record->strideLength = command->strideLength;
+    record->strideHeight = command->strideHeight;
+  } else {
+    record->version = 0;
+    record->keys = record->events = 0;
+    record->sequence = 0;
+    record->senderMicros = 0;
+    record->velocity = record->turn = 0;
+    record->strideLength = record->strideHeight = 0;
+  }
+  record->pitch = attitude != NULL ? attitude->pitch : 0;
+  record->roll = attitude != NULL ? attitude->roll : 0;
+  memcpy(record->servoTicks, servoPositions, sizeof(record->servoTicks));
+  // Count the record only once it is complete, a crash mid record leaves it out
+  __atomic_store_n(&this->header->written, index + 1, __ATOMIC_RELEASE);
+}
+
+const SessionLogHeader *SessionLog::getHeader() {
+  return this->header;
+}
+
+uint64_t SessionLog::getRecordCount() {
+  uint64_t written = this->header->written;
+  return written < this->header->capacity ? written : this->header->capacity;
+}
+
+bool SessionLog::hasWrapped() {
+  return this->header->written > this->header->capacity;
+}
+
+const SessionRecord *SessionLog::getRecord(uint64_t index) {
+  uint64_t first = this->header->written - this->getRecordCount();
+  return &this->records[(first + index) % this->header->capacity];
+}
+
+void sessionRecordToFrame(const SessionRecord *record, CommandFrame *frame) {
+  memset(frame, 0, sizeof(*frame));
+  frame->bytes[0] = record->keys;
+  frame->bytes[1] = record->events;
+  frame->version = record->version;
+  frame->sequence = record->sequence;
+  frame->senderMicros = record->senderMicros;
+  frame->velocity = record->velocity;
+  frame->turn = record->turn;
+  frame->strideLength = record->strideLength;
+  frame->strideHeight = record->strideHeight;
+  frame->receivedNanos = record->tickNanos;
+}
@@ -0,0 +1,103 @@
+#ifndef _SESSION_LOG_H
+#define _SESSION_LOG_H
+
+#include <stdint.h>
+#include "CommandReceiver.h"
+#include "AttitudeFilter.h"
+#include "ServoCalibration.h"
+#include "ServoDriver.h"
+
+#define SESSION_LOG_MAGIC "PBLSLOG"
+#define SESSION_LOG_VERSION 2
+// Records start on the first page after the header
+#define SESSION_LOG_HEADER_BYTES 4096
+// One hour at 100 Hz
+#define SESSION_LOG_DEFAULT_CAPACITY 360000
+
+#define SESSION_RECORD_COMMAND 0x01
+#define SESSION_RECORD_WRITTEN 0x02
+#define SESSION_RECORD_ATTITUDE 0x04
+
+/*!
+ * Everything needed to start a replay in the same state the recording started in
+ * */
+struct SessionLogHeader {
+  char magic[8];
+  uint32_t version, recordSize, capacity, servoCount;
+  // Records appended so far, the newest is at (written - 1) % capacity
+  volatile uint64_t written;
+  int32_t rateHz, phaseSource, keyframeCache, gaitPattern;
+  ServoCalibration calibrations[SERVO_COUNT];
+  int32_t footSpace;
+};
+
+/*!
+ * One control loop tick: the command that was applied (if any), the IMU attitude it
+ * used (if any), the tick time and the servo frame it produced.
+ * */
+struct SessionRecord {
+  int64_t tickNanos;
+  float deltaTime;
+  uint8_t flags, version, keys, events;
+  uint32_t sequence;
+  uint64_t senderMicros;
+  float velocity, turn;
+  uint8_t strideLength, strideHeight;
+  float pitch, roll;
+  uint16_t servoTicks[SERVO_COUNT];
+};
+
+/*!
+ * Ring of fixed size SessionRecords in a memory mapped file. The file is sized and
+ * faulted in when it is opened, appending is a copy into the mapping and never a
+ * system call, and the kernel writes the pages back even if the engine crashes.
+ * */
+class SessionLog {
+private:
+  SessionLogHeader *header;
+  SessionRecord *records;
+  size_t mappedBytes;
+public:
+  SessionLog();
+  ~SessionLog();
+  /*!
+   * Creates (or truncates) a log for recording
+   * @return 0 on success, -1 on error
+   * */
+  int create(const char *path, uint32_t capacity, int rateHz, int phaseSource, bool keyframeCache, int gaitPattern,
+             bool footSpace);
+  /*!
+   * Maps an existing log read only
+   * @return 0 on success, -1 if it is missing or was written by an incompatible build
+   * */
+  int openForReplay(const char *path);
+  void close();
+  bool isOpen();
+  /*!
+   * Appends one tick, taking the servo frame from servoPositions
+   * @param command the command applied in this tick, NULL if none
+   * @param attitude the attitude the tick used, NULL without an IMU
+   * */
+  void append(int64_t tickNanos, float deltaTime, const CommandFrame *command, const Attitude *attitude, bool written);
+  const SessionLogHeader *getHeader();
+  /*!
+   * Number of records still in the ring
+   * */
+  uint64_t getRecordCount();
+  /*!
+   * True once the oldest records have been overwritten, the log then no longer starts
+   * in the recorded initial state
+   * */
+  bool hasWrapped();
+  /*!
+   * @param index 0 is the oldest record still in the ring
+   * */
+  const SessionRecord *getRecord(uint64_t index);
+};
+
+/*!
+ * The command stored in a record, as it was handed to commandInterpreter
+ * */
+void sessionRecordToFrame(const SessionRecord *record, CommandFrame *frame);
+
+#endif
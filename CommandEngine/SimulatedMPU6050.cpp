@@ -0,0 +1,136 @@
+#include "SimulatedMPU6050.h"
+#include "ControlLoop.h"
+#include "ImuSampler.h"
+#include "SimulatedPCA9685.h"
+#include <cmath>
+#include <string.h>
+
+SimulatedMPU6050 simulatedImu;
+
+SimulatedMPU6050::SimulatedMPU6050() {
+  this->address = MPU6050_I2C_ADDRESS;
+  this->opened = false;
+  this->setMotion(SIMULATED_MPU6050_PITCH_DEGREES, SIMULATED_MPU6050_ROLL_DEGREES, SIMULATED_MPU6050_PERIOD_SECONDS,
+                  SIMULATED_MPU6050_GYRO_BIAS_DPS);
+  this->powerOnReset();
+}
+
+/*!
+ *  @brief  Register values after power up, see the MPU-6000/6050 register map
+ */
+void SimulatedMPU6050::powerOnReset() {
+  memset(this->registers, 0, sizeof(this->registers));
+  this->registers[MPU6050_PWR_MGMT_1] = PWR_MGMT_1_SLEEP;
+  this->registers[MPU6050_WHO_AM_I] = MPU6050_WHO_AM_I_VALUE;
+  this->wakeNanos = 0;
+}
+
+void SimulatedMPU6050::setMotion(float pitchDegrees, float rollDegrees, float periodSeconds, float gyroBiasDps) {
+  this->pitchAmplitude = pitchDegrees * (float)(M_PI / 180);
+  this->rollAmplitude = rollDegrees * (float)(M_PI / 180);
+  this->periodSeconds = periodSeconds;
+  this->gyroBiasDps = gyroBiasDps;
+}
+
+void SimulatedMPU6050::getAttitude(int64_t nowNanos, float *pitch, float *roll) {
+  double seconds = (double)(nowNanos - this->wakeNanos - SIMULATED_MPU6050_STILL_NANOS) / NANOS_PER_SECOND;
+  if (this->wakeNanos == 0 || seconds < 0) {
+    seconds = 0;
+  }
+  double omega = 2 * M_PI / this->periodSeconds;
+  *pitch = this->pitchAmplitude * sin(omega * seconds);
+  *roll = this->rollAmplitude * sin(omega / 0.7 * seconds);
+}
+
+void SimulatedMPU6050::measure(int64_t nowNanos) {
+  float pitch, roll;
+  this->getAttitude(nowNanos, &pitch, &roll);
+  double seconds = (double)(nowNanos - this->wakeNanos - SIMULATED_MPU6050_STILL_NANOS) / NANOS_PER_SECOND;
+  double omega = 2 * M_PI / this->periodSeconds;
+  // Rates are the derivatives of the rocking, zero while the body is still held
+  float pitchRate = 0, rollRate = 0;
+  if (seconds > 0) {
+    pitchRate = this->pitchAmplitude * omega * cos(omega * seconds);
+    rollRate = this->rollAmplitude * (omega / 0.7) * cos(omega / 0.7 * seconds);
+  }
+  // What the accelerometer reads of gravity in the body frame, in g
+  float accel[3] = {-sinf(pitch), cosf(pitch) * sinf(roll), cosf(pitch) * cosf(roll)};
+  float degreesPerRadian = 180 / M_PI;
+  float gyro[3] = {rollRate * degreesPerRadian, pitchRate * degreesPerRadian, 0};
+  float accelLsbPerG = 16384.0f / (1 << ((this->registers[MPU6050_ACCEL_CONFIG] >> 3) & 0x03));
+  float gyroLsbPerDps = 131.0f / (1 << ((this->registers[MPU6050_GYRO_CONFIG] >> 3) & 0x03));
+  uint8_t *out = &this->registers[MPU6050_ACCEL_XOUT_H];
+  for (int axis = 0; axis < 3; axis++) {
+    int16_t value = (int16_t)lrintf(accel[axis] * accelLsbPerG);
+    out[2 * axis] = (uint16_t)value >> 8;
+    out[2 * axis + 1] = value & 0xFF;
+    value = (int16_t)lrintf((gyro[axis] + this->gyroBiasDps) * gyroLsbPerDps);
+    out[8 + 2 * axis] = (uint16_t)value >> 8;
+    out[8 + 2 * axis + 1] = value & 0xFF;
+  }
+}
+
+int SimulatedMPU6050::open(unsigned int bus, uint8_t address) {
+  this->address = address;
+  this->opened = true;
+  return 0;
+}
+
+void SimulatedMPU6050::close() {
+  this->opened = false;
+}
+
+void SimulatedMPU6050::writeRegister(uint8_t reg, uint8_t value) {
+  if (reg >= MPU6050_REGISTER_COUNT || reg == MPU6050_WHO_AM_I) {
+    return;
+  }
+  if (reg == MPU6050_PWR_MGMT_1) {
+    if (value & PWR_MGMT_1_DEVICE_RESET) {
+      this->powerOnReset();
+      return;
+    }
+    if ((this->registers[reg] & PWR_MGMT_1_SLEEP) && !(value & PWR_MGMT_1_SLEEP)) {
+      this->wakeNanos = monotonicNanos();
+    }
+  }
+  this->registers[reg] = value;
+}
+
+int SimulatedMPU6050::writeDevice(const uint8_t *data, unsigned int length) {
+  if (!this->opened || length == 0) {
+    return -1;
+  }
+  simulatedI2CBus.charge(length + 1, 1);
+  // Register pointer, then consecutive registers
+  for (unsigned int i = 1; i < length; i++) {
+    this->writeRegister(data[0] + i - 1, data[i]);
+  }
+  return 0;
+}
+
+int SimulatedMPU6050::writeByteData(uint8_t reg, uint8_t value) {
+  uint8_t data[2] = {reg, value};
+  return this->writeDevice(data, 2);
+}
+
+int SimulatedMPU6050::readByteData(uint8_t reg) {
+  uint8_t value;
+  if (this->readBlockData(reg, &value, 1) < 0) {
+    return -1;
+  }
+  return value;
+}
+
+int SimulatedMPU6050::readBlockData(uint8_t reg, uint8_t *data, unsigned int length) {
+  if (!this->opened || reg + length > MPU6050_REGISTER_COUNT) {
+    return -1;
+  }
+  // Address + register, repeated start, address + data
+  simulatedI2CBus.charge(2 + 1 + length, 2);
+  if ((this->registers[MPU6050_PWR_MGMT_1] & PWR_MGMT_1_SLEEP) == 0 && reg <= MPU6050_GYRO_ZOUT_L &&
+      reg + length > MPU6050_ACCEL_XOUT_H) {
+    this->measure(monotonicNanos());
+  }
+  memcpy(data, &this->registers[reg], length);
+  return length;
+}
@@ -0,0 +1,59 @@
+#ifndef _SIMULATED_MPU6050_H
+#define _SIMULATED_MPU6050_H
+
+#include "I2CTransport.h"
+#include <stdint.h>
+
+#define MPU6050_REGISTER_COUNT 128
+#define MPU6050_GYRO_ZOUT_L 0x48
+// The body holds still this long after the sensor woke up, for the bias measurement
+#define SIMULATED_MPU6050_STILL_NANOS 500000000LL
+// Default motion: rocking in pitch and roll, a slope the gait should follow
+#define SIMULATED_MPU6050_PITCH_DEGREES 10.0f
+#define SIMULATED_MPU6050_ROLL_DEGREES 5.0f
+#define SIMULATED_MPU6050_PERIOD_SECONDS 8.0f
+// Degrees per second on every axis, what the bias measurement has to take out
+#define SIMULATED_MPU6050_GYRO_BIAS_DPS 1.5f
+
+/*!
+ * In process model of an MPU-6050 on the simulated I2C bus.
+ * Models the registers ImuSampler touches: PWR_MGMT_1 with its reset and sleep bits,
+ * WHO_AM_I, the full scale settings of GYRO_CONFIG / ACCEL_CONFIG and the measurement
+ * registers, which are filled at the time of every read from a body rocking in pitch
+ * (period P) and roll (period 0.7 P) plus a constant gyro bias. Transactions are charged
+ * to simulatedI2CBus like the PCA9685's.
+ * Axes: x forward, y left, z up. Pitch is nose up, roll is right side down.
+ * */
+class SimulatedMPU6050 : public I2CTransport {
+private:
+  uint8_t registers[MPU6050_REGISTER_COUNT];
+  uint8_t address;
+  bool opened;
+  int64_t wakeNanos;
+  float pitchAmplitude, rollAmplitude, periodSeconds, gyroBiasDps;
+  void powerOnReset();
+  void writeRegister(uint8_t reg, uint8_t value);
+  // Fills the measurement registers for the body at nowNanos
+  void measure(int64_t nowNanos);
+public:
+  SimulatedMPU6050();
+  int open(unsigned int bus, uint8_t address);
+  void close();
+  int writeDevice(const uint8_t *data, unsigned int length);
+  int writeByteData(uint8_t reg, uint8_t value);
+  int readByteData(uint8_t reg);
+  int readBlockData(uint8_t reg, uint8_t *data, unsigned int length);
+  /*!
+   * @param pitchDegrees amplitude of the pitch rocking
+   * @param rollDegrees amplitude of the roll rocking
+   * */
+  void setMotion(float pitchDegrees, float rollDegrees, float periodSeconds, float gyroBiasDps);
+  /*!
+   * The attitude the body had at nowNanos, radians
+   * */
+  void getAttitude(int64_t nowNanos, float *pitch, float *roll);
+};
+
+extern SimulatedMPU6050 simulatedImu;
+
+#endif
@@ -0,0 +1,262 @@
+#include "SimulatedPCA9685.h"
+#include "ControlLoop.h"
+#include "ServoDriver.h"
+#include <string.h>
+
+SimulatedI2CBus simulatedI2CBus;
+
+SimulatedI2CBus::SimulatedI2CBus() {
+  this->setTiming(SIMULATED_I2C_CLOCK_HZ, false);
+  this->resetStats();
+}
+
+void SimulatedI2CBus::setTiming(uint32_t clockHz, bool emulate) {
+  int64_t bitNanos = NANOS_PER_SECOND / clockHz;
+  this->nanosPerByte = SIMULATED_I2C_BITS_PER_BYTE * bitNanos;
+  this->nanosPerTransaction = SIMULATED_I2C_FRAMING_BITS * bitNanos;
+  this->emulateBusTime = emulate;
+}
+
+void SimulatedI2CBus::charge(unsigned int bytes, unsigned int segments) {
+  int64_t cost = segments * this->nanosPerTransaction + bytes * this->nanosPerByte;
+  this->busNanos += cost;
+  this->bytesTransferred += bytes;
+  this->transactions++;
+  if (this->emulateBusTime) {
+    int64_t until = monotonicNanos() + cost;
+    while (monotonicNanos() < until) {
+    }
+  }
+}
+
+uint64_t SimulatedI2CBus::getBusNanos() {
+  return this->busNanos;
+}
+
+uint64_t SimulatedI2CBus::getBytesTransferred() {
+  return this->bytesTransferred;
+}
+
+uint32_t SimulatedI2CBus::getTransactions() {
+  return this->transactions;
+}
+
+void SimulatedI2CBus::resetStats() {
+  this->busNanos = 0;
+  this->bytesTransferred = 0;
+  this->transactions = 0;
+}
+
+SimulatedPCA9685::SimulatedPCA9685() {
+  this->address = PCA9685_I2C_ADDRESS;
+  this->opened = false;
+  this->powerOnReset();
+}
+
+/*!
+ *  @brief  Register values after power up, see the PCA9685 datasheet register table
+ */
+void SimulatedPCA9685::powerOnReset() {
+  memset(this->registers, 0, sizeof(this->registers));
+  this->registers[PCA9685_MODE1] = MODE1_SLEEP | MODE1_ALLCAL;
+  this->registers[PCA9685_MODE2] = MODE2_OUTDRV;
+  this->registers[PCA9685_SUBADR1] = 0xE2;
+  this->registers[PCA9685_SUBADR2] = 0xE4;
+  this->registers[PCA9685_SUBADR3] = 0xE8;
+  this->registers[PCA9685_ALLCALLADR] = 0xE0;
+  for (int channel = 0; channel < PCA9685_CHANNEL_COUNT; channel++) {
+    // Full off
+    this->registers[PCA9685_LED0_OFF_H + 4 * channel] = 0x10;
+  }
+  this->registers[PCA9685_PRESCALE] = 0x1E;
+  this->registerPointer = PCA9685_MODE1;
+}
+
+int SimulatedPCA9685::open(unsigned int bus, uint8_t address) {
+  this->address = address;
+  this->opened = true;
+  return 0;
+}
+
+void SimulatedPCA9685::close() {
+  this->opened = false;
+}
+
+void SimulatedPCA9685::setBusTiming(uint32_t clockHz, bool emulate) {
+  simulatedI2CBus.setTiming(clockHz, emulate);
+}
+
+void SimulatedPCA9685::advancePointer() {
+  if ((this->registers[PCA9685_MODE1] & MODE1_AI) == 0) {
+    return;
+  }
+  if (this->registerPointer == PCA9685_LED15_OFF_H) {
+    this->registerPointer = PCA9685_MODE1;
+  } else {
+    this->registerPointer++;
+  }
+}
+
+void SimulatedPCA9685::writeRegister(uint8_t reg, uint8_t value) {
+  if (reg == PCA9685_MODE1) {
+    // Writing 1 to RESTART restarts the PWM channels and clears the bit
+    this->registers[reg] = value & ~MODE1_RESTART;
+  } else if (reg == PCA9685_PRESCALE) {
+    // Writes are blocked while the oscillator is running
+    if (this->registers[PCA9685_MODE1] & MODE1_SLEEP) {
+      this->registers[reg] = value < PCA9685_PRESCALE_MIN ? PCA9685_PRESCALE_MIN : value;
+    }
+  } else if (reg >= PCA9685_ALLLED_ON_L && reg <= PCA9685_ALLLED_OFF_H) {
+    for (int channel = 0; channel < PCA9685_CHANNEL_COUNT; channel++) {
+      this->registers[PCA9685_LED0_ON_L + 4 * channel + (reg - PCA9685_ALLLED_ON_L)] = value;
+    }
+  } else if (reg <= PCA9685_LED15_OFF_H) {
+    this->registers[reg] = value;
+  }
+  // Reserved registers and TESTMODE are ignored
+}
+
+uint8_t SimulatedPCA9685::readRegister(uint8_t reg) {
+  // ALL_LED registers are write only
+  if (reg >= PCA9685_ALLLED_ON_L && reg <= PCA9685_ALLLED_OFF_H) {
+    return 0;
+  }
+  return this->registers[reg];
+}
+
+void SimulatedPCA9685::applyWrite(const uint8_t *data, unsigned int length) {
+  this->registerPointer = data[0];
+  for (unsigned int i = 1; i < length; i++) {
+    this->writeRegister(this->registerPointer, data[i]);
+    this->advancePointer();
+  }
+}
+
+int SimulatedPCA9685::writeDevice(const uint8_t *data, unsigned int length) {
+  if (!this->opened || length == 0) {
+    return -1;
+  }
+  // Address byte + payload
+  simulatedI2CBus.charge(length + 1, 1);
+  this->applyWrite(data, length);
+  return 0;
+}
+
+bool SimulatedPCA9685::receiveAllCall(uint8_t allCallAddress, const uint8_t *data, unsigned int length) {
+  // ALLCALLADR holds the 7 bit address in its upper bits
+  if (!this->opened || length == 0 || (this->registers[PCA9685_MODE1] & MODE1_ALLCAL) == 0 ||
+      (this->registers[PCA9685_ALLCALLADR] >> 1) != allCallAddress) {
+    return false;
+  }
+  this->applyWrite(data, length);
+  return true;
+}
+
+int SimulatedPCA9685::writeByteData(uint8_t reg, uint8_t value) {
+  uint8_t data[2] = {reg, value};
+  return this->writeDevice(data, 2);
+}
+
+int SimulatedPCA9685::readByteData(uint8_t reg) {
+  uint8_t value;
+  if (this->readBlockData(reg, &value, 1) < 0) {
+    return -1;
+  }
+  return value;
+}
+
+int SimulatedPCA9685::readBlockData(uint8_t reg, uint8_t *data, unsigned int length) {
+  if (!this->opened) {
+    return -1;
+  }
+  // Address + register, repeated start, address + data
+  simulatedI2CBus.charge(2 + 1 + length, 2);
+  this->registerPointer = reg;
+  for (unsigned int i = 0; i < length; i++) {
+    data[i] = this->readRegister(this->registerPointer);
+    this->advancePointer();
+  }
+  return length;
+}
+
+uint8_t SimulatedPCA9685::getRegister(uint8_t reg) {
+  return this->registers[reg];
+}
+
+uint16_t SimulatedPCA9685::getChannelOn(uint8_t channel) {
+  uint8_t base = PCA9685_LED0_ON_L + 4 * channel;
+  return this->registers[base] | (this->registers[base + 1] << 8);
+}
+
+uint16_t SimulatedPCA9685::getChannelOff(uint8_t channel) {
+  uint8_t base = PCA9685_LED0_OFF_L + 4 * channel;
+  return this->registers[base] | (this->registers[base + 1] << 8);
+}
+
+bool SimulatedPCA9685::isSleeping() {
+  return (this->registers[PCA9685_MODE1] & MODE1_SLEEP) != 0;
+}
+
+uint64_t SimulatedPCA9685::getBusNanos() {
+  return simulatedI2CBus.getBusNanos();
+}
+
+uint64_t SimulatedPCA9685::getBytesTransferred() {
+  return simulatedI2CBus.getBytesTransferred();
+}
+
+uint32_t SimulatedPCA9685::getTransactions() {
+  return simulatedI2CBus.getTransactions();
+}
+
+void SimulatedPCA9685::resetStats() {
+  simulatedI2CBus.resetStats();
+}
+
+SimulatedAllCall::SimulatedAllCall() {
+  this->devices = NULL;
+  this->deviceCount = 0;
+  this->address = PCA9685_ALLCALL_ADDRESS;
+  this->opened = false;
+}
+
+void SimulatedAllCall::attach(SimulatedPCA9685 *devices, int deviceCount) {
+  this->devices = devices;
+  this->deviceCount = deviceCount;
+}
+
+int SimulatedAllCall::open(unsigned int bus, uint8_t address) {
+  this->address = address;
+  this->opened = true;
+  return 0;
+}
+
+void SimulatedAllCall::close() {
+  this->opened = false;
+}
+
+int SimulatedAllCall::writeDevice(const uint8_t *data, unsigned int length) {
+  if (!this->opened || length == 0) {
+    return -1;
+  }
+  simulatedI2CBus.charge(length + 1, 1);
+  bool acknowledged = false;
+  for (int i = 0; i < this->deviceCount; i++) {
+    acknowledged |= this->devices[i].receiveAllCall(this->address, data, length);
+  }
+  // Nobody answering is a NACK on the address byte
+  return acknowledged ? 0 : -1;
+}
+
+int SimulatedAllCall::writeByteData(uint8_t reg, uint8_t value) {
+  uint8_t data[2] = {reg, value};
+  return this->writeDevice(data, 2);
+}
+
+int SimulatedAllCall::readByteData(uint8_t reg) {
+  return -1;
+}
+
+int SimulatedAllCall::readBlockData(uint8_t reg, uint8_t *data, unsigned int length) {
+  return -1;
+}
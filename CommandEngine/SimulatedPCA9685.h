@@ -0,0 +1,115 @@
+#ifndef _SIMULATED_PCA9685_H
+#define _SIMULATED_PCA9685_H
+
+#include "I2CTransport.h"
+#include "ServoDriver.h"
+#include <stdint.h>
+
+#define SIMULATED_I2C_CLOCK_HZ 100000
+// 8 data bits + ACK
+#define SIMULATED_I2C_BITS_PER_BYTE 9
+// Start, stop and bus free time around every transaction, in bit times
+#define SIMULATED_I2C_FRAMING_BITS 3
+
+#define PCA9685_REGISTER_COUNT 256
+#define PCA9685_LED15_OFF_H 0x45
+
+/*!
+ * Time and traffic of one simulated I2C bus. Every device on the bus charges its
+ * transactions here, so the totals are the bus utilization however many boards there are.
+ * */
+class SimulatedI2CBus {
+private:
+  bool emulateBusTime;
+  int64_t nanosPerByte, nanosPerTransaction;
+  uint64_t busNanos, bytesTransferred;
+  uint32_t transactions;
+public:
+  SimulatedI2CBus();
+  /*!
+   * @param clockHz bus clock, 100000 for standard mode, 400000 for fast mode
+   * @param emulate busy wait for the charged time on every transaction
+   * */
+  void setTiming(uint32_t clockHz, bool emulate);
+  void charge(unsigned int bytes, unsigned int segments);
+  uint64_t getBusNanos();
+  uint64_t getBytesTransferred();
+  uint32_t getTransactions();
+  void resetStats();
+};
+
+extern SimulatedI2CBus simulatedI2CBus;
+
+/*!
+ * In process model of a PCA9685 behind an I2C bus.
+ * Models the MODE1/MODE2/PRESCALE/LEDn/ALL_LED registers with their power on values,
+ * MODE1 auto-increment (LED15_OFF_H rolls over to MODE1), PRESCALE only being writable
+ * while asleep, the RESTART bit clearing itself and answering the LED All Call address
+ * while MODE1 ALLCALL is set.
+ * Every transaction is charged to simulatedI2CBus the time it would occupy the bus at the
+ * configured clock, which is accumulated and can optionally be spent busy waiting so loop
+ * timings match the real hardware.
+ * */
+class SimulatedPCA9685 : public I2CTransport {
+private:
+  uint8_t registers[PCA9685_REGISTER_COUNT];
+  uint8_t registerPointer;
+  uint8_t address;
+  bool opened;
+  void powerOnReset();
+  void writeRegister(uint8_t reg, uint8_t value);
+  uint8_t readRegister(uint8_t reg);
+  void advancePointer();
+  void applyWrite(const uint8_t *data, unsigned int length);
+public:
+  SimulatedPCA9685();
+  int open(unsigned int bus, uint8_t address);
+  void close();
+  int writeDevice(const uint8_t *data, unsigned int length);
+  int writeByteData(uint8_t reg, uint8_t value);
+  int readByteData(uint8_t reg);
+  int readBlockData(uint8_t reg, uint8_t *data, unsigned int length);
+  /*!
+   * A write to a general address, already charged to the bus by the sender. Applied
+   * only if this device is configured to answer that address.
+   * @return true if the device took the write
+   * */
+  bool receiveAllCall(uint8_t allCallAddress, const uint8_t *data, unsigned int length);
+
+  /*!
+   * Sets the timing of the bus this device is on, see SimulatedI2CBus::setTiming
+   * */
+  void setBusTiming(uint32_t clockHz, bool emulate);
+  uint8_t getRegister(uint8_t reg);
+  uint16_t getChannelOn(uint8_t channel);
+  uint16_t getChannelOff(uint8_t channel);
+  bool isSleeping();
+  uint64_t getBusNanos();
+  uint64_t getBytesTransferred();
+  uint32_t getTransactions();
+  void resetStats();
+};
+
+/*!
+ * The LED All Call address on the simulated bus: one write, charged once, taken by
+ * every attached device that answers the address. Reads are not possible, several
+ * devices would drive the bus at once.
+ * */
+class SimulatedAllCall : public I2CTransport {
+private:
+  SimulatedPCA9685 *devices;
+  int deviceCount;
+  uint8_t address;
+  bool opened;
+public:
+  SimulatedAllCall();
+  void attach(SimulatedPCA9685 *devices, int deviceCount);
+  int open(unsigned int bus, uint8_t address);
+  void close();
+  int writeDevice(const uint8_t *data, unsigned int length);
+  int writeByteData(uint8_t reg, uint8_t value);
+  int readByteData(uint8_t reg);
+  int readBlockData(uint8_t reg, uint8_t *data, unsigned int length);
+};
+
+#endif
@@ -0,0 +1,131 @@
+#include "Telemetry.h"
+#include "ControlLoop.h"
+#include <sys/socket.h>
+
+static uint8_t *writeLittle16(uint8_t *out, uint16_t value) {
+  out[0] = value & 0xFF;
+  out[1] = value >> 8;
+  return out + 2;
+}
+
+static uint8_t *writeLittle32(uint8_t *out, uint32_t value) {
+  writeLittle16(out, value & 0xFFFF);
+  return writeLittle16(out + 2, value >> 16);
+}
+
+static uint8_t *writeLittle64(uint8_t *out, uint64_t value) {
+  writeLittle32(out, value & 0xFFFFFFFF);
+  return writeLittle32(out + 4, value >> 32);
+}
+
+static int16_t toFixed16(float value, float scale) {
+  float scaled = value * scale;
+  if (scaled > 32767)
+    return 32767;
+  if (scaled < -32767)
+    return -32767;
+  return (int16_t)(scaled < 0 ? scaled - 0.5f : scaled + 0.5f);
+}
+
+static uint16_t nanosToMicros16(int64_t nanos) {
+  int64_t micros = nanos / 1000;
+  return micros > 0xFFFF ? 0xFFFF : (uint16_t)micros;
+}
+
+TelemetrySender::TelemetrySender() {
+  this->socketFileDescriptor = -1;
+  this->periodNanos = 0;
+  this->nextSendNanos = 0;
+  this->sequence = 0;
+  this->sentCount = 0;
+  this->failedCount = 0;
+  this->gait = NULL;
+  this->timing = NULL;
+  this->receiver = NULL;
+}
+
+void TelemetrySender::start(int socketFileDescriptor, int rateHz, GaitControl *gait, LoopTiming *timing,
+                            CommandReceiver *receiver) {
+  if (rateHz > TELEMETRY_MAX_RATE_HZ)
+    rateHz = TELEMETRY_MAX_RATE_HZ;
+  this->socketFileDescriptor = socketFileDescriptor;
+  this->periodNanos = rateHz > 0 ? NANOS_PER_SECOND / rateHz : 0;
+  this->gait = gait;
+  this->timing = timing;
+  this->receiver = receiver;
+}
+
+int TelemetrySender::build(int64_t nowNanos, const CommandFrame *lastCommand) {
+  uint8_t *out = this->buffer;
+  uint8_t flags = 0;
+  if (this->gait->getPhaseSource() == PHASE_SOURCE_CPG)
+    flags |= TELEMETRY_FLAG_CPG;
+  if (this->gait->getKeyframeCache())
+    flags |= TELEMETRY_FLAG_KEYFRAMES;
+  if (this->gait->isTransitioning())
+    flags |= TELEMETRY_FLAG_TRANSITIONING;
+
+  *out++ = TELEMETRY_MAGIC;
+  *out++ = TELEMETRY_VERSION;
+  *out++ = this->gait->getGaitState();
+  *out++ = flags;
+  out = writeLittle32(out, this->sequence);
+  out = writeLittle64(out, nowNanos / 1000);
+  out = writeLittle32(out, lastCommand->sequence);
+  out = writeLittle64(out, lastCommand->senderMicros);
+  out = writeLittle32(out, (uint32_t)((monotonicNanos() - lastCommand->receivedNanos) / 1000));
+
+  for (int i = 0; i < SERVO_COUNT; i++) {
+    out = writeLittle16(out, servoPositions[i]);
+  }
+  for (int i = 0; i < LEG_COUNT; i++) {
+    out = writeLittle16(out, this->gait->getLegPhase(i) >> 16);
+  }
+  for (int i = 0; i < LEG_COUNT; i++) {
+    out = writeLittle16(out, toFixed16(this->gait->getCurrentStrideLength(i), 100));
+  }
+  for (int i = 0; i < LEG_COUNT; i++) {
+    out = writeLittle16(out, toFixed16(this->gait->getCurrentStrideHeight(i), 100));
+  }
+  out = writeLittle16(out, toFixed16(this->gait->getIncline(), 1000));
+
+  LatencyHistogram *tick = this->timing->getPhase(TIMING_PHASE_TICK);
+  out = writeLittle16(out, nanosToMicros16(tick->getPercentile(0.5)));
+  out = writeLittle16(out, nanosToMicros16(tick->getPercentile(0.99)));
+  out = writeLittle16(out, nanosToMicros16(tick->getMax()));
+  out = writeLittle32(out, this->timing->getDeadlineMisses());
+  out = writeLittle32(out, this->receiver->getReceivedCount());
+  out = writeLittle32(out, this->receiver->getOutOfOrderCount() + this->receiver->getStaleCount());
+  out = writeLittle32(out, this->receiver->getLostCount());
+  return out - this->buffer;
+}
+
+bool TelemetrySender::update(int64_t nowNanos, const CommandFrame *lastCommand) {
+  if (this->periodNanos == 0 || this->socketFileDescriptor < 0 || lastCommand->sender.sin_port == 0 ||
+      nowNanos < this->nextSendNanos) {
+    return false;
+  }
+  // Keep the rate without bursting after a stall
+  this->nextSendNanos += this->periodNanos;
+  if (this->nextSendNanos < nowNanos) {
+    this->nextSendNanos = nowNanos + this->periodNanos;
+  }
+
+  int length = this->build(nowNanos, lastCommand);
+  this->sequence++;
+  if (sendto(this->socketFileDescriptor, this->buffer, length, MSG_DONTWAIT, (const struct sockaddr *)&lastCommand->sender,
+             sizeof(lastCommand->sender)) != length) {
+    this->failedCount++;
+    return false;
+  }
+  this->sentCount++;
+  return true;
+}
+
+uint32_t TelemetrySender::getSentCount() {
+  return this->sentCount;
+}
+
+uint32_t TelemetrySender::getFailedCount() {
+  return this->failedCount;
+}
@@ -0,0 +1,78 @@
+#ifndef _TELEMETRY_H
+#define _TELEMETRY_H
+
+#include <netinet/in.h>
+#include <stdint.h>
+#include "CommandReceiver.h"
+#include "LoopTiming.h"
+#include "ServoDriver.h"
+#include "gait.h"
+
+#define TELEMETRY_MAGIC 0x54
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_DEFAULT_RATE_HZ 20
+#define TELEMETRY_MAX_RATE_HZ 200
+
+#define TELEMETRY_FLAG_CPG 0x01
+#define TELEMETRY_FLAG_KEYFRAMES 0x02
+#define TELEMETRY_FLAG_TRANSITIONING 0x04
+
+/*
+ * Telemetry datagram, multi byte fields little endian:
+ *   0  uint8   magic, TELEMETRY_MAGIC
+ *   1  uint8   version, TELEMETRY_VERSION
+ *   2  uint8   gait state, GAIT_STATE_*
+ *   3  uint8   flags, TELEMETRY_FLAG_*
+ *   4  uint32  telemetry sequence number
+ *   8  uint64  engine time in microseconds (CLOCK_MONOTONIC)
+ *   16 uint32  sequence number of the last v2 command applied
+ *   20 uint64  sender timestamp of that command, echoed back
+ *   28 uint32  microseconds between receiving that command and sending this datagram,
+ *              round trip = client now - echoed timestamp - this
+ *   32 uint16  servo ticks, SERVO_COUNT entries
+ *   .. uint16  leg phase, fraction of a turn * 65536, LEG_COUNT entries
+ *   .. int16   current stride length, 1/100 degree, LEG_COUNT entries
+ *   .. int16   current stride height, 1/100 degree, LEG_COUNT entries
+ *   .. int16   incline, 1/1000
+ *   .. uint16  loop busy time p50, p99 and max in microseconds (3 entries)
+ *   .. uint32  deadline misses
+ *   .. uint32  commands received
+ *   .. uint32  commands dropped as out of order or stale
+ *   .. uint32  commands lost (sequence gaps)
+ * With 9 servos and 4 legs this is 98 bytes.
+ */
+#define TELEMETRY_HEADER_SIZE 32
+#define TELEMETRY_SIZE (TELEMETRY_HEADER_SIZE + 2 * SERVO_COUNT + 2 * 3 * LEG_COUNT + 2 + 2 * 3 + 4 * 4)
+
+/*!
+ * Sends a telemetry datagram to the last client that sent a command, at a fixed rate.
+ * The datagram is built in place in a buffer owned by the sender and goes out through
+ * the command socket without blocking, so the client gets it from the port it sends to.
+ * */
+class TelemetrySender {
+private:
+  uint8_t buffer[TELEMETRY_SIZE];
+  int socketFileDescriptor;
+  int64_t periodNanos, nextSendNanos;
+  uint32_t sequence, sentCount, failedCount;
+  GaitControl *gait;
+  LoopTiming *timing;
+  CommandReceiver *receiver;
+  int build(int64_t nowNanos, const CommandFrame *lastCommand);
+public:
+  TelemetrySender();
+  /*!
+   * @param rateHz datagrams per second, 0 disables telemetry
+   * */
+  void start(int socketFileDescriptor, int rateHz, GaitControl *gait, LoopTiming *timing, CommandReceiver *receiver);
+  /*!
+   * Called by the control loop once per tick, sends if a datagram is due.
+   * @param lastCommand the last command applied, its sender is the destination
+   * @return true if a datagram was sent
+   * */
+  bool update(int64_t nowNanos, const CommandFrame *lastCommand);
+  uint32_t getSentCount();
+  uint32_t getFailedCount();
+};
+
+#endif
@@ -0,0 +1,97 @@
+#include "Trajectory.h"
+
+TrajectoryPlanner servoTrajectories;
+
+float trajectoryProfile(uint8_t profile, float u) {
+    if (profile == TRAJECTORY_MINIMUM_JERK) {
+        return u * u * u * (10.0f + u * (-15.0f + u * 6.0f));
+    }
+    if (profile == TRAJECTORY_TRAPEZOID) {
+        const float ramp = TRAJECTORY_RAMP_FRACTION;
+        // Acceleration that covers the whole move with ramps of that length
+        const float acceleration = 1.0f / (ramp * (1.0f - ramp));
+        if (u < ramp) {
+            return 0.5f * acceleration * u * u;
+        }
+        if (u > 1.0f - ramp) {
+            return 1.0f - 0.5f * acceleration * (1.0f - u) * (1.0f - u);
+        }
+        return 0.5f * acceleration * ramp * ramp + acceleration * ramp * (u - ramp);
+    }
+    return u;
+}
+
+TrajectoryPlanner::TrajectoryPlanner() {
+    this->nowNanos = 0;
+    this->droppedSetpoints = 0;
+    for (int i = 0; i < SERVO_COUNT; i++) {
+        this->head[i] = 0;
+        this->length[i] = 0;
+        this->startTicks[i] = 0;
+        this->startNanos[i] = 0;
+    }
+}
+
+void TrajectoryPlanner::moveTo(uint8_t channel, uint16_t ticks, int64_t durationNanos, uint8_t profile) {
+    this->cancel(channel);
+    this->queueSetpoint(channel, ticks, this->nowNanos + durationNanos, profile);
+}
+
+bool TrajectoryPlanner::queueSetpoint(uint8_t channel, uint16_t ticks, int64_t atNanos, uint8_t profile) {
+    int length = this->length[channel];
+    if (length == 0) {
+        // The segment starts wherever the channel is now
+        this->startTicks[channel] = servoPositions[channel];
+        this->startNanos[channel] = this->nowNanos;
+    } else {
+        int last = (this->head[channel] + length - 1) % TRAJECTORY_QUEUE_SIZE;
+        if (length == TRAJECTORY_QUEUE_SIZE || atNanos < this->queue[channel][last].atNanos) {
+            this->droppedSetpoints++;
+            return false;
+        }
+    }
+    TrajectorySetpoint *setpoint = &this->queue[channel][(this->head[channel] + length) % TRAJECTORY_QUEUE_SIZE];
+    setpoint->atNanos = atNanos;
+    setpoint->ticks = ticks;
+    setpoint->profile = profile;
+    this->length[channel]++;
+    return true;
+}
+
+void TrajectoryPlanner::cancel(uint8_t channel) {
+    this->length[channel] = 0;
+}
+
+bool TrajectoryPlanner::isActive(uint8_t channel) {
+    return this->length[channel] > 0;
+}
+
+bool TrajectoryPlanner::update(int64_t nowNanos) {
+    this->nowNanos = nowNanos;
+    bool wrote = false;
+    for (int channel = 0; channel < SERVO_COUNT; channel++) {
+        while (this->length[channel] > 0) {
+            TrajectorySetpoint *target = &this->queue[channel][this->head[channel]];
+            if (nowNanos >= target->atNanos) {
+                // Reached, the next segment starts from here
+                servoPositions[channel] = target->ticks;
+                this->startTicks[channel] = target->ticks;
+                this->startNanos[channel] = target->atNanos;
+                this->head[channel] = (this->head[channel] + 1) % TRAJECTORY_QUEUE_SIZE;
+                this->length[channel]--;
+                wrote = true;
+                continue;
+            }
+            float u = (float)(nowNanos - this->startNanos[channel]) / (target->atNanos - this->startNanos[channel]);
+            float distance = (float)target->ticks - this->startTicks[channel];
+            servoPositions[channel] = (uint16_t)(this->startTicks[channel] + distance * trajectoryProfile(target->profile, u) + 0.5f);
+            wrote = true;
+            break;
+        }
+    }
+    return wrote;
+}
+
+uint32_t TrajectoryPlanner::getDroppedSetpoints() {
+    return this->droppedSetpoints;
+}
@@ -0,0 +1,73 @@
+#ifndef _TRAJECTORY_H
+#define _TRAJECTORY_H
+
+#include <stdint.h>
+#include "ServoDriver.h"
+
+#define TRAJECTORY_QUEUE_SIZE 8
+
+#define TRAJECTORY_LINEAR 0
+// Constant acceleration for the first and last TRAJECTORY_RAMP_FRACTION of the move
+#define TRAJECTORY_TRAPEZOID 1
+// 10u^3 - 15u^4 + 6u^5, zero velocity and acceleration at both ends
+#define TRAJECTORY_MINIMUM_JERK 2
+#define TRAJECTORY_RAMP_FRACTION 0.25f
+
+/*!
+ * A target for one channel: reach ticks at atNanos (CLOCK_MONOTONIC), moving there
+ * from the previous setpoint along profile.
+ * */
+struct TrajectorySetpoint {
+    int64_t atNanos;
+    uint16_t ticks;
+    uint8_t profile;
+};
+
+/*!
+ * Output stage between the gait logic and servoDriverWriteCommands. Each channel has a
+ * fixed size queue of time stamped setpoints, update() interpolates between them at the
+ * loop rate and writes the result to servoPositions, so sparse targets reach the servos
+ * as smooth ramps instead of steps (and the battery sees no current spikes).
+ *
+ * A channel with an empty queue is left alone, whatever wrote servoPositions last wins.
+ * The gait writes the leg channels directly every tick while walking.
+ * */
+class TrajectoryPlanner {
+private:
+    TrajectorySetpoint queue[SERVO_COUNT][TRAJECTORY_QUEUE_SIZE];
+    uint8_t head[SERVO_COUNT], length[SERVO_COUNT];
+    // Where the segment towards the head setpoint starts
+    uint16_t startTicks[SERVO_COUNT];
+    int64_t startNanos[SERVO_COUNT];
+    int64_t nowNanos;
+    uint32_t droppedSetpoints;
+public:
+    TrajectoryPlanner();
+    /*!
+     * Replaces whatever the channel was doing with a move from its current position to
+     * ticks, taking durationNanos from the current tick.
+     * */
+    void moveTo(uint8_t channel, uint16_t ticks, int64_t durationNanos, uint8_t profile);
+    /*!
+     * Appends a setpoint after the ones already queued.
+     * @return false if the queue is full or atNanos is before the last setpoint
+     * */
+    bool queueSetpoint(uint8_t channel, uint16_t ticks, int64_t atNanos, uint8_t profile);
+    void cancel(uint8_t channel);
+    bool isActive(uint8_t channel);
+    /*!
+     * Advances every active channel to nowNanos and writes it to servoPositions
+     * @return true if any channel was written
+     * */
+    bool update(int64_t nowNanos);
+    uint32_t getDroppedSetpoints();
+};
+
+/*!
+ * Fraction of the move done at u (0 - 1 of the duration) for a profile
+ * */
+float trajectoryProfile(uint8_t profile, float u);
+
+extern TrajectoryPlanner servoTrajectories;
+
+#endif
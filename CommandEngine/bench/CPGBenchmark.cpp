@@ -0,0 +1,113 @@
+/*!
+ * Cost and behaviour of the Hopf CPG with the pebble's leg offsets.
+ * Reports ns per RK4 step and per control tick, how long the oscillators take to lock
+ * from a perturbed start, and how far the phase lock and the unit amplitude are
+ * disturbed across a speed step and a direction reversal.
+ * Usage: CPGBenchmark [steps] [rateHz]
+ * */
+#include "../ControlLoop.h"
+#include "../CPG.h"
+#include <cmath>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BENCHMARK_LEGS 4
+#define LOCK_TOLERANCE_RADIANS 0.01f
+
+// Leg offsets with the backward legs mirrored, as GaitControl sets them up
+static const float phaseOffsets[BENCHMARK_LEGS] = {0, M_PI, -M_PI, -2 * M_PI};
+
+volatile float sink;
+
+float wrapAngle(float angle) {
+  while (angle > M_PI)
+    angle -= 2 * M_PI;
+  while (angle < -M_PI)
+    angle += 2 * M_PI;
+  return angle;
+}
+
+float lockError(HopfCPG *cpg) {
+  float worst = 0;
+  for (int i = 1; i < BENCHMARK_LEGS; i++) {
+    float error = wrapAngle((cpg->getPhase(i) - cpg->getPhase(0)) - (phaseOffsets[i] - phaseOffsets[0]));
+    worst = fmaxf(worst, fabsf(error));
+  }
+  return worst;
+}
+
+void setUp(HopfCPG *cpg, float omega) {
+  cpg->setCount(BENCHMARK_LEGS);
+  for (int i = 0; i < BENCHMARK_LEGS; i++) {
+    cpg->setPhaseOffset(i, phaseOffsets[i]);
+  }
+  cpg->setFrequency(omega);
+  cpg->resetToLimitCycle(0);
+}
+
+/*!
+ * Runs ticks and tracks the worst phase lock error and amplitude deviation
+ * */
+void runTicks(HopfCPG *cpg, int ticks, float tickSeconds, float *worstLock, float *worstAmplitude) {
+  *worstLock = 0;
+  *worstAmplitude = 0;
+  for (int tick = 0; tick < ticks; tick++) {
+    cpg->step(tickSeconds);
+    *worstLock = fmaxf(*worstLock, lockError(cpg));
+    for (int i = 0; i < BENCHMARK_LEGS; i++) {
+      float radius = sqrtf(cpg->getX(i) * cpg->getX(i) + cpg->getY(i) * cpg->getY(i));
+      *worstAmplitude = fmaxf(*worstAmplitude, fabsf(radius - 1));
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  long steps = argc > 1 ? atol(argv[1]) : 1000000;
+  int rateHz = argc > 2 ? atoi(argv[2]) : 100;
+  float tickSeconds = 1.0f / rateHz;
+  // GaitControl runs at 2 pi * speed * 10 rad/s, speed 0.5
+  float omega = 2 * M_PI * 0.5f * 10;
+
+  HopfCPG cpg;
+  setUp(&cpg, omega);
+  int64_t start = monotonicNanos();
+  for (long i = 0; i < steps; i++) {
+    cpg.step(CPG_STEP_SECONDS);
+    sink = cpg.getX(0);
+  }
+  double stepNanos = (double)(monotonicNanos() - start) / steps;
+  int stepsPerTick = (int)(tickSeconds / CPG_STEP_SECONDS);
+  if (stepsPerTick > CPG_MAX_STEPS_PER_TICK)
+    stepsPerTick = CPG_MAX_STEPS_PER_TICK;
+  printf("%d oscillators, RK4 step %.1f ms\n", BENCHMARK_LEGS, CPG_STEP_SECONDS * 1000);
+  printf("integration: %8.1f ns/step, %8.1f ns/tick at %d Hz (%d steps)\n",
+         stepNanos, stepNanos * stepsPerTick, rateHz, stepsPerTick);
+
+  // Lock from a start where every oscillator is at the same phase
+  setUp(&cpg, omega);
+  for (int i = 0; i < BENCHMARK_LEGS; i++) {
+    cpg.setPhaseOffset(i, 0);
+  }
+  cpg.resetToLimitCycle(0);
+  for (int i = 0; i < BENCHMARK_LEGS; i++) {
+    cpg.setPhaseOffset(i, phaseOffsets[i]);
+  }
+  int ticks = 0;
+  while (lockError(&cpg) > LOCK_TOLERANCE_RADIANS && ticks < 100 * rateHz) {
+    cpg.step(tickSeconds);
+    ticks++;
+  }
+  printf("phase lock from in-phase start: %.2f s (error %.4f rad)\n", (float)ticks / rateHz, lockError(&cpg));
+
+  float lock, amplitude;
+  setUp(&cpg, omega);
+  runTicks(&cpg, rateHz, tickSeconds, &lock, &amplitude);
+  printf("steady:     lock error %.4f rad, amplitude error %.4f\n", lock, amplitude);
+  cpg.setFrequency(2 * omega);
+  runTicks(&cpg, rateHz, tickSeconds, &lock, &amplitude);
+  printf("speed x2:   lock error %.4f rad, amplitude error %.4f\n", lock, amplitude);
+  cpg.setFrequency(-omega);
+  runTicks(&cpg, rateHz, tickSeconds, &lock, &amplitude);
+  printf("reversal:   lock error %.4f rad, amplitude error %.4f\n", lock, amplitude);
+  return 0;
+}
@@ -0,0 +1,449 @@
+/*!
+ * Drives GaitControl through scripted scenarios in simulated time, the same way the
+ * control loop does (sequences, trajectories, gait, flush to a simulated PCA9685),
+ * as fast as the CPU allows. Reports ns per tick, heap allocations per tick, retired
+ * instructions per tick (when perf_event_open is permitted) and a checksum of every
+ * servo frame, so a gait or driver change can be compared against the previous build
+ * before it goes on the robot. The checksum only depends on the scenario, the rate,
+ * the duration, the phase source and the gait pattern.
+ * Usage: GaitBenchmark [--seconds N] [--rate HZ] [--scenario NAME] [--cpg] [--live-gait] [--gait PATTERN]
+ * */
+#include "../ControlLoop.h"
+#include "../I2CTransport.h"
+#include "../LoopTiming.h"
+#include "../ServoCalibration.h"
+#include "../ServoDriver.h"
+#include "../SimulatedPCA9685.h"
+#include "../Trajectory.h"
+#include "../gait.h"
+#include <getopt.h>
+#include <linux/perf_event.h>
+#include <math.h>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+// As set by main
+#define BENCHMARK_SPEED 0.5f
+
+// Every operator new in the process goes through here, the loop should never get here
+static uint64_t allocationCount = 0;
+
+void *operator new(size_t size) {
+  allocationCount++;
+  void *pointer = malloc(size == 0 ? 1 : size);
+  if (pointer == NULL)
+    throw std::bad_alloc();
+  return pointer;
+}
+
+void *operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void *pointer) noexcept {
+  free(pointer);
+}
+
+void operator delete[](void *pointer) noexcept {
+  free(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept {
+  free(pointer);
+}
+
+void operator delete[](void *pointer, size_t) noexcept {
+  free(pointer);
+}
+
+/*!
+ * Commands a scenario issues before a tick, called with the tick's simulated time.
+ * Held keys are modelled by issuing the command on every tick they are held, like the
+ * receiver does for a client that keeps sending.
+ * */
+typedef void (*ScenarioScript)(GaitControl *gait, long tick, int rateHz);
+
+struct Scenario {
+  const char *name;
+  const char *description;
+  ScenarioScript script;
+};
+
+static double secondsAt(long tick, int rateHz) {
+  return (double)tick / rateHz;
+}
+
+/*!
+ * Ramps up, holds top speed, then lets go
+ */
+static void walkScript(GaitControl *gait, long tick, int rateHz) {
+  double seconds = secondsAt(tick, rateHz);
+  if (tick == 0) {
+    gait->setGaitState(GAIT_STATE_MOVE);
+    gait->setDirection(TRANSLATION_DIRECTION_FORWARD);
+  }
+  // Held forward for 20 s, released for 10 s
+  if (fmod(seconds, 30.0) < 20.0) {
+    gait->accelerate();
+  } else {
+    gait->decelerate();
+  }
+}
+
+/*!
+ * Walks forward while cycling through every turn, 2 s each
+ */
+static void turnScript(GaitControl *gait, long tick, int rateHz) {
+  static const int turns[] = {TURN_DIRECTION_NONE, TURN_DIRECTION_LEFT, TURN_DIRECTION_RIGHT,
+                              TURN_DIRECTION_IN_PLACE_LEFT, TURN_DIRECTION_IN_PLACE_RIGHT};
+  if (tick == 0) {
+    gait->setGaitState(GAIT_STATE_MOVE);
+    gait->setDirection(TRANSLATION_DIRECTION_FORWARD);
+  }
+  int turn = (int)(secondsAt(tick, rateHz) / 2) % (sizeof(turns) / sizeof(turns[0]));
+  gait->setTurnDirection(turns[turn]);
+  gait->accelerate();
+}
+
+/*!
+ * Walks while the stride length, stride height and incline step up and down, one
+ * change every 0.5 s, so the keyframe tables keep getting rebuilt
+ */
+static void strideScript(GaitControl *gait, long tick, int rateHz) {
+  if (tick == 0) {
+    gait->setGaitState(GAIT_STATE_MOVE);
+    gait->setDirection(TRANSLATION_DIRECTION_FORWARD);
+  }
+  gait->accelerate();
+  long changeTicks = rateHz / 2 > 0 ? rateHz / 2 : 1;
+  if (tick % changeTicks != 0)
+    return;
+  switch ((tick / changeTicks) % 12) {
+  case 0:
+  case 1:
+    gait->incrementStrideLength();
+    break;
+  case 2:
+  case 3:
+    gait->decrementStrideLength();
+    break;
+  case 4:
+  case 5:
+    gait->incrementStrideHeight();
+    break;
+  case 6:
+  case 7:
+    gait->decrementStrideHeight();
+    break;
+  case 8:
+    gait->incrementIncline();
+    break;
+  case 9:
+    gait->decrementIncline();
+    break;
+  case 10:
+    gait->setDirection(TRANSLATION_DIRECTION_BACKWARD);
+    break;
+  case 11:
+    gait->setDirection(TRANSLATION_DIRECTION_FORWARD);
+    break;
+  }
+}
+
+/*!
+ * Closes and reopens every 2 s, exercising the sequencer and the servo ramps
+ */
+static void openCloseScript(GaitControl *gait, long tick, int rateHz) {
+  long periodTicks = 2 * rateHz;
+  if (tick % periodTicks != 0)
+    return;
+  if ((tick / periodTicks) % 2 == 0) {
+    gait->closePebble();
+  } else {
+    gait->openPebble();
+  }
+  gait->setGaitState(GAIT_STATE_STOP);
+}
+
+/*!
+ * The continuous v2 controls: velocity and turn rate sweep slowly, strides are set
+ * directly every 5 s
+ */
+static void motionScript(GaitControl *gait, long tick, int rateHz) {
+  double seconds = secondsAt(tick, rateHz);
+  if (tick == 0) {
+    gait->setGaitState(GAIT_STATE_MOVE);
+  }
+  if (tick % (5 * rateHz) == 0) {
+    gait->setStrideLength(20 + (tick / (5 * rateHz)) % 3 * 5);
+    gait->setStrideHeight(15 + (tick / (5 * rateHz)) % 2 * 5);
+  }
+  float velocity = (float)sin(seconds * TWO_PI / 20);
+  float turn = (float)sin(seconds * TWO_PI / 7) * 0.5f;
+  gait->setMotion(velocity, turn);
+  if (fabs(velocity) > 0.05 || fabs(turn) > 0.05) {
+    gait->accelerate();
+  } else {
+    gait->decelerate();
+  }
+}
+
+static const Scenario scenarios[] = {
+    {"walk", "accelerate, cruise, decelerate", walkScript},
+    {"turns", "walk through every turn direction", turnScript},
+    {"strides", "stride length, height and incline changes while walking", strideScript},
+    {"openclose", "close and reopen every 2 s", openCloseScript},
+    {"motion", "continuous velocity and turn rate", motionScript},
+};
+#define SCENARIO_COUNT (int)(sizeof(scenarios) / sizeof(scenarios[0]))
+
+/*!
+ * Counts retired user space instructions of this thread, if the kernel allows it
+ * */
+class InstructionCounter {
+private:
+  int fileDescriptor;
+public:
+  InstructionCounter() {
+    struct perf_event_attr attributes;
+    memset(&attributes, 0, sizeof(attributes));
+    attributes.type = PERF_TYPE_HARDWARE;
+    attributes.size = sizeof(attributes);
+    attributes.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attributes.disabled = 1;
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv = 1;
+    this->fileDescriptor = syscall(__NR_perf_event_open, &attributes, 0, -1, -1, 0);
+  }
+  ~InstructionCounter() {
+    if (this->fileDescriptor >= 0)
+      close(this->fileDescriptor);
+  }
+  bool isAvailable() {
+    return this->fileDescriptor >= 0;
+  }
+  void start() {
+    if (this->fileDescriptor < 0)
+      return;
+    ioctl(this->fileDescriptor, PERF_EVENT_IOC_RESET, 0);
+    ioctl(this->fileDescriptor, PERF_EVENT_IOC_ENABLE, 0);
+  }
+  uint64_t stop() {
+    uint64_t count = 0;
+    if (this->fileDescriptor < 0)
+      return 0;
+    ioctl(this->fileDescriptor, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(this->fileDescriptor, &count, sizeof(count)) != sizeof(count))
+      return 0;
+    return count;
+  }
+};
+
+struct ScenarioResult {
+  int64_t elapsedNanos;
+  uint64_t allocations, instructions, checksum;
+  uint32_t flushes, transactions;
+  uint64_t busBytes, busNanos;
+};
+
+static uint64_t checksumFrame(uint64_t hash, bool written) {
+  const uint8_t *bytes = (const uint8_t *)servoPositions;
+  for (unsigned int i = 0; i < SERVO_COUNT * sizeof(uint16_t); i++) {
+    hash = (hash ^ bytes[i]) * FNV_PRIME;
+  }
+  return (hash ^ (written ? 1 : 0)) * FNV_PRIME;
+}
+
+/*!
+ * Runs one scenario from the power up state. Setup allocations happen before the
+ * counters start.
+ * */
+static void runScenario(const Scenario *scenario, long ticks, int rateHz, int phaseSource, bool keyframeCache,
+                        int gaitPattern, const uint16_t *initialPositions, InstructionCounter *instructions,
+                        LatencyHistogram *tickTimes, ScenarioResult *result) {
+  SimulatedPCA9685 *controller = (SimulatedPCA9685 *)servoDriverGetTransport();
+  memcpy(servoPositions, initialPositions, SERVO_COUNT * sizeof(uint16_t));
+  for (int channel = 0; channel < SERVO_COUNT; channel++) {
+    servoTrajectories.cancel(channel);
+  }
+  servoDriverInvalidateShadow();
+  GaitControl *gait = new GaitControl();
+  // The engine's settings, speed and turn are not set by the constructor
+  gait->setSpeed(BENCHMARK_SPEED);
+  gait->setTurnDirection(TURN_DIRECTION_NONE);
+  gait->setPhaseSource(phaseSource);
+  gait->setKeyframeCache(keyframeCache);
+  gait->setGaitPattern(gaitPattern);
+  controller->resetStats();
+  ServoDriverBusStats busBefore = servoDriverGetBusStats();
+
+  int64_t periodNanos = NANOS_PER_SECOND / rateHz;
+  float deltaTime = 1.0f / rateHz;
+  uint64_t hash = FNV_OFFSET_BASIS;
+  tickTimes->reset();
+  uint64_t allocationsBefore = allocationCount;
+  instructions->start();
+  int64_t startNanos = monotonicNanos();
+  for (long tick = 0; tick < ticks; tick++) {
+    int64_t tickStartNanos = monotonicNanos();
+    int64_t nowNanos = tick * periodNanos;
+    scenario->script(gait, tick, rateHz);
+    bool moved = gait->updateSequences(nowNanos);
+    moved |= servoTrajectories.update(nowNanos);
+    gait->updateGait(deltaTime);
+    bool written = moved || gait->getGaitState() == GAIT_STATE_MOVE;
+    if (written) {
+      servoDriverWriteCommands();
+    }
+    hash = checksumFrame(hash, written);
+    tickTimes->record(monotonicNanos() - tickStartNanos);
+  }
+  result->elapsedNanos = monotonicNanos() - startNanos;
+  result->instructions = instructions->stop();
+  result->allocations = allocationCount - allocationsBefore;
+  result->checksum = hash;
+  ServoDriverBusStats busAfter = servoDriverGetBusStats();
+  result->flushes = busAfter.flushes - busBefore.flushes;
+  result->transactions = busAfter.transactions - busBefore.transactions;
+  result->busBytes = busAfter.bytesWritten - busBefore.bytesWritten;
+  result->busNanos = controller->getBusNanos();
+  delete gait;
+}
+
+void printUsage(const char *programName) {
+  printf("Usage: %s [--seconds N] [--rate HZ] [--scenario NAME] [--cpg] [--live-gait] [--gait PATTERN]\n",
+         programName);
+  printf("  --seconds N      simulated seconds per scenario (default 60)\n");
+  printf("  --rate HZ        control loop rate, %d - %d (default %d)\n", CONTROL_LOOP_RATE_MIN_HZ,
+         CONTROL_LOOP_RATE_MAX_HZ, CONTROL_LOOP_RATE_DEFAULT_HZ);
+  printf("  --scenario NAME  run only this scenario (default all):\n");
+  for (int i = 0; i < SCENARIO_COUNT; i++) {
+    printf("                     %-10s %s\n", scenarios[i].name, scenarios[i].description);
+  }
+  printf("  --cpg            generate leg phases with the coupled oscillator CPG\n");
+  printf("  --live-gait      evaluate the gait every tick instead of playing back keyframes\n");
+  printf("  --gait PATTERN   trot, walk, pace or bound (default %s)\n", gaitPatternName(GAIT_PATTERN_DEFAULT));
+}
+
+int main(int argc, char *argv[]) {
+  static struct option longOptions[] = {
+      {"seconds", required_argument, 0, 's'},
+      {"rate", required_argument, 0, 'r'},
+      {"scenario", required_argument, 0, 'n'},
+      {"cpg", no_argument, 0, 'g'},
+      {"live-gait", no_argument, 0, 'l'},
+      {"gait", required_argument, 0, 'w'},
+      {"help", no_argument, 0, 'h'},
+      {0, 0, 0, 0}};
+  double seconds = 60;
+  int rateHz = CONTROL_LOOP_RATE_DEFAULT_HZ;
+  const char *scenarioName = NULL;
+  int phaseSource = PHASE_SOURCE_OSCILLATOR;
+  bool keyframeCache = true;
+  int gaitPattern = GAIT_PATTERN_DEFAULT;
+
+  int option;
+  while ((option = getopt_long(argc, argv, "s:r:n:glw:h", longOptions, NULL)) != -1) {
+    switch (option) {
+    case 's':
+      seconds = atof(optarg);
+      break;
+    case 'r':
+      rateHz = atoi(optarg);
+      break;
+    case 'n':
+      scenarioName = optarg;
+      break;
+    case 'g':
+      phaseSource = PHASE_SOURCE_CPG;
+      break;
+    case 'l':
+      keyframeCache = false;
+      break;
+    case 'w':
+      gaitPattern = -1;
+      for (int pattern = 0; pattern < GAIT_PATTERN_COUNT; pattern++) {
+        if (strcmp(optarg, gaitPatternName(pattern)) == 0)
+          gaitPattern = pattern;
+      }
+      if (gaitPattern < 0) {
+        printUsage(argv[0]);
+        return 2;
+      }
+      break;
+    default:
+      printUsage(argv[0]);
+      return 2;
+    }
+  }
+  if (seconds <= 0 || rateHz < CONTROL_LOOP_RATE_MIN_HZ || rateHz > CONTROL_LOOP_RATE_MAX_HZ) {
+    printUsage(argv[0]);
+    return 2;
+  }
+  int selected = -1;
+  if (scenarioName != NULL) {
+    for (int i = 0; i < SCENARIO_COUNT; i++) {
+      if (strcmp(scenarios[i].name, scenarioName) == 0)
+        selected = i;
+    }
+    if (selected < 0) {
+      printUsage(argv[0]);
+      return 2;
+    }
+  }
+
+  // The simulator without bus emulation, so only the driver's own work is timed
+  servoCalibrationLoadDefaults();
+  servoDriverSelectTransport(I2C_TRANSPORT_SIMULATED);
+  if (servoDriverInit(0) < 0) {
+    return 1;
+  }
+  uint16_t initialPositions[SERVO_COUNT];
+  memcpy(initialPositions, servoPositions, sizeof(initialPositions));
+
+  long ticks = (long)(seconds * rateHz);
+  InstructionCounter instructions;
+  LatencyHistogram tickTimes;
+  printf("%ld ticks per scenario at %d Hz, %s, %s, %s\n", ticks, rateHz,
+         phaseSource == PHASE_SOURCE_CPG ? "CPG" : "oscillators", keyframeCache ? "keyframes" : "live gait",
+         gaitPatternName(gaitPattern));
+  printf("%-10s %9s %9s %9s %11s %13s %9s %12s %18s\n", "scenario", "ns/tick", "p99 ns", "max ns", "allocs/tick",
+         "instr/tick", "flushes", "I2C B/tick", "checksum");
+
+  uint64_t combined = FNV_OFFSET_BASIS;
+  uint64_t totalAllocations = 0;
+  for (int i = 0; i < SCENARIO_COUNT; i++) {
+    if (selected >= 0 && i != selected)
+      continue;
+    ScenarioResult result;
+    runScenario(&scenarios[i], ticks, rateHz, phaseSource, keyframeCache, gaitPattern, initialPositions, &instructions,
+                &tickTimes, &result);
+    char instructionText[32];
+    if (instructions.isAvailable() && result.instructions > 0) {
+      snprintf(instructionText, sizeof(instructionText), "%.1f", (double)result.instructions / ticks);
+    } else {
+      snprintf(instructionText, sizeof(instructionText), "n/a");
+    }
+    printf("%-10s %9.1f %9u %9u %11.4f %13s %9u %12.1f   %016llx\n", scenarios[i].name,
+           (double)result.elapsedNanos / ticks, tickTimes.getPercentile(0.99), tickTimes.getMax(),
+           (double)result.allocations / ticks, instructionText, result.flushes, (double)result.busBytes / ticks,
+           (unsigned long long)result.checksum);
+    combined = (combined ^ result.checksum) * FNV_PRIME;
+    totalAllocations += result.allocations;
+  }
+  if (selected < 0) {
+    printf("combined checksum %016llx\n", (unsigned long long)combined);
+  }
+  if (!instructions.isAvailable()) {
+    printf("instruction counts need perf_event_open (see /proc/sys/kernel/perf_event_paranoid)\n");
+  }
+  servoDriverDeInit(0);
+  return totalAllocations == 0 ? 0 : 1;
+}
@@ -0,0 +1,100 @@
+/*!
+ * Compares live gait evaluation with keyframe playback on two GaitControls driven in
+ * lockstep. Reports ns per tick for both, the largest servo tick difference between
+ * them, and how many keyframe tables a stride / incline change rebuilds.
+ * Usage: GaitCacheBenchmark [ticks] [rateHz]
+ * */
+#include "../ControlLoop.h"
+#include "../ServoCalibration.h"
+#include "../gait.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCHMARK_SPEED 0.5f
+// Commands needed for the strides to settle on their targets
+#define BENCHMARK_SETTLE_COMMANDS 200
+
+volatile uint16_t sink;
+
+/*!
+ * Runs ticks and returns the elapsed nanoseconds
+ * */
+int64_t runTicks(GaitControl *gait, long ticks, float deltaTime) {
+  int64_t start = monotonicNanos();
+  for (long tick = 0; tick < ticks; tick++) {
+    gait->updateGait(deltaTime);
+    sink = servoPositions[0];
+  }
+  return monotonicNanos() - start;
+}
+
+void setUp(GaitControl *gait, bool keyframeCache) {
+  gait->setSpeed(BENCHMARK_SPEED);
+  gait->setKeyframeCache(keyframeCache);
+  gait->setTurnDirection(TURN_DIRECTION_NONE);
+  gait->setGaitState(GAIT_STATE_MOVE);
+  for (int i = 0; i < BENCHMARK_SETTLE_COMMANDS; i++) {
+    gait->accelerate();
+  }
+}
+
+/*!
+ * Runs both gaits one tick at a time and returns the largest difference in ticks
+ * */
+int compareTicks(GaitControl *live, GaitControl *cached, long ticks, float deltaTime) {
+  uint16_t liveTicks[SERVO_COUNT];
+  int worst = 0;
+  for (long tick = 0; tick < ticks; tick++) {
+    live->updateGait(deltaTime);
+    memcpy(liveTicks, servoPositions, sizeof(liveTicks));
+    cached->updateGait(deltaTime);
+    for (int i = 0; i < LEG_COUNT * 2; i++) {
+      worst = max(worst, abs((int)liveTicks[i] - (int)servoPositions[i]));
+    }
+  }
+  return worst;
+}
+
+int main(int argc, char *argv[]) {
+  long ticks = argc > 1 ? atol(argv[1]) : 1000000;
+  int rateHz = argc > 2 ? atoi(argv[2]) : 100;
+  float deltaTime = 1.0f / rateHz;
+
+  servoCalibrationLoadDefaults();
+  servoPositions = new uint16_t[SERVO_COUNT]();
+  GaitControl live, cached;
+  setUp(&live, false);
+  setUp(&cached, true);
+
+  // Timing
+  int64_t liveNanos = runTicks(&live, ticks, deltaTime);
+  int64_t cachedNanos = runTicks(&cached, ticks, deltaTime);
+  printf("ticks: %ld at %d Hz, %d legs\n", ticks, rateHz, LEG_COUNT);
+  printf("live:      %8.2f ns/tick\n", (double)liveNanos / ticks);
+  printf("keyframes: %8.2f ns/tick\n", (double)cachedNanos / ticks);
+  printf("tables built: %u, keyframe footprint %u bytes\n", gaitCacheStats.rebuilds,
+         (unsigned)(LEG_COUNT * 2 * (GAIT_CACHE_SIZE + 1) * sizeof(uint16_t)));
+
+  // Accuracy, both gaits restarted from the same phase
+  GaitControl liveCheck, cachedCheck;
+  setUp(&liveCheck, false);
+  setUp(&cachedCheck, true);
+  int worst = compareTicks(&liveCheck, &cachedCheck, rateHz * 60, deltaTime);
+  printf("largest difference from live: %d ticks\n", worst);
+
+  // Incremental invalidation, each change should only rebuild the tables it affects
+  uint32_t before = gaitCacheStats.rebuilds;
+  liveCheck.incrementStrideLength();
+  cachedCheck.incrementStrideLength();
+  compareTicks(&liveCheck, &cachedCheck, GAIT_CACHE_SETTLE_EVALUATIONS, deltaTime);
+  printf("stride length change: %u tables rebuilt\n", gaitCacheStats.rebuilds - before);
+  before = gaitCacheStats.rebuilds;
+  liveCheck.incrementIncline();
+  cachedCheck.incrementIncline();
+  compareTicks(&liveCheck, &cachedCheck, GAIT_CACHE_SETTLE_EVALUATIONS, deltaTime);
+  printf("incline change:       %u tables rebuilt\n", gaitCacheStats.rebuilds - before);
+  worst = max(worst, compareTicks(&liveCheck, &cachedCheck, rateHz * 60, deltaTime));
+  printf("largest difference after the changes: %d ticks\n", worst);
+  return worst <= 1 ? 0 : 1;
+}
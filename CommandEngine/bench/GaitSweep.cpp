@@ -0,0 +1,565 @@
+/*!
+ * Searches the gait parameters offline: every configuration (stride length, stride
+ * height, incline, speed and the leg phase offsets) walks forward on GaitSimulator for
+ * a few simulated seconds and gets scored on forward speed, foot slip, servo travel
+ * (an energy proxy) and smoothness. Configurations are a grid over the ranges or a
+ * seeded random sample of them, and run on a work stealing pool over all cores, each
+ * worker with its own GaitControl and servo frame. The results only depend on the
+ * configurations, the rate and the durations, not on the thread count, the checksum
+ * shows it.
+ * Usage: GaitSweep [--random N] [--seed S] [--stride-length RANGE] [--stride-height RANGE] [--incline RANGE]
+ *                  [--speed RANGE] [--gait LIST] [--random-lags] [--seconds N] [--settle N] [--rate HZ]
+ *                  [--threads N] [--cpg] [--live-gait] [--foot-space] [--calibration FILE] [--csv FILE] [--top N]
+ * */
+#include "../ControlLoop.h"
+#include "../GaitSimulator.h"
+#include "../ServoCalibration.h"
+#include "../ServoDriver.h"
+#include "../gait.h"
+#include <algorithm>
+#include <atomic>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+// Marks a configuration with its own phase lags instead of a pattern's
+#define SWEEP_CUSTOM_LAGS -1
+#define SWEEP_MAX_THREADS 256
+#define SWEEP_DEFAULT_SECONDS 5.0
+#define SWEEP_DEFAULT_SETTLE_SECONDS 1.0
+#define SWEEP_DEFAULT_TOP 10
+
+/*!
+ * MIN:MAX:COUNT, COUNT evenly spaced values for the grid. A random sample draws
+ * uniformly from MIN to MAX and ignores COUNT.
+ * */
+struct SweepRange {
+  float min, max;
+  int count;
+  float at(int i) {
+    return this->count > 1 ? this->min + (this->max - this->min) * i / (this->count - 1) : this->min;
+  }
+};
+
+struct SweepConfig {
+  float strideLength, strideHeight, incline, speed;
+  // A GAIT_PATTERN or SWEEP_CUSTOM_LAGS
+  int pattern;
+  // Fraction of a cycle each leg is behind, as gaitPatternLag
+  float lags[LEG_COUNT];
+};
+
+struct SweepResult {
+  GaitMetrics metrics;
+  uint32_t unreachable;
+};
+
+struct SweepSettings {
+  long settleTicks, measuredTicks;
+  int rateHz;
+  int phaseSource;
+  bool keyframeCache, footSpace;
+};
+
+/*!
+ * splitmix64, so a seed gives the same sample everywhere
+ * */
+static uint64_t nextRandom(uint64_t *state) {
+  uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+static float randomBetween(uint64_t *state, float min, float max) {
+  return min + (max - min) * (float)((nextRandom(state) >> 40) / (double)(1ULL << 24));
+}
+
+/*!
+ * Every worker owns a range [begin, end) of configuration indices, packed into one
+ * word so that the owner taking from the front and a thief taking the back half are
+ * both a single compare and swap. A worker only takes one configuration at a time,
+ * each is thousands of ticks.
+ * */
+struct alignas(64) WorkRange {
+  std::atomic<uint64_t> packed;
+};
+
+static uint64_t packRange(uint32_t begin, uint32_t end) {
+  return ((uint64_t)begin << 32) | end;
+}
+
+static uint32_t rangeBegin(uint64_t packed) {
+  return (uint32_t)(packed >> 32);
+}
+
+static uint32_t rangeEnd(uint64_t packed) {
+  return (uint32_t)packed;
+}
+
+class SweepPool {
+private:
+  WorkRange ranges[SWEEP_MAX_THREADS];
+  int workerCount;
+  std::atomic<uint32_t> steals;
+public:
+  SweepPool(int workerCount, uint32_t configCount) : workerCount(workerCount), steals(0) {
+    for (int i = 0; i < workerCount; i++) {
+      uint32_t begin = (uint64_t)configCount * i / workerCount;
+      uint32_t end = (uint64_t)configCount * (i + 1) / workerCount;
+      this->ranges[i].packed.store(packRange(begin, end));
+    }
+  }
+  /*!
+   * The next configuration for worker, its own first, then stolen. False when no
+   * worker has any left.
+   * */
+  bool take(int worker, uint32_t *index) {
+    std::atomic<uint64_t> *own = &this->ranges[worker].packed;
+    while (true) {
+      uint64_t packed = own->load(std::memory_order_acquire);
+      while (rangeBegin(packed) < rangeEnd(packed)) {
+        if (own->compare_exchange_weak(packed, packRange(rangeBegin(packed) + 1, rangeEnd(packed)),
+                                       std::memory_order_acq_rel)) {
+          *index = rangeBegin(packed);
+          return true;
+        }
+      }
+      if (!this->steal(worker)) {
+        return false;
+      }
+    }
+  }
+  /*!
+   * Moves the back half of the fullest range to worker's own, which is empty
+   * */
+  bool steal(int worker) {
+    while (true) {
+      int victim = -1;
+      uint64_t victimPacked = 0;
+      uint32_t most = 0;
+      for (int i = 0; i < this->workerCount; i++) {
+        uint64_t packed = this->ranges[i].packed.load(std::memory_order_acquire);
+        uint32_t remaining = rangeBegin(packed) < rangeEnd(packed) ? rangeEnd(packed) - rangeBegin(packed) : 0;
+        if (i != worker && remaining > most) {
+          most = remaining;
+          victim = i;
+          victimPacked = packed;
+        }
+      }
+      if (victim < 0) {
+        return false;
+      }
+      uint32_t split = rangeEnd(victimPacked) - (most + 1) / 2;
+      if (this->ranges[victim].packed.compare_exchange_strong(
+              victimPacked, packRange(rangeBegin(victimPacked), split), std::memory_order_acq_rel)) {
+        this->ranges[worker].packed.store(packRange(split, rangeEnd(victimPacked)), std::memory_order_release);
+        this->steals.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+    }
+  }
+  uint32_t getSteals() {
+    return this->steals;
+  }
+};
+
+/*!
+ * Walks one configuration forward from the power up pose: settleTicks to reach the
+ * stride, then measuredTicks scored. The gait writes to frame, the calling worker's own.
+ * */
+static void runConfig(const SweepConfig *config, const SweepSettings *settings, const uint16_t *initialPositions,
+                      uint16_t *frame, GaitCacheStats *cacheStats, SweepResult *result) {
+  memcpy(frame, initialPositions, SERVO_COUNT * sizeof(uint16_t));
+  GaitControl *gait = new GaitControl(frame, cacheStats);
+  gait->setSpeed(config->speed);
+  gait->setTurnDirection(TURN_DIRECTION_NONE);
+  gait->setPhaseSource(settings->phaseSource);
+  gait->setKeyframeCache(settings->keyframeCache);
+  gait->setFootSpace(settings->footSpace);
+  if (config->pattern == SWEEP_CUSTOM_LAGS) {
+    gait->setPhaseLags(config->lags);
+  } else {
+    gait->setGaitPattern(config->pattern);
+  }
+  gait->setStrideLength(config->strideLength);
+  gait->setStrideHeight(config->strideHeight);
+  gait->setIncline(config->incline);
+  gait->setGaitState(GAIT_STATE_MOVE);
+  gait->setDirection(TRANSLATION_DIRECTION_FORWARD);
+
+  GaitSimulator simulator;
+  simulator.reset(gait);
+  float deltaTime = 1.0f / settings->rateHz;
+  for (long tick = 0; tick < settings->settleTicks + settings->measuredTicks; tick++) {
+    if (tick == settings->settleTicks) {
+      simulator.clearMetrics();
+    }
+    gait->accelerate();
+    gait->updateGait(deltaTime);
+    simulator.step(frame, deltaTime);
+  }
+  result->metrics = simulator.getMetrics();
+  result->unreachable = gait->getUnreachableCount();
+  delete gait;
+}
+
+static void workerLoop(SweepPool *pool, int worker, const std::vector<SweepConfig> *configs,
+                       const SweepSettings *settings, const uint16_t *initialPositions,
+                       std::vector<SweepResult> *results) {
+  uint16_t frame[SERVO_COUNT];
+  GaitCacheStats cacheStats = {};
+  uint32_t index;
+  while (pool->take(worker, &index)) {
+    runConfig(&(*configs)[index], settings, initialPositions, frame, &cacheStats, &(*results)[index]);
+  }
+}
+
+static const char *configPatternName(const SweepConfig *config) {
+  return config->pattern == SWEEP_CUSTOM_LAGS ? "custom" : gaitPatternName(config->pattern);
+}
+
+static float efficiency(const SweepResult *result) {
+  return result->metrics.servoTravel > 0 ? result->metrics.forwardSpeed / result->metrics.servoTravel : 0;
+}
+
+static void printTop(const char *title, const std::vector<uint32_t> &order, const std::vector<SweepConfig> &configs,
+                     const std::vector<SweepResult> &results, int top) {
+  printf("\n%s\n", title);
+  printf("%8s %-7s %7s %7s %7s %6s %9s %9s %9s %10s %8s %7s\n", "config", "gait", "length", "height", "incline",
+         "speed", "fwd mm/s", "slip mm/s", "deg/s", "mm/deg", "rough", "feet");
+  for (int i = 0; i < top && i < (int)order.size(); i++) {
+    const SweepConfig *config = &configs[order[i]];
+    const SweepResult *result = &results[order[i]];
+    printf("%8u %-7s %7.1f %7.1f %7.2f %6.2f %9.1f %9.1f %9.0f %10.4f %8.0f %7.2f\n", order[i],
+           configPatternName(config), config->strideLength, config->strideHeight, config->incline, config->speed,
+           result->metrics.forwardSpeed, result->metrics.slip, result->metrics.servoTravel, efficiency(result),
+           result->metrics.roughness, result->metrics.support);
+  }
+}
+
+static int writeCsv(const char *path, const std::vector<SweepConfig> &configs,
+                    const std::vector<SweepResult> &results) {
+  FILE *file = fopen(path, "w");
+  if (file == NULL) {
+    perror(path);
+    return -1;
+  }
+  fprintf(file, "config,gait,stride_length,stride_height,incline,speed");
+  for (int leg = 0; leg < LEG_COUNT; leg++) {
+    fprintf(file, ",lag%d", leg);
+  }
+  fprintf(file, ",forward_mm_s,lateral_mm_s,yaw_deg_s,slip_mm_s,travel_deg_s,roughness_deg_s2,support,unreachable\n");
+  for (size_t i = 0; i < configs.size(); i++) {
+    const SweepConfig *config = &configs[i];
+    const GaitMetrics *metrics = &results[i].metrics;
+    fprintf(file, "%zu,%s,%g,%g,%g,%g", i, configPatternName(config), config->strideLength, config->strideHeight,
+            config->incline, config->speed);
+    for (int leg = 0; leg < LEG_COUNT; leg++) {
+      fprintf(file, ",%g", config->lags[leg]);
+    }
+    fprintf(file, ",%g,%g,%g,%g,%g,%g,%g,%u\n", metrics->forwardSpeed, metrics->lateralSpeed, metrics->yawRate,
+            metrics->slip, metrics->servoTravel, metrics->roughness, metrics->support, results[i].unreachable);
+  }
+  return fclose(file);
+}
+
+static bool parseRange(const char *text, SweepRange *range) {
+  float min, max;
+  int count;
+  int fields = sscanf(text, "%f:%f:%d", &min, &max, &count);
+  if (fields == 1) {
+    max = min;
+    count = 1;
+  } else if (fields != 3 || count < 1 || max < min) {
+    return false;
+  }
+  range->min = min;
+  range->max = max;
+  range->count = count;
+  return true;
+}
+
+/*!
+ * Comma separated pattern names, or "all"
+ * */
+static bool parsePatterns(const char *text, std::vector<int> *patterns) {
+  patterns->clear();
+  char buffer[128];
+  snprintf(buffer, sizeof(buffer), "%s", text);
+  for (char *name = strtok(buffer, ","); name != NULL; name = strtok(NULL, ",")) {
+    bool found = false;
+    for (int pattern = 0; pattern < GAIT_PATTERN_COUNT; pattern++) {
+      if (strcmp(name, "all") == 0 || strcmp(name, gaitPatternName(pattern)) == 0) {
+        patterns->push_back(pattern);
+        found = true;
+      }
+    }
+    if (!found) {
+      return false;
+    }
+  }
+  return !patterns->empty();
+}
+
+void printUsage(const char *programName) {
+  printf("Usage: %s [--random N] [--seed S] [--stride-length RANGE] [--stride-height RANGE] [--incline RANGE]\n"
+         "       [--speed RANGE] [--gait LIST] [--random-lags] [--seconds N] [--settle N] [--rate HZ]\n"
+         "       [--threads N] [--cpg] [--live-gait] [--foot-space] [--calibration FILE] [--csv FILE] [--top N]\n",
+         programName);
+  printf("  RANGE is MIN:MAX:COUNT (COUNT grid points) or a single value\n");
+  printf("  --random N           N random configurations within the ranges instead of the grid\n");
+  printf("  --seed S             seed of the random sample (default 1)\n");
+  printf("  --stride-length R    degrees (default 10:40:4)\n");
+  printf("  --stride-height R    degrees (default 5:25:3)\n");
+  printf("  --incline R          manual incline, 1 is 45 degrees (default -0.4:0.4:3)\n");
+  printf("  --speed R            as main sets it, 0.5 is 5 strides per second (default 0.2:0.8:4)\n");
+  printf("  --gait LIST          comma separated trot, walk, pace, bound or all (default all)\n");
+  printf("  --random-lags        random phase lags per leg instead of the patterns' (random sample only)\n");
+  printf("  --seconds N          measured simulated seconds per configuration (default %g)\n", SWEEP_DEFAULT_SECONDS);
+  printf("  --settle N           simulated seconds before measuring (default %g)\n", SWEEP_DEFAULT_SETTLE_SECONDS);
+  printf("  --rate HZ            control loop rate, %d - %d (default %d)\n", CONTROL_LOOP_RATE_MIN_HZ,
+         CONTROL_LOOP_RATE_MAX_HZ, CONTROL_LOOP_RATE_DEFAULT_HZ);
+  printf("  --threads N          workers (default one per core)\n");
+  printf("  --cpg                generate leg phases with the coupled oscillator CPG\n");
+  printf("  --live-gait          evaluate the gait every tick instead of playing back keyframes\n");
+  printf("  --foot-space         drive the feet along foot space paths through leg IK\n");
+  printf("  --calibration FILE   the robot's servo calibration (default the SG90 defaults)\n");
+  printf("  --csv FILE           write every configuration and its metrics\n");
+  printf("  --top N              rows in the summary tables (default %d)\n", SWEEP_DEFAULT_TOP);
+}
+
+int main(int argc, char *argv[]) {
+  static struct option longOptions[] = {
+      {"random", required_argument, 0, 'n'},
+      {"seed", required_argument, 0, 'e'},
+      {"stride-length", required_argument, 0, 'L'},
+      {"stride-height", required_argument, 0, 'H'},
+      {"incline", required_argument, 0, 'i'},
+      {"speed", required_argument, 0, 'v'},
+      {"gait", required_argument, 0, 'w'},
+      {"random-lags", no_argument, 0, 'a'},
+      {"seconds", required_argument, 0, 's'},
+      {"settle", required_argument, 0, 'S'},
+      {"rate", required_argument, 0, 'r'},
+      {"threads", required_argument, 0, 't'},
+      {"cpg", no_argument, 0, 'g'},
+      {"live-gait", no_argument, 0, 'l'},
+      {"foot-space", no_argument, 0, 'f'},
+      {"calibration", required_argument, 0, 'k'},
+      {"csv", required_argument, 0, 'c'},
+      {"top", required_argument, 0, 'T'},
+      {"help", no_argument, 0, 'h'},
+      {0, 0, 0, 0}};
+  long randomCount = 0;
+  uint64_t seed = 1;
+  SweepRange strideLength = {10, 40, 4};
+  SweepRange strideHeight = {5, 25, 3};
+  SweepRange incline = {-0.4f, 0.4f, 3};
+  SweepRange speed = {0.2f, 0.8f, 4};
+  std::vector<int> patterns;
+  parsePatterns("all", &patterns);
+  bool randomLags = false;
+  double seconds = SWEEP_DEFAULT_SECONDS;
+  double settleSeconds = SWEEP_DEFAULT_SETTLE_SECONDS;
+  int rateHz = CONTROL_LOOP_RATE_DEFAULT_HZ;
+  int threadCount = std::thread::hardware_concurrency();
+  int phaseSource = PHASE_SOURCE_OSCILLATOR;
+  bool keyframeCache = true;
+  bool footSpace = false;
+  const char *calibrationPath = NULL;
+  const char *csvPath = NULL;
+  int top = SWEEP_DEFAULT_TOP;
+
+  int option;
+  bool valid = true;
+  while ((option = getopt_long(argc, argv, "n:e:L:H:i:v:w:as:S:r:t:glfk:c:T:h", longOptions, NULL)) != -1) {
+    switch (option) {
+    case 'n':
+      randomCount = atol(optarg);
+      valid &= randomCount > 0;
+      break;
+    case 'e':
+      seed = strtoull(optarg, NULL, 0);
+      break;
+    case 'L':
+      valid &= parseRange(optarg, &strideLength);
+      break;
+    case 'H':
+      valid &= parseRange(optarg, &strideHeight);
+      break;
+    case 'i':
+      valid &= parseRange(optarg, &incline);
+      break;
+    case 'v':
+      valid &= parseRange(optarg, &speed);
+      break;
+    case 'w':
+      valid &= parsePatterns(optarg, &patterns);
+      break;
+    case 'a':
+      randomLags = true;
+      break;
+    case 's':
+      seconds = atof(optarg);
+      break;
+    case 'S':
+      settleSeconds = atof(optarg);
+      break;
+    case 'r':
+      rateHz = atoi(optarg);
+      break;
+    case 't':
+      threadCount = atoi(optarg);
+      break;
+    case 'g':
+      phaseSource = PHASE_SOURCE_CPG;
+      break;
+    case 'l':
+      keyframeCache = false;
+      break;
+    case 'f':
+      footSpace = true;
+      break;
+    case 'k':
+      calibrationPath = optarg;
+      break;
+    case 'c':
+      csvPath = optarg;
+      break;
+    case 'T':
+      top = atoi(optarg);
+      break;
+    default:
+      valid = false;
+      break;
+    }
+  }
+  if (threadCount < 1) {
+    threadCount = 1;
+  }
+  if (!valid || seconds <= 0 || settleSeconds < 0 || rateHz < CONTROL_LOOP_RATE_MIN_HZ ||
+      rateHz > CONTROL_LOOP_RATE_MAX_HZ || threadCount > SWEEP_MAX_THREADS || (randomLags && randomCount == 0)) {
+    printUsage(argv[0]);
+    return 2;
+  }
+
+  std::vector<SweepConfig> configs;
+  if (randomCount > 0) {
+    uint64_t state = seed;
+    for (long i = 0; i < randomCount; i++) {
+      SweepConfig config;
+      config.strideLength = randomBetween(&state, strideLength.min, strideLength.max);
+      config.strideHeight = randomBetween(&state, strideHeight.min, strideHeight.max);
+      config.incline = randomBetween(&state, incline.min, incline.max);
+      config.speed = randomBetween(&state, speed.min, speed.max);
+      config.pattern = randomLags ? SWEEP_CUSTOM_LAGS : patterns[nextRandom(&state) % patterns.size()];
+      for (int leg = 0; leg < LEG_COUNT; leg++) {
+        // Only the offsets between the legs matter, leg 0 is the reference
+        config.lags[leg] = config.pattern != SWEEP_CUSTOM_LAGS ? gaitPatternLag(config.pattern, leg)
+                                                               : (leg == 0 ? 0.0f : randomBetween(&state, 0, 1));
+      }
+      configs.push_back(config);
+    }
+  } else {
+    for (size_t p = 0; p < patterns.size(); p++)
+      for (int l = 0; l < strideLength.count; l++)
+        for (int h = 0; h < strideHeight.count; h++)
+          for (int c = 0; c < incline.count; c++)
+            for (int v = 0; v < speed.count; v++) {
+              SweepConfig config;
+              config.strideLength = strideLength.at(l);
+              config.strideHeight = strideHeight.at(h);
+              config.incline = incline.at(c);
+              config.speed = speed.at(v);
+              config.pattern = patterns[p];
+              for (int leg = 0; leg < LEG_COUNT; leg++) {
+                config.lags[leg] = gaitPatternLag(config.pattern, leg);
+              }
+              configs.push_back(config);
+            }
+  }
+
+  SweepSettings settings;
+  settings.rateHz = rateHz;
+  settings.settleTicks = (long)(settleSeconds * rateHz);
+  settings.measuredTicks = (long)(seconds * rateHz);
+  settings.phaseSource = phaseSource;
+  settings.keyframeCache = keyframeCache;
+  settings.footSpace = footSpace;
+  if (settings.measuredTicks < 2) {
+    printUsage(argv[0]);
+    return 2;
+  }
+  if ((size_t)threadCount > configs.size()) {
+    threadCount = configs.size();
+  }
+
+  if (calibrationPath != NULL) {
+    if (servoCalibrationLoad(calibrationPath) < 0) {
+      return 1;
+    }
+  } else {
+    servoCalibrationLoadDefaults();
+  }
+  // The first GaitControl fills the shared lookup tables, before any worker runs
+  GaitControl *tables = new GaitControl();
+  delete tables;
+  // What servoDriverInit would have put out, the sweep never opens the driver
+  uint16_t initialPositions[SERVO_COUNT];
+  servoDriverPowerUpPose(initialPositions);
+
+  printf("Sweeping %zu configurations, %g + %g s at %d Hz each, on %d threads%s%s%s\n", configs.size(),
+         settleSeconds, seconds, rateHz, threadCount, phaseSource == PHASE_SOURCE_CPG ? ", CPG" : "",
+         keyframeCache ? "" : ", live gait", footSpace ? ", foot space" : "");
+  std::vector<SweepResult> results(configs.size());
+  SweepPool pool(threadCount, configs.size());
+  int64_t startNanos = monotonicNanos();
+  std::vector<std::thread> workers;
+  for (int i = 0; i < threadCount; i++) {
+    workers.push_back(std::thread(workerLoop, &pool, i, &configs, &settings, initialPositions, &results));
+  }
+  for (size_t i = 0; i < workers.size(); i++) {
+    workers[i].join();
+  }
+  double elapsedSeconds = (double)(monotonicNanos() - startNanos) / NANOS_PER_SECOND;
+
+  uint64_t hash = FNV_OFFSET_BASIS;
+  for (size_t i = 0; i < results.size(); i++) {
+    const uint8_t *bytes = (const uint8_t *)&results[i].metrics;
+    for (size_t b = 0; b < sizeof(GaitMetrics); b++) {
+      hash = (hash ^ bytes[b]) * FNV_PRIME;
+    }
+    hash = (hash ^ results[i].unreachable) * FNV_PRIME;
+  }
+  long ticks = (settings.settleTicks + settings.measuredTicks) * (long)configs.size();
+  printf("%.2f s wall, %.0f configurations/s, %.1f M ticks/s, %u steals, checksum %016llx\n", elapsedSeconds,
+         configs.size() / elapsedSeconds, ticks / elapsedSeconds / 1e6, pool.getSteals(),
+         (unsigned long long)hash);
+
+  std::vector<uint32_t> order(configs.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  // Ties go to the lower index, so the tables do not depend on the sort either
+  std::sort(order.begin(), order.end(), [&results](uint32_t a, uint32_t b) {
+    float speedA = results[a].metrics.forwardSpeed, speedB = results[b].metrics.forwardSpeed;
+    return speedA != speedB ? speedA > speedB : a < b;
+  });
+  printTop("Fastest forward", order, configs, results, top);
+  std::sort(order.begin(), order.end(), [&results](uint32_t a, uint32_t b) {
+    float efficiencyA = efficiency(&results[a]), efficiencyB = efficiency(&results[b]);
+    return efficiencyA != efficiencyB ? efficiencyA > efficiencyB : a < b;
+  });
+  printTop("Most forward travel per servo degree", order, configs, results, top);
+
+  if (csvPath != NULL && writeCsv(csvPath, configs, results) < 0) {
+    return 1;
+  }
+  return 0;
+}
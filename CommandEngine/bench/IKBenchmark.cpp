@@ -0,0 +1,128 @@
+/*!
+ * Times LegKinematics::inverse, batched over all legs, against the same solve with libm
+ * asin, and checks the round trip: every target of a grid over the reachable foot space
+ * is solved and put through double precision forward kinematics, the foot has to land
+ * within KINEMATICS_MAX_ERROR_MM of the target. Out of reach targets have to be reported.
+ * Usage: IKBenchmark [calls] [gridSteps]
+ * */
+#include "../ControlLoop.h"
+#include "../LegKinematics.h"
+#include "../gait.h"
+#include <cmath>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Target sets cycled through by the timing runs, one gait cycle
+#define BENCHMARK_TARGET_SETS 64
+// Degrees, the joint space extremes the targets are built from
+#define BENCHMARK_STRIDE_DEGREES 40.0f
+#define BENCHMARK_HEIGHT_DEGREES 20.0f
+
+volatile float sink;
+
+/*!
+ * The same solve as LegKinematics::inverse with libm arcsine
+ * */
+void libmInverse(float coxa, float femur, const float *strideMm, const float *liftMm, float *yawDegrees,
+                 float *liftDegrees, int count) {
+  const float degreesPerRadian = 180 / M_PI;
+  for (int i = 0; i < count; i++) {
+    float liftSin = fmaxf(-1.0f, fminf(1.0f, liftMm[i] / femur));
+    float reach = coxa + femur * sqrtf(1.0f - liftSin * liftSin);
+    float yawSin = fmaxf(-1.0f, fminf(1.0f, strideMm[i] / reach));
+    liftDegrees[i] = asinf(liftSin) * degreesPerRadian;
+    yawDegrees[i] = asinf(yawSin) * degreesPerRadian;
+  }
+}
+
+void forwardExact(double coxa, double femur, float yawDegrees, float liftDegrees, double *strideMm, double *liftMm) {
+  double yaw = yawDegrees * M_PI / 180, lift = liftDegrees * M_PI / 180;
+  *strideMm = (coxa + femur * cos(lift)) * sin(yaw);
+  *liftMm = femur * sin(lift);
+}
+
+int main(int argc, char *argv[]) {
+  long calls = argc > 1 ? atol(argv[1]) : 1000000;
+  int gridSteps = argc > 2 ? atoi(argv[2]) : 400;
+  LegKinematics kinematics;
+  float coxa = kinematics.getCoxa(), femur = kinematics.getFemur();
+
+  // Targets along the foot space gait, each leg half a cycle from its neighbour
+  static float strideMm[BENCHMARK_TARGET_SETS][LEG_COUNT], liftMm[BENCHMARK_TARGET_SETS][LEG_COUNT];
+  float strideAmplitude = kinematics.strideForAngle(BENCHMARK_STRIDE_DEGREES);
+  float liftAmplitude = kinematics.liftForAngle(BENCHMARK_HEIGHT_DEGREES);
+  for (int set = 0; set < BENCHMARK_TARGET_SETS; set++) {
+    for (int i = 0; i < LEG_COUNT; i++) {
+      double phase = TWO_PI * set / BENCHMARK_TARGET_SETS + M_PI * i;
+      strideMm[set][i] = strideAmplitude * cos(phase);
+      liftMm[set][i] = liftAmplitude * sin(phase);
+    }
+  }
+
+  // Timing
+  float yawDegrees[LEG_COUNT], liftDegrees[LEG_COUNT];
+  int unreachable = 0;
+  int64_t start = monotonicNanos();
+  for (long call = 0; call < calls; call++) {
+    int set = call % BENCHMARK_TARGET_SETS;
+    unreachable += kinematics.inverse(strideMm[set], liftMm[set], yawDegrees, liftDegrees, LEG_COUNT);
+    sink = yawDegrees[0] + liftDegrees[LEG_COUNT - 1];
+  }
+  int64_t tableNanos = monotonicNanos() - start;
+  start = monotonicNanos();
+  for (long call = 0; call < calls; call++) {
+    int set = call % BENCHMARK_TARGET_SETS;
+    libmInverse(coxa, femur, strideMm[set], liftMm[set], yawDegrees, liftDegrees, LEG_COUNT);
+    sink = yawDegrees[0] + liftDegrees[LEG_COUNT - 1];
+  }
+  int64_t libmNanos = monotonicNanos() - start;
+  long solves = calls * LEG_COUNT;
+  printf("legs: coxa %.1f mm, femur %.1f mm, %d per call, %ld calls\n", coxa, femur, LEG_COUNT, calls);
+  printf("table: %8.2f ns/leg, %6.2f M solves/s, %8.2f ns/call\n", (double)tableNanos / solves,
+         solves / (tableNanos / 1e3), (double)tableNanos / calls);
+  printf("libm:  %8.2f ns/leg, %6.2f M solves/s, %8.2f ns/call\n", (double)libmNanos / solves,
+         solves / (libmNanos / 1e3), (double)libmNanos / calls);
+
+  // Round trip over a grid, lift up to just short of the femur, stride up to just short of the reach there
+  double worstError = 0, worstStride = 0, worstLift = 0;
+  for (int liftStep = 0; liftStep <= gridSteps; liftStep++) {
+    float lift = femur * (0.999f * (2.0f * liftStep / gridSteps - 1));
+    float reach = coxa + sqrtf(femur * femur - lift * lift);
+    float rowStride[LEG_COUNT], rowLift[LEG_COUNT];
+    for (int strideStep = 0; strideStep <= gridSteps; strideStep += LEG_COUNT) {
+      for (int i = 0; i < LEG_COUNT; i++) {
+        int step = strideStep + i < gridSteps ? strideStep + i : gridSteps;
+        rowStride[i] = reach * (0.999f * (2.0f * step / gridSteps - 1));
+        rowLift[i] = lift;
+      }
+      unreachable += kinematics.inverse(rowStride, rowLift, yawDegrees, liftDegrees, LEG_COUNT);
+      for (int i = 0; i < LEG_COUNT; i++) {
+        double footStride, footLift;
+        forwardExact(coxa, femur, yawDegrees[i], liftDegrees[i], &footStride, &footLift);
+        double error = hypot(footStride - rowStride[i], footLift - rowLift[i]);
+        if (error > worstError) {
+          worstError = error;
+          worstStride = rowStride[i];
+          worstLift = rowLift[i];
+        }
+      }
+    }
+  }
+  printf("round trip max error: %.3g mm at stride %.2f mm, lift %.2f mm (bound %.3g)\n", worstError, worstStride,
+         worstLift, KINEMATICS_MAX_ERROR_MM);
+  printf("reachable targets reported out of reach: %d\n", unreachable);
+
+  // A target out of reach is reported and solved for a point the leg can reach
+  float farStride[LEG_COUNT], farLift[LEG_COUNT];
+  for (int i = 0; i < LEG_COUNT; i++) {
+    farStride[i] = (i % 2 == 0 ? 2 : 0) * (coxa + femur);
+    farLift[i] = (i % 2 == 0 ? 0 : -2) * femur;
+  }
+  int farCount = kinematics.inverse(farStride, farLift, yawDegrees, liftDegrees, LEG_COUNT);
+  bool farSolved = true;
+  for (int i = 0; i < LEG_COUNT; i++) {
+    farSolved = farSolved && std::isfinite(yawDegrees[i]) && std::isfinite(liftDegrees[i]);
+  }
+  printf("out of reach targets reported: %d of %d\n", farCount, LEG_COUNT);
+  return worstError <= KINEMATICS_MAX_ERROR_MM && unreachable == 0 && farCount == LEG_COUNT && farSolved ? 0 : 1;
+}
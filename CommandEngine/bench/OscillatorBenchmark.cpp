@@ -0,0 +1,105 @@
+/*!
+ * Compares the float phase path of Leg::moveByPhase with the fixed point OscillatorBank.
+ * Reports ns per tick per leg for both and the worst error of each against a double
+ * precision reference, over the same simulated run.
+ * Usage: OscillatorBenchmark [ticks] [rateHz]
+ * */
+#include "../ControlLoop.h"
+#include "../Oscillator.h"
+#include <cmath>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BENCHMARK_LEGS 4
+#define BENCHMARK_SPEED 0.5f
+#define BENCHMARK_INCLINE 0.3f
+#define TWO_PI (2 * M_PI)
+
+static const float phaseOffsets[BENCHMARK_LEGS] = {0, M_PI, M_PI, 2 * M_PI};
+static const int directions[BENCHMARK_LEGS] = {1, 1, -1, -1};
+
+volatile float sink;
+
+/*!
+ * The math of Leg::moveByPhase, without the servo writes
+ * */
+int64_t runFloatPath(long ticks, float deltaPhase, float *phaseAngle, float *cosOut, float *sinOut) {
+  float inclineAngle = (M_PI / 4) * BENCHMARK_INCLINE;
+  int64_t start = monotonicNanos();
+  for (long tick = 0; tick < ticks; tick++) {
+    for (int i = 0; i < BENCHMARK_LEGS; i++) {
+      phaseAngle[i] += deltaPhase * directions[i];
+      float offsettedPhaseAngle = phaseAngle[i] + phaseOffsets[i];
+      offsettedPhaseAngle = fmodf(fmodf(offsettedPhaseAngle, TWO_PI) + TWO_PI, TWO_PI);
+      cosOut[i] = cos(offsettedPhaseAngle);
+      sinOut[i] = sin(offsettedPhaseAngle + inclineAngle);
+    }
+    sink = cosOut[0] + sinOut[BENCHMARK_LEGS - 1];
+  }
+  return monotonicNanos() - start;
+}
+
+int64_t runFixedPath(long ticks, float deltaPhase, OscillatorBank *bank, float *cosOut, float *sinOut) {
+  uint32_t inclinePhase = radiansToPhase((M_PI / 4) * BENCHMARK_INCLINE);
+  int64_t start = monotonicNanos();
+  for (long tick = 0; tick < ticks; tick++) {
+    bank->advance(deltaPhase);
+    bank->evaluate();
+    float sinIncline = phaseSin(inclinePhase);
+    float cosIncline = phaseCos(inclinePhase);
+    for (int i = 0; i < BENCHMARK_LEGS; i++) {
+      cosOut[i] = bank->cosOut[i];
+      sinOut[i] = bank->sinOut[i] * cosIncline + bank->cosOut[i] * sinIncline;
+    }
+    sink = cosOut[0] + sinOut[BENCHMARK_LEGS - 1];
+  }
+  return monotonicNanos() - start;
+}
+
+int main(int argc, char *argv[]) {
+  long ticks = argc > 1 ? atol(argv[1]) : 1000000;
+  int rateHz = argc > 2 ? atoi(argv[2]) : 100;
+  float deltaPhase = TWO_PI * (BENCHMARK_SPEED * (1.0f / rateHz) * 10);
+
+  float phaseAngle[BENCHMARK_LEGS] = {0};
+  float floatCos[BENCHMARK_LEGS], floatSin[BENCHMARK_LEGS];
+  float fixedCos[BENCHMARK_LEGS], fixedSin[BENCHMARK_LEGS];
+  OscillatorBank bank;
+  bank.setCount(BENCHMARK_LEGS);
+  for (int i = 0; i < BENCHMARK_LEGS; i++) {
+    bank.setOscillator(i, phaseOffsets[i], directions[i]);
+  }
+
+  // Timing
+  int64_t floatNanos = runFloatPath(ticks, deltaPhase, phaseAngle, floatCos, floatSin);
+  int64_t fixedNanos = runFixedPath(ticks, deltaPhase, &bank, fixedCos, fixedSin);
+  printf("ticks: %ld at %d Hz, %d legs\n", ticks, rateHz, BENCHMARK_LEGS);
+  printf("float path: %8.2f ns/tick/leg\n", (double)floatNanos / ticks / BENCHMARK_LEGS);
+  printf("fixed path: %8.2f ns/tick/leg\n", (double)fixedNanos / ticks / BENCHMARK_LEGS);
+
+  // Accuracy, one tick at a time against a double precision phase
+  for (int i = 0; i < BENCHMARK_LEGS; i++) {
+    phaseAngle[i] = 0;
+    bank.setPhase(i, 0);
+  }
+  double inclineAngle = (M_PI / 4) * BENCHMARK_INCLINE;
+  double exactDelta = (double)radiansToPhase(deltaPhase) * (TWO_PI / 4294967296.0);
+  double floatError = 0, fixedError = 0;
+  for (long tick = 1; tick <= ticks; tick++) {
+    runFloatPath(1, deltaPhase, phaseAngle, floatCos, floatSin);
+    runFixedPath(1, deltaPhase, &bank, fixedCos, fixedSin);
+    for (int i = 0; i < BENCHMARK_LEGS; i++) {
+      // The fixed path quantizes the per tick step, compare each path with the exact
+      // phase it is trying to follow
+      double floatPhase = fmod((double)deltaPhase * tick * directions[i] + phaseOffsets[i], TWO_PI);
+      double fixedPhase = fmod(exactDelta * tick * directions[i] + phaseOffsets[i], TWO_PI);
+      floatError = fmax(floatError, fabs(cos(floatPhase) - floatCos[i]));
+      floatError = fmax(floatError, fabs(sin(floatPhase + inclineAngle) - floatSin[i]));
+      fixedError = fmax(fixedError, fabs(cos(fixedPhase) - fixedCos[i]));
+      fixedError = fmax(fixedError, fabs(sin(fixedPhase + inclineAngle) - fixedSin[i]));
+    }
+  }
+  printf("float path max error: %.3g (accumulated phase drift over %.0f s)\n", floatError, (double)ticks / rateHz);
+  printf("fixed path max error: %.3g (bound %.3g)\n", fixedError, 2 * OSCILLATOR_MAX_ERROR);
+  return fixedError <= 2 * OSCILLATOR_MAX_ERROR ? 0 : 1;
+}
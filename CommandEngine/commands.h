@@ -1,6 +1,9 @@
 #ifndef _COMMANDS_H
 #define _COMMANDS_H
 
+// Legacy format: two bitmask bytes, see below
+#define COMMAND_SIZE 2
+
 // Byte 0
 #define TRANSLATE_FORWARD      0b00000010
 #define TRANSLATE_BACKWARD     0b00000001
@@ -24,4 +27,28 @@
 #define INCREMENT_INCLINE         0b00010000
 #define DECREMENT_INCLINE         0b00100000
 
+/*
+ * Protocol v2, COMMAND_V2_SIZE bytes, multi byte fields little endian:
+ *   0  uint8   magic, COMMAND_V2_MAGIC
+ *   1  uint8   version, COMMAND_VERSION_2
+ *   2  uint8   events, same bits as byte 1 of the legacy format
+ *   3  uint8   keys, same bits as byte 0 of the legacy format. Only the camera bits
+ *              are used, translation and turning come from velocity and turn.
+ *   4  uint32  sequence number, incremented by one per datagram
+ *   8  uint64  sender timestamp in microseconds, any clock that does not jump
+ *   16 int16   velocity, -32767 (full backward) to 32767 (full forward)
+ *   18 int16   turn rate, -32767 (in place left) to 32767 (in place right)
+ *   20 uint8   stride length in degrees, 0 keeps the current one
+ *   21 uint8   stride height in degrees, 0 keeps the current one
+ *   22 uint16  reserved, 0
+ * Legacy datagrams (exactly COMMAND_SIZE bytes) are still accepted on the same port.
+ */
+#define COMMAND_V2_SIZE 24
+#define COMMAND_V2_MAGIC 0x50
+#define COMMAND_VERSION_LEGACY 1
+#define COMMAND_VERSION_2 2
+#define COMMAND_V2_AXIS_MAX 32767
+// Largest datagram the receiver reads, anything longer is rejected as truncated
+#define COMMAND_MAX_SIZE 64
+
 #endif
@@ -1,18 +1,28 @@
 #include "gait.h"
 #include <cmath>
-#include <unistd.h>
 #include "ServoDriver.h"
+#include "ServoCalibration.h"
+#include "Trajectory.h"
 #include <iostream>
 
 using namespace std;
 
 
-char *servoPositions;
+// Static, so the frame is there (and locked with the rest) before anything runs
+static uint16_t servoPositionStorage[SERVO_COUNT];
+uint16_t *servoPositions = servoPositionStorage;
 
-CameraServo::CameraServo() {
-    this->servoIndex = SERVO_COUNT - 1;
+static_assert(LEG_COUNT % 2 == 0, "legs come in left / right pairs");
+static_assert(SERVO_COUNT > 2 * LEG_COUNT, "two servos per leg and at least one camera servo");
+static_assert(LEG_COUNT <= OSCILLATOR_MAX_COUNT && LEG_COUNT <= CPG_MAX_OSCILLATORS, "one oscillator per leg");
+
+CameraServo::CameraServo() : CameraServo(SERVO_COUNT - 1) {
+}
+
+CameraServo::CameraServo(uint8_t servoIndex) {
+    this->servoIndex = servoIndex;
     this->servoPos = 0;
-    // servoPositions[this->servoIndex] = (uint8_t) (this->servoPos + this->servoPosMax);
+    // servoPositions[this->servoIndex] = servoAngleToTicks(this->servoIndex, this->servoPos + this->servoPosMax);
 }
 
 void CameraServo::stepLeft() {
@@ -20,7 +30,16 @@ void CameraServo::stepLeft() {
     if (this->servoPos < -this->servoPosMax) {
         this->servoPos = -this->servoPosMax;
     }
-    servoPositions[this->servoIndex] = (uint8_t) (this->servoPos + this->servoPosMax);
+    servoTrajectories.moveTo(this->servoIndex, servoAngleToTicks(this->servoIndex, this->servoPos + this->servoPosMax),
+                             CAMERA_STEP_NANOS, TRAJECTORY_MINIMUM_JERK);
+}
+
+int CameraServo::getPosition() {
+    return this->servoPos;
+}
+
+void CameraServo::setPosition(int position) {
+    this->servoPos = max(-this->servoPosMax, min(this->servoPosMax, position));
 }
 
 void CameraServo::stepRight() {
@@ -28,10 +47,12 @@ void CameraServo::stepRight() {
     if (this->servoPos > this->servoPosMax) {
         this->servoPos = this->servoPosMax;
     }
-    servoPositions[this->servoIndex] = (uint8_t) (this->servoPos + this->servoPosMax);
+    servoTrajectories.moveTo(this->servoIndex, servoAngleToTicks(this->servoIndex, this->servoPos + this->servoPosMax),
+                             CAMERA_STEP_NANOS, TRAJECTORY_MINIMUM_JERK);
 }
 
 Leg::Leg() {
+    this->setOutput(servoPositions, &gaitCacheStats);
 }
 
 Leg::Leg(uint8_t legNumber, float phaseAngleOffset) {
@@ -39,17 +60,18 @@ Leg::Leg(uint8_t legNumber, float phaseAngleOffset) {
     this->servoXIndex = this->servoZIndex + 1;
     this->phaseAngleOffset = phaseAngleOffset;
     this->strideDirection = LEG_DIRECTION_FORWARD;
+    this->setOutput(servoPositions, &gaitCacheStats);
 }
 
 
-void Leg::moveLegTo_Z(int angle) {
-    servoPositions[this->servoZIndex] = (uint8_t)(angle + this->maxStrideLength + this->zOpenPos);
-    // cout << "Z: " << (unsigned int)servoPositions[this->servoZIndex] << '\n';
+void Leg::moveLegTo_Z(float angle) {
+    this->frame[this->servoZIndex] = servoAngleToTicks(this->servoZIndex, angle + this->maxStrideLength + this->zOpenPos);
+    // cout << "Z: " << this->frame[this->servoZIndex] << '\n';
 }
 
 
-void Leg::moveLegTo_X(int angle) {
-    servoPositions[this->servoXIndex] = (uint8_t)(angle + this->maxStrideHeight + this->xOpenPos);
+void Leg::moveLegTo_X(float angle) {
+    this->frame[this->servoXIndex] = servoAngleToTicks(this->servoXIndex, angle + this->maxStrideHeight + this->xOpenPos);
 }
 
 void Leg::moveByPhase(float deltaPhaseAngle, float incline) {
@@ -58,13 +80,77 @@ void Leg::moveByPhase(float deltaPhaseAngle, float incline) {
     // Normalize to prevent overflows
     offsettedPhaseAngle = fmodf(fmodf(offsettedPhaseAngle, TWO_PI) + TWO_PI, TWO_PI);
     // cout << "Phase angle for leg: " << offsettedPhaseAngle << '\n';
-    // Convert to degrees
-    int zPos = this->currentStrideLength * cos(offsettedPhaseAngle);
-    int xPos = this->currentStrideHeight * sin(offsettedPhaseAngle + ((M_PI / 4) * incline));
+    // Convert to degrees, kept fractional for the calibration tables
+    float zPos = this->currentStrideLength * cos(offsettedPhaseAngle);
+    float xPos = this->currentStrideHeight * sin(offsettedPhaseAngle + ((M_PI / 4) * incline));
+    this->moveLegTo_Z(zPos);
+    this->moveLegTo_X(xPos);
+}
+
+void Leg::moveBySinCos(float sinPhase, float cosPhase, float sinIncline, float cosIncline) {
+    // sin(phase + inclineAngle) expanded, so the incline costs no extra table lookup per leg
+    float zPos = this->currentStrideLength * cosPhase;
+    float xPos = this->currentStrideHeight * (sinPhase * cosIncline + cosPhase * sinIncline);
     this->moveLegTo_Z(zPos);
     this->moveLegTo_X(xPos);
 }
 
+void Leg::footTarget(LegKinematics *kinematics, float sinPhase, float cosPhase, float sinIncline, float cosIncline,
+                     float *strideMm, float *liftMm) {
+    // Same shape as moveBySinCos, with the amplitudes the joint space stride reaches at its ends
+    *strideMm = kinematics->strideForAngle(this->currentStrideLength) * cosPhase;
+    *liftMm = kinematics->liftForAngle(this->currentStrideHeight) * (sinPhase * cosIncline + cosPhase * sinIncline);
+}
+
+void Leg::moveToJointAngles(float yawDegrees, float liftDegrees) {
+    this->moveLegTo_Z(yawDegrees);
+    this->moveLegTo_X(liftDegrees);
+}
+
+void Leg::setOutput(uint16_t *frame, GaitCacheStats *cacheStats) {
+    this->frame = frame;
+    this->cacheStats = cacheStats;
+}
+
+void Leg::moveByKeyframes(uint32_t offsetPhase, uint32_t inclinePhase) {
+    if (this->keyframesCurrent) {
+        this->frame[this->servoZIndex] = this->zTrajectory.sample(offsetPhase);
+        this->frame[this->servoXIndex] = this->xTrajectory.sample(offsetPhase);
+        this->cacheStats->playbacks += 2;
+        return;
+    }
+    // cos(phase) is sin(phase + pi / 2)
+    bool zCurrent = this->zTrajectory.evaluate(
+        this->servoZIndex, this->currentStrideLength, this->maxStrideLength + this->zOpenPos,
+        OSCILLATOR_QUARTER_TURN, offsetPhase, &this->frame[this->servoZIndex], this->cacheStats);
+    bool xCurrent = this->xTrajectory.evaluate(
+        this->servoXIndex, this->currentStrideHeight, this->maxStrideHeight + this->xOpenPos,
+        inclinePhase, offsetPhase, &this->frame[this->servoXIndex], this->cacheStats);
+    this->keyframesCurrent = zCurrent && xCurrent;
+}
+
+void Leg::invalidateKeyframes() {
+    this->zTrajectory.invalidate();
+    this->xTrajectory.invalidate();
+    this->keyframesCurrent = false;
+}
+
+void Leg::markKeyframesStale() {
+    this->keyframesCurrent = false;
+}
+
+float Leg::getPhaseAngleOffset() {
+    return this->phaseAngleOffset;
+}
+
+void Leg::setPhaseAngleOffset(float phaseAngleOffset) {
+    this->phaseAngleOffset = phaseAngleOffset;
+}
+
+int Leg::getStrideDirection() {
+    return this->strideDirection;
+}
+
 void Leg::setDirectionForward() {
     this->strideDirection = LEG_DIRECTION_FORWARD;
 }
@@ -86,6 +172,9 @@ bool Leg::isEnabled() {
 }
 
 void Leg::setStrideHeight(float strideHeight) {
+    if (strideHeight != this->maxStrideHeight) {
+        this->keyframesCurrent = false;
+    }
     this->maxStrideHeight = strideHeight;
 }
 
@@ -94,6 +183,9 @@ float Leg::getStrideHeight() {
 }
 
 void Leg::setStrideLength(float strideLength) {
+    if (strideLength != this->maxStrideLength) {
+        this->keyframesCurrent = false;
+    }
     this->maxStrideLength = strideLength;
 }
 
@@ -101,12 +193,32 @@ float Leg::getStrideLength() {
     return this->maxStrideLength;
 }
 
+float Leg::getZCenter() {
+    return this->maxStrideLength + this->zOpenPos;
+}
+
+float Leg::getXCenter() {
+    return this->maxStrideHeight + this->xOpenPos;
+}
+
+void Leg::moveServoTo(int channel, float angle) {
+    servoTrajectories.moveTo(channel, servoAngleToTicks(channel, angle), LEG_TRANSITION_DELAY_NANOS, TRAJECTORY_MINIMUM_JERK);
+}
+
+float Leg::getCurrentStrideLength() {
+    return this->currentStrideLength;
+}
+
+float Leg::getCurrentStrideHeight() {
+    return this->currentStrideHeight;
+}
+
 void Leg::closeX() {
-    servoPositions[this->servoXIndex] = this->xClosedPos;
+    this->moveServoTo(this->servoXIndex, this->xClosedPos);
 }
 
 void Leg::closeZ() {
-    servoPositions[this->servoZIndex] = this->zClosedPos + this->maxStrideLength;
+    this->moveServoTo(this->servoZIndex, this->zClosedPos + this->maxStrideLength);
 }
 
 void Leg::closeLeg() {
@@ -121,11 +233,11 @@ void Leg::closeLeg() {
 }
 
 void Leg::openX() {
-    servoPositions[this->servoXIndex] = (this->xOpenPos + this->maxStrideHeight);
+    this->moveServoTo(this->servoXIndex, this->xOpenPos + this->maxStrideHeight);
 }
 
 void Leg::openZ() {
-    servoPositions[this->servoZIndex] = this->zOpenPos + this->maxStrideLength;
+    this->moveServoTo(this->servoZIndex, this->zOpenPos + this->maxStrideLength);
 }
 
 void Leg::openLeg() {
@@ -139,40 +251,113 @@ void Leg::openLeg() {
     }
 }
 
+/*!
+ * One acceleration step of value towards target, ending exactly on the target
+ * */
+static float approach(float value, float target) {
+    value += LEG_ACCELERATION_FACTOR * (target - value);
+    if (fabsf(target - value) < LEG_SETTLE_DEGREES) {
+        value = target;
+    }
+    return value;
+}
+
 void Leg::accelerateStrideLength(float maxStrideLength) {
-    this->currentStrideLength += LEG_ACCELERATION_FACTOR * (maxStrideLength - this->currentStrideLength);
+    this->updateStrideLength(approach(this->currentStrideLength, maxStrideLength));
 }
 
 void Leg::decelerateStrideLength() {
-    this->currentStrideLength += LEG_ACCELERATION_FACTOR * (0 - this->currentStrideLength);
+    this->updateStrideLength(approach(this->currentStrideLength, 0));
 }
 
 
 void Leg::accelerateStrideHeight(float maxStrideHeight) {
-	this->currentStrideHeight += LEG_ACCELERATION_FACTOR * (maxStrideHeight - this->currentStrideHeight);
+	this->updateStrideHeight(approach(this->currentStrideHeight, maxStrideHeight));
 }
 
 void Leg::decelerateStrideHeight() {
-	this->currentStrideHeight += LEG_ACCELERATION_FACTOR * (0 - this->currentStrideHeight);
-}
-
-
-GaitControl::GaitControl() {
-    this->legs.push_back(Leg(0, 0));
-    this->legs.push_back(Leg(1, M_PI));
-    this->legs.push_back(Leg(2, M_PI));
-    this->legs.push_back(Leg(3, M_PI + M_PI));
-    // for (int i = 0; i < LEG_COUNT; i++) {
-        // this->legs.push_back(Leg(i, (M_PI / 2) * i));
-	// this->legs[i].disableLeg();
-    // }
-    // this->legs[0].enableLeg();
-    this->legs[2].setDirectionBackward();
-    this->legs[3].setDirectionBackward();
+	this->updateStrideHeight(approach(this->currentStrideHeight, 0));
+}
+
+void Leg::setCurrentStride(float strideLength, float strideHeight) {
+    this->updateStrideLength(strideLength);
+    this->updateStrideHeight(strideHeight);
+}
+
+void Leg::updateStrideLength(float strideLength) {
+    if (strideLength != this->currentStrideLength) {
+        this->currentStrideLength = strideLength;
+        this->keyframesCurrent = false;
+    }
+}
+
+void Leg::updateStrideHeight(float strideHeight) {
+    if (strideHeight != this->currentStrideHeight) {
+        this->currentStrideHeight = strideHeight;
+        this->keyframesCurrent = false;
+    }
+}
+
+
+const char *gaitPatternName(int pattern) {
+    static const char *names[GAIT_PATTERN_COUNT] = {"trot", "walk", "pace", "bound"};
+    return pattern >= 0 && pattern < GAIT_PATTERN_COUNT ? names[pattern] : "unknown";
+}
+
+GaitControl::GaitControl() : GaitControl(servoPositions, &gaitCacheStats) {
+}
+
+GaitControl::GaitControl(uint16_t *frame, GaitCacheStats *cacheStats) {
+    // Left side first, then the right side, which is mounted mirrored
+    for (int i = 0; i < LEG_COUNT; i++) {
+        this->legs[i] = Leg(i, 0);
+        this->legs[i].setOutput(frame, cacheStats);
+        if (legSide(i) == 1) {
+            this->legs[i].setDirectionBackward();
+        }
+    }
+    this->oscillators.setCount(LEG_COUNT);
+    this->cpg.setCount(LEG_COUNT);
+    this->applyGaitPattern();
+    this->cpg.resetToLimitCycle(0);
     this->setDirection(TRANSLATION_DIRECTION_FORWARD);
     this->setGaitState(GAIT_STATE_STOP);
 }
 
+void GaitControl::applyGaitPattern() {
+    float lags[LEG_COUNT];
+    for (int i = 0; i < LEG_COUNT; i++) {
+        lags[i] = gaitPatternLag(this->gaitPattern, i);
+    }
+    this->setPhaseLags(lags);
+}
+
+void GaitControl::setPhaseLags(const float *lags) {
+    for (int i = 0; i < LEG_COUNT; i++) {
+        // Behind by the lag, a backward leg runs its phase mirrored so its offset is mirrored too
+        this->legs[i].setPhaseAngleOffset(-this->legs[i].getStrideDirection() * TWO_PI * lags[i]);
+        this->oscillators.setOscillator(
+            i,
+            this->legs[i].getPhaseAngleOffset(),
+            this->legs[i].isEnabled() ? this->legs[i].getStrideDirection() : 0);
+        // The CPG oscillators all turn the same way, a backward leg follows its
+        // oscillator mirrored (see updateGait), so its offset is mirrored too
+        this->cpg.setPhaseOffset(i, this->legs[i].getStrideDirection() * this->legs[i].getPhaseAngleOffset());
+    }
+}
+
+void GaitControl::setGaitPattern(int pattern) {
+    if (pattern < 0 || pattern >= GAIT_PATTERN_COUNT || pattern == this->gaitPattern) {
+        return;
+    }
+    this->gaitPattern = pattern;
+    this->applyGaitPattern();
+}
+
+int GaitControl::getGaitPattern() {
+    return this->gaitPattern;
+}
+
 void GaitControl::setGaitState(int state) {
     this->state = state;
 }
@@ -181,6 +366,50 @@ int GaitControl::getGaitState() {
 	return this->state;
 }
 
+void GaitControl::setPhaseSource(int source) {
+    if (source == PHASE_SOURCE_CPG && this->phaseSource != PHASE_SOURCE_CPG) {
+        // Leg i of the oscillator bank sits at direction_i * sharedPhase
+        float sharedPhase = phaseToRadians(this->oscillators.getPhase(0)) * this->legs[0].getStrideDirection();
+        this->cpg.resetToLimitCycle(sharedPhase);
+    } else if (source == PHASE_SOURCE_OSCILLATOR && this->phaseSource != PHASE_SOURCE_OSCILLATOR) {
+        uint32_t sharedPhase = radiansToPhase(this->cpg.getPhase(0) - this->legs[0].getStrideDirection() * this->legs[0].getPhaseAngleOffset());
+        for (int i = 0; i < LEG_COUNT; i++) {
+            this->oscillators.setPhase(i, sharedPhase * (uint32_t)this->legs[i].getStrideDirection());
+        }
+    }
+    this->phaseSource = source;
+}
+
+int GaitControl::getPhaseSource() {
+    return this->phaseSource;
+}
+
+void GaitControl::setKeyframeCache(bool enabled) {
+    this->keyframeCache = enabled;
+}
+
+bool GaitControl::getKeyframeCache() {
+    return this->keyframeCache;
+}
+
+void GaitControl::setFootSpace(bool enabled) {
+    this->footSpace = enabled;
+}
+
+bool GaitControl::getFootSpace() {
+    return this->footSpace;
+}
+
+uint32_t GaitControl::getUnreachableCount() {
+    return this->unreachableCount;
+}
+
+void GaitControl::invalidateKeyframes() {
+    for (int i = 0; i < LEG_COUNT; i++) {
+        this->legs[i].invalidateKeyframes();
+    }
+}
+
 void GaitControl::setSpeed(float speed) {
     this->speed = speed;
 }
@@ -194,64 +423,105 @@ void GaitControl::updateGait(float deltaTime) {
     if (this->state == GAIT_STATE_MOVE) {
         float deltaPhaseAngle = TWO_PI * (this->speed * deltaTime * 10) * this->translationDirection;
         // cout << deltaPhaseAngle << '\n';
+        uint32_t inclinePhase = radiansToPhase((M_PI / 4) * (this->incline + this->measuredIncline));
+        float sinIncline = phaseSin(inclinePhase);
+        float cosIncline = phaseCos(inclinePhase);
+        if (this->phaseSource == PHASE_SOURCE_CPG) {
+            // Same rate as the oscillators: deltaPhaseAngle per deltaTime
+            this->cpg.setFrequency(TWO_PI * this->speed * 10 * this->translationDirection);
+            this->cpg.step(deltaTime);
+            if (this->footSpace) {
+                float sinPhase[LEG_COUNT], cosPhase[LEG_COUNT];
+                for (int i = 0; i < LEG_COUNT; i++) {
+                    sinPhase[i] = this->legs[i].getStrideDirection() * this->cpg.getY(i);
+                    cosPhase[i] = this->cpg.getX(i);
+                }
+                this->moveFeet(sinPhase, cosPhase, sinIncline, cosIncline);
+                return;
+            }
+            for (int i = 0; i < LEG_COUNT; i++) {
+                if (this->legs[i].isEnabled()) {
+                    float direction = this->legs[i].getStrideDirection();
+                    this->legs[i].moveBySinCos(
+                        direction * this->cpg.getY(i), this->cpg.getX(i), sinIncline, cosIncline);
+                }
+            }
+            return;
+        }
+        this->oscillators.advance(deltaPhaseAngle);
+        if (this->keyframeCache && !this->footSpace) {
+            for (int i = 0; i < LEG_COUNT; i++) {
+                if (this->legs[i].isEnabled()) {
+                    this->legs[i].moveByKeyframes(this->oscillators.getOffsetPhase(i), inclinePhase);
+                }
+            }
+            return;
+        }
+        this->oscillators.evaluate();
+        if (this->footSpace) {
+            this->moveFeet(this->oscillators.sinOut, this->oscillators.cosOut, sinIncline, cosIncline);
+            return;
+        }
         for (int i = 0; i < LEG_COUNT; i++) {
             if (this->legs[i].isEnabled()) {
-                this->legs[i].moveByPhase(deltaPhaseAngle, this->incline);
+                this->legs[i].moveBySinCos(
+                    this->oscillators.sinOut[i], this->oscillators.cosOut[i], sinIncline, cosIncline);
             }
         }
     }
 }
 
-void GaitControl::accelerate() {
-    if (this->turnDirection == TURN_DIRECTION_NONE) {
-        for (int i = 0; i < LEG_COUNT; i++) {
-            this->legs[i].accelerateStrideLength(this->legs[i].getStrideLength());
-	    this->legs[i].accelerateStrideHeight(this->legs[i].getStrideHeight());
+void GaitControl::moveFeet(const float *sinPhase, const float *cosPhase, float sinIncline, float cosIncline) {
+    float strideMm[LEG_COUNT], liftMm[LEG_COUNT], yawDegrees[LEG_COUNT], liftDegrees[LEG_COUNT];
+    for (int i = 0; i < LEG_COUNT; i++) {
+        this->legs[i].footTarget(&this->kinematics, sinPhase[i], cosPhase[i], sinIncline, cosIncline,
+                                 &strideMm[i], &liftMm[i]);
+    }
+    // Disabled legs are solved along with the rest, cheaper than compacting, and not moved
+    this->unreachableCount += this->kinematics.inverse(strideMm, liftMm, yawDegrees, liftDegrees, LEG_COUNT);
+    for (int i = 0; i < LEG_COUNT; i++) {
+        if (this->legs[i].isEnabled()) {
+            this->legs[i].moveToJointAngles(yawDegrees[i], liftDegrees[i]);
         }
     }
-    else if (this->turnDirection == TURN_DIRECTION_LEFT) {
-        this->legs[0].accelerateStrideLength(this->legs[0].getStrideLength() / 2);
-        this->legs[1].accelerateStrideLength(this->legs[1].getStrideLength() / 2);
-        this->legs[2].accelerateStrideLength(this->legs[2].getStrideLength());
-        this->legs[3].accelerateStrideLength(this->legs[3].getStrideLength());
-        this->legs[0].accelerateStrideHeight(this->legs[0].getStrideHeight());
-        this->legs[1].accelerateStrideHeight(this->legs[1].getStrideHeight());
-        this->legs[2].accelerateStrideHeight(this->legs[2].getStrideHeight());
-        this->legs[3].accelerateStrideHeight(this->legs[3].getStrideHeight());
-
-    }
-    else if (this->turnDirection == TURN_DIRECTION_RIGHT) {
-        this->legs[0].accelerateStrideLength(this->legs[0].getStrideLength());
-        this->legs[1].accelerateStrideLength(this->legs[1].getStrideLength());
-        this->legs[2].accelerateStrideLength(this->legs[2].getStrideLength() / 2);
-        this->legs[3].accelerateStrideLength(this->legs[3].getStrideLength() / 2);
-        this->legs[0].accelerateStrideHeight(this->legs[0].getStrideHeight());
-        this->legs[1].accelerateStrideHeight(this->legs[1].getStrideHeight());
-        this->legs[2].accelerateStrideHeight(this->legs[2].getStrideHeight());
-        this->legs[3].accelerateStrideHeight(this->legs[3].getStrideHeight());
-
-    }
-    else if (this->turnDirection == TURN_DIRECTION_IN_PLACE_LEFT) {
-        this->legs[0].accelerateStrideLength(-this->legs[0].getStrideLength());
-        this->legs[1].accelerateStrideLength(-this->legs[1].getStrideLength());
-        this->legs[2].accelerateStrideLength(this->legs[2].getStrideLength());
-        this->legs[3].accelerateStrideLength(this->legs[3].getStrideLength());
-        this->legs[0].accelerateStrideHeight(this->legs[0].getStrideHeight());
-        this->legs[1].accelerateStrideHeight(this->legs[1].getStrideHeight());
-        this->legs[2].accelerateStrideHeight(this->legs[2].getStrideHeight());
-        this->legs[3].accelerateStrideHeight(this->legs[3].getStrideHeight());
-    
-    }
-    else if (this->turnDirection == TURN_DIRECTION_IN_PLACE_RIGHT) {
-        this->legs[0].accelerateStrideLength(this->legs[0].getStrideLength());
-        this->legs[1].accelerateStrideLength(this->legs[1].getStrideLength());
-        this->legs[2].accelerateStrideLength(-this->legs[2].getStrideLength());
-        this->legs[3].accelerateStrideLength(-this->legs[3].getStrideLength());
-        this->legs[0].accelerateStrideHeight(this->legs[0].getStrideHeight());
-        this->legs[1].accelerateStrideHeight(this->legs[1].getStrideHeight());
-        this->legs[2].accelerateStrideHeight(this->legs[2].getStrideHeight());
-        this->legs[3].accelerateStrideHeight(this->legs[3].getStrideHeight());
-    
+}
+
+static float clampUnit(float value) {
+    return value > 1.0f ? 1.0f : (value < -1.0f ? -1.0f : value);
+}
+
+/*!
+ * Velocity and turn of each discrete turn, indexed by TURN_DIRECTION_*
+ * */
+struct TurnScale {
+    float magnitude, turn;
+};
+
+static constexpr TurnScale turnScales[TURN_DIRECTION_CONTINUOUS] = {
+    {1.0f, -0.5f}, // TURN_DIRECTION_LEFT, halves the left side
+    {1.0f, 0.5f},  // TURN_DIRECTION_RIGHT
+    {0.0f, 1.0f},  // TURN_DIRECTION_IN_PLACE_RIGHT, reverses the right side
+    {0.0f, -1.0f}, // TURN_DIRECTION_IN_PLACE_LEFT
+    {1.0f, 0.0f},  // TURN_DIRECTION_NONE
+};
+
+void GaitControl::accelerate() {
+    // Differential steering: the left legs (first half) get velocity + turn and the
+    // right legs velocity - turn of their stride. The discrete turns are fixed points
+    // of it: a turn while walking halves one side, a turn in place reverses one side.
+    float magnitude, turn;
+    if (this->turnDirection == TURN_DIRECTION_CONTINUOUS) {
+        magnitude = this->velocityMagnitude;
+        turn = this->turnRate;
+    } else {
+        magnitude = turnScales[this->turnDirection].magnitude;
+        turn = turnScales[this->turnDirection].turn;
+    }
+    const float sideScales[2] = {clampUnit(magnitude + turn), clampUnit(magnitude - turn)};
+    for (int i = 0; i < LEG_COUNT; i++) {
+        float scale = sideScales[legSide(i)];
+        this->legs[i].accelerateStrideLength(scale * this->legs[i].getStrideLength());
+        this->legs[i].accelerateStrideHeight(this->legs[i].getStrideHeight());
     }
 }
 
@@ -262,37 +532,56 @@ void GaitControl::decelerate() {
     }
 }
 
-void GaitControl::openPebble() {
-    for (int i = 0; i < LEG_COUNT; i++) {
-        if (this->legs[i].isEnabled()) {
-            this->legs[i].openLeg();
-        }
-    }
-    servoDriverWriteCommands();
-    usleep(SERVO_COMMAND_DELAY_USECS);
+void GaitControl::stepLegs(bool open) {
     for (int i = 0; i < LEG_COUNT; i++) {
         if (this->legs[i].isEnabled()) {
-            this->legs[i].openLeg();
+            if (open) {
+                this->legs[i].openLeg();
+            } else {
+                this->legs[i].closeLeg();
+            }
         }
     }
-    servoDriverWriteCommands();
+}
+
+int GaitControl::openSequence(MotionTask *task) {
+    GaitControl *gait = (GaitControl *)task->context;
+    SEQUENCE_BEGIN(task);
+    gait->stepLegs(true);
+    SEQUENCE_WAIT_FOR(task, LEG_TRANSITION_DELAY_NANOS);
+    gait->stepLegs(true);
+    SEQUENCE_END(task);
+}
+
+int GaitControl::closeSequence(MotionTask *task) {
+    GaitControl *gait = (GaitControl *)task->context;
+    SEQUENCE_BEGIN(task);
+    gait->stepLegs(false);
+    SEQUENCE_WAIT_FOR(task, LEG_TRANSITION_DELAY_NANOS);
+    gait->stepLegs(false);
+    SEQUENCE_END(task);
+}
+
+void GaitControl::startLegTransition(MotionStep sequence) {
+    this->sequencer.cancel(this->legTransitionTask);
+    this->legTransitionTask = this->sequencer.start(sequence, this);
+}
+
+void GaitControl::openPebble() {
+    this->startLegTransition(openSequence);
 }
 
 
 void GaitControl::closePebble() {
-    for (int i = 0; i < LEG_COUNT; i++) {
-        if (this->legs[i].isEnabled()) {
-            this->legs[i].closeLeg();
-        }
-    }
-    servoDriverWriteCommands();
-    usleep(SERVO_COMMAND_DELAY_USECS);
-    for (int i = 0; i < LEG_COUNT; i++) {
-        if (this->legs[i].isEnabled()) {
-            this->legs[i].closeLeg();
-        }
-    }
-    servoDriverWriteCommands();
+    this->startLegTransition(closeSequence);
+}
+
+bool GaitControl::updateSequences(int64_t nowNanos) {
+    return this->sequencer.tick(nowNanos);
+}
+
+bool GaitControl::isTransitioning() {
+    return this->sequencer.isRunning(this->legTransitionTask);
 }
 
 
@@ -327,15 +616,137 @@ void GaitControl::decrementStrideLength() {
 void GaitControl::incrementIncline() {
     for (int i = 0; i < LEG_COUNT; i++) {
         this->incline += 0.1;
+        this->legs[i].markKeyframesStale();
     }
 }
 
 void GaitControl::decrementIncline() {
     for (int i = 0; i < LEG_COUNT; i++) {
         this->incline -= 0.1;
+        this->legs[i].markKeyframesStale();
+    }
+}
+
+void GaitControl::setMeasuredIncline(float incline) {
+    incline = clampUnit(incline);
+    if (fabsf(incline - this->measuredIncline) < GAIT_MEASURED_INCLINE_STEP) {
+        return;
+    }
+    this->measuredIncline = roundf(incline / GAIT_MEASURED_INCLINE_STEP) * GAIT_MEASURED_INCLINE_STEP;
+    for (int i = 0; i < LEG_COUNT; i++) {
+        this->legs[i].markKeyframesStale();
     }
 }
 
+float GaitControl::getMeasuredIncline() {
+    return this->measuredIncline;
+}
+
 void GaitControl::setTurnDirection(int dir) {
-	this->turnDirection = dir;
+	// Anything unknown walks straight
+	this->turnDirection = (dir >= 0 && dir <= TURN_DIRECTION_CONTINUOUS) ? dir : TURN_DIRECTION_NONE;
+}
+
+void GaitControl::setMotion(float velocity, float turnRate) {
+    if (velocity > 0) {
+        this->setDirection(TRANSLATION_DIRECTION_FORWARD);
+    } else if (velocity < 0) {
+        this->setDirection(TRANSLATION_DIRECTION_BACKWARD);
+    }
+    this->velocityMagnitude = fabsf(clampUnit(velocity));
+    this->turnRate = clampUnit(turnRate);
+    this->turnDirection = TURN_DIRECTION_CONTINUOUS;
+}
+
+void GaitControl::setStrideLength(float strideLength) {
+    for (int i = 0; i < LEG_COUNT; i++) {
+        this->legs[i].setStrideLength(strideLength);
+    }
+}
+
+uint32_t GaitControl::getLegPhase(int leg) {
+    if (this->phaseSource == PHASE_SOURCE_CPG) {
+        // Mirrored for backward legs, see updateGait
+        return radiansToPhase(atan2f(this->legs[leg].getStrideDirection() * this->cpg.getY(leg), this->cpg.getX(leg)));
+    }
+    return this->oscillators.getOffsetPhase(leg);
+}
+
+float GaitControl::getCurrentStrideLength(int leg) {
+    return this->legs[leg].getCurrentStrideLength();
+}
+
+float GaitControl::getCurrentStrideHeight(int leg) {
+    return this->legs[leg].getCurrentStrideHeight();
+}
+
+float GaitControl::getIncline() {
+    return this->incline;
+}
+
+void GaitControl::setIncline(float incline) {
+    this->incline = incline;
+    for (int i = 0; i < LEG_COUNT; i++) {
+        this->legs[i].markKeyframesStale();
+    }
+}
+
+float GaitControl::getLegZCenter(int leg) {
+    return this->legs[leg].getZCenter();
+}
+
+float GaitControl::getLegXCenter(int leg) {
+    return this->legs[leg].getXCenter();
+}
+
+void GaitControl::setStrideHeight(float strideHeight) {
+    for (int i = 0; i < LEG_COUNT; i++) {
+        this->legs[i].setStrideHeight(strideHeight);
+    }
+}
+
+void GaitControl::saveSnapshot(GaitSnapshot *snapshot) {
+    snapshot->state = this->state;
+    snapshot->translationDirection = this->translationDirection;
+    snapshot->turnDirection = this->turnDirection;
+    snapshot->gaitPattern = this->gaitPattern;
+    snapshot->phaseSource = this->phaseSource;
+    snapshot->keyframeCache = this->keyframeCache;
+    snapshot->footSpace = this->footSpace;
+    snapshot->incline = this->incline;
+    snapshot->speed = this->speed;
+    snapshot->velocityMagnitude = this->velocityMagnitude;
+    snapshot->turnRate = this->turnRate;
+    for (int i = 0; i < LEG_COUNT; i++) {
+        snapshot->oscillatorPhase[i] = this->oscillators.getPhase(i);
+        snapshot->cpgX[i] = this->cpg.getX(i);
+        snapshot->cpgY[i] = this->cpg.getY(i);
+        snapshot->strideLength[i] = this->legs[i].getStrideLength();
+        snapshot->strideHeight[i] = this->legs[i].getStrideHeight();
+        snapshot->currentStrideLength[i] = this->legs[i].getCurrentStrideLength();
+        snapshot->currentStrideHeight[i] = this->legs[i].getCurrentStrideHeight();
+    }
+}
+
+void GaitControl::restoreSnapshot(const GaitSnapshot *snapshot) {
+    this->setGaitPattern(snapshot->gaitPattern);
+    // Both phase sources are restored as they were, no conversion between them
+    this->phaseSource = snapshot->phaseSource == PHASE_SOURCE_CPG ? PHASE_SOURCE_CPG : PHASE_SOURCE_OSCILLATOR;
+    this->keyframeCache = snapshot->keyframeCache != 0;
+    this->footSpace = snapshot->footSpace != 0;
+    this->state = snapshot->state;
+    this->setDirection(snapshot->translationDirection);
+    this->setTurnDirection(snapshot->turnDirection);
+    this->incline = snapshot->incline;
+    this->speed = snapshot->speed;
+    this->velocityMagnitude = snapshot->velocityMagnitude;
+    this->turnRate = snapshot->turnRate;
+    for (int i = 0; i < LEG_COUNT; i++) {
+        this->oscillators.setPhase(i, snapshot->oscillatorPhase[i]);
+        this->cpg.setState(i, snapshot->cpgX[i], snapshot->cpgY[i]);
+        this->legs[i].setStrideLength(snapshot->strideLength[i]);
+        this->legs[i].setStrideHeight(snapshot->strideHeight[i]);
+        this->legs[i].setCurrentStride(snapshot->currentStrideLength[i], snapshot->currentStrideHeight[i]);
+        this->legs[i].markKeyframesStale();
+    }
 }
@@ -1,8 +1,13 @@
 #ifndef _GAIT_H
 #define _GAIT_H
 
-#include <vector>
+#include <array>
 #include <cstdint>
+#include "CPG.h"
+#include "GaitCache.h"
+#include "LegKinematics.h"
+#include "MotionSequencer.h"
+#include "Oscillator.h"
 
 #define TRANSLATION_DIRECTION_FORWARD 1
 #define TRANSLATION_DIRECTION_BACKWARD -1
@@ -11,22 +16,84 @@
 #define TURN_DIRECTION_IN_PLACE_RIGHT 2
 #define TURN_DIRECTION_IN_PLACE_LEFT 3
 #define TURN_DIRECTION_NONE 4
+// Velocity and turn rate come from setMotion
+#define TURN_DIRECTION_CONTINUOUS 5
 
+// Even, the first half is the left side. Set by the build for other robot variants.
+#ifndef LEG_COUNT
 #define LEG_COUNT 4
+#endif
+// Legs of a side, counted from the front
+#define LEG_COUNT_PER_SIDE (LEG_COUNT / 2)
 #define LEG_DIRECTION_FORWARD 1
 #define LEG_DIRECTION_BACKWARD -1
 #define LEG_ACCELERATION_FACTOR 0.1
+// Closer than this (degrees) the stride snaps to its target, so it settles and the
+// keyframe cache can take over
+#define LEG_SETTLE_DEGREES (1.0f / 64)
 
 #define STATE_OPENING 1
 #define STATE_CLOSING 2
 #define STATE_MOVING 3
-#define SERVO_COMMAND_DELAY_USECS 100000
+// Time between the two halves of opening / closing a leg
+#define LEG_TRANSITION_DELAY_NANOS 100000000LL
+// How long the camera takes for one degree step
+#define CAMERA_STEP_NANOS 50000000LL
 
 #define GAIT_STATE_MOVE 0
 #define GAIT_STATE_STOP 1
 
+// Where the leg phases come from: independent oscillators with fixed offsets, or the
+// coupled oscillators of the CPG
+#define PHASE_SOURCE_OSCILLATOR 0
+#define PHASE_SOURCE_CPG 1
+
 #define TWO_PI (2 * M_PI)
 
+// Body pitch (radians, nose up) to measured incline: the incline angle (pi / 4) * incline
+// follows the pitch one to one. Set by the build to scale or flip it for the IMU mounting.
+#ifndef GAIT_INCLINE_PER_RADIAN
+#define GAIT_INCLINE_PER_RADIAN (4 / M_PI)
+#endif
+// Measured incline changes below this are ignored, sensor noise would keep the
+// keyframes from ever settling
+#define GAIT_MEASURED_INCLINE_STEP (1.0f / 64)
+
+// Footfall patterns, see gaitPatternLag
+#define GAIT_PATTERN_TROT 0
+#define GAIT_PATTERN_WALK 1
+#define GAIT_PATTERN_PACE 2
+#define GAIT_PATTERN_BOUND 3
+#define GAIT_PATTERN_COUNT 4
+// Set by the build to start in another pattern
+#ifndef GAIT_PATTERN_DEFAULT
+#define GAIT_PATTERN_DEFAULT GAIT_PATTERN_TROT
+#endif
+
+constexpr int legSide(int leg) {
+    return leg / LEG_COUNT_PER_SIDE;
+}
+
+constexpr int legPosition(int leg) {
+    return leg % LEG_COUNT_PER_SIDE;
+}
+
+/*!
+ * How far a leg's stride lags the first leg's (left front), as a fraction of a stride.
+ *   trot:  diagonal legs together, the two diagonals half a stride apart (tripods with six legs)
+ *   walk:  one leg at a time, rear to front on a side, the sides half a stride apart
+ *   pace:  the legs of a side together, the sides half a stride apart
+ *   bound: the legs of a pair (left and right) together, neighbouring pairs half a stride apart
+ * */
+constexpr float gaitPatternLag(int pattern, int leg) {
+    return pattern == GAIT_PATTERN_TROT ? 0.5f * (legPosition(leg) + legSide(leg))
+         : pattern == GAIT_PATTERN_WALK ? 0.5f * legSide(leg) + (float)(LEG_COUNT_PER_SIDE - 1 - legPosition(leg)) / LEG_COUNT
+         : pattern == GAIT_PATTERN_PACE ? 0.5f * legSide(leg)
+         : 0.5f * legPosition(leg);
+}
+
+const char *gaitPatternName(int pattern);
+
 using namespace std;
 
 class CameraServo {
@@ -34,13 +101,35 @@ private:
     int servoPos, servoPosMax = 90, servoIndex;
 public:
     CameraServo();
+    CameraServo(uint8_t servoIndex);
     void stepRight();
     void stepLeft();
+    // Degrees from center, -90 - 90
+    int getPosition();
+    /*!
+     * Takes over a position the servo is already at, nothing is moved
+     * */
+    void setPosition(int position);
+};
+
+/*!
+ * Everything GaitControl carries from one tick to the next, so a restarted engine can
+ * carry on with the gait where the previous one left it
+ * */
+struct GaitSnapshot {
+    int32_t state, translationDirection, turnDirection, gaitPattern, phaseSource, keyframeCache, footSpace;
+    float incline, speed, velocityMagnitude, turnRate;
+    uint32_t oscillatorPhase[LEG_COUNT];
+    float cpgX[LEG_COUNT], cpgY[LEG_COUNT];
+    float strideLength[LEG_COUNT], strideHeight[LEG_COUNT];
+    float currentStrideLength[LEG_COUNT], currentStrideHeight[LEG_COUNT];
 };
 
 /*!
  * This is meant to be an interface layer between gait logic and motor control.
- * The indices refer to the data positions (0 - 180) in a global array (servoPositions)
+ * The indices refer to the servo channels in an array of PWM ticks (servoPositions unless
+ * GaitControl was given another frame),
+ * angles (0 - 180) are converted with each channel's calibration table
  * The Pos's refer to the angular positions of the legs (-90 - + 90)
  * Stride length and height refer to the maximum range of motion (-90 - + 90)
  * All use degrees as units.
@@ -54,9 +143,20 @@ private:
     float maxStrideHeight = 20, maxStrideLength = 40, currentStrideHeight=0.0f, currentStrideLength=0.0f;
     float phaseAngleOffset, phaseAngle = 0.0f;
     // These convert angles in range (-90to+90) into angles in range(0to180)
-    void moveLegTo_Z(int angle);
-    void moveLegTo_X(int angle);
+    void moveLegTo_Z(float angle);
+    void moveLegTo_X(float angle);
+    // Set the current stride, marking the keyframes stale if it changed
+    void updateStrideLength(float strideLength);
+    void updateStrideHeight(float strideHeight);
+    // Ramps a servo to an open / closed angle (0 - 180) over LEG_TRANSITION_DELAY_NANOS
+    void moveServoTo(int channel, float angle);
     bool enabled=true;
+    ServoTrajectory zTrajectory, xTrajectory;
+    // Where the gait writes its ticks and counts its keyframe use, see setOutput
+    uint16_t *frame;
+    GaitCacheStats *cacheStats;
+    // Both trajectories match the current parameters, cleared by anything that changes them
+    bool keyframesCurrent = false;
     
 public:
     Leg();
@@ -65,8 +165,45 @@ public:
     int stepLegNegative_Z();
     /*!
      * Here, phase angle is in radians.
+     * Float reference path, GaitControl drives the legs through moveBySinCos.
      * */
     void moveByPhase(float deltaPhaseAngle, float incline);
+    /*!
+     * Places the leg on its trajectory given the sine and cosine of its offset phase
+     * and of the incline angle ((pi / 4) * incline).
+     * */
+    void moveBySinCos(float sinPhase, float cosPhase, float sinIncline, float cosIncline);
+    /*!
+     * Same trajectory as moveBySinCos, played back from the keyframe cache.
+     * @param offsetPhase the leg's phase including its offset, 2^32 is one turn
+     * @param inclinePhase (pi / 4) * incline in the same units
+     * */
+    void moveByKeyframes(uint32_t offsetPhase, uint32_t inclinePhase);
+    /*!
+     * The foot space version of moveBySinCos: the foot goes round an ellipse whose ends
+     * are where the joint space stride puts them, instead of the distorted path of two
+     * sinusoidal joints. Only computes the target, see LegKinematics for the units.
+     * */
+    void footTarget(LegKinematics *kinematics, float sinPhase, float cosPhase, float sinIncline, float cosIncline,
+                    float *strideMm, float *liftMm);
+    /*!
+     * Places the leg at joint angles solved for its footTarget
+     * */
+    void moveToJointAngles(float yawDegrees, float liftDegrees);
+    /*!
+     * The frame (SERVO_COUNT ticks) and the stats the gait writes to. Opening and closing
+     * ramp through servoTrajectories, which always works on servoPositions.
+     * */
+    void setOutput(uint16_t *frame, GaitCacheStats *cacheStats);
+    void invalidateKeyframes();
+    /*!
+     * The incline changed, the keyframes have to be checked against it on the next tick
+     * */
+    void markKeyframesStale();
+    
+    float getPhaseAngleOffset();
+    void setPhaseAngleOffset(float phaseAngleOffset);
+    int getStrideDirection();
     
     void setDirectionForward();
     void setDirectionBackward();
@@ -81,6 +218,16 @@ public:
     void setStrideHeight(float strideHeight);
     float getStrideHeight();
     
+    // Servo angles (0 - 180) the Z / X trajectories swing around, what a joint angle of 0 is at
+    float getZCenter();
+    float getXCenter();
+    
+    // Where acceleration has got the stride to so far
+    float getCurrentStrideLength();
+    float getCurrentStrideHeight();
+    // Resumes at a stride acceleration had reached before, e.g. from a GaitSnapshot
+    void setCurrentStride(float strideLength, float strideHeight);
+    
     void accelerateStrideLength(float maxStrideLength);
     void decelerateStrideLength();
 
@@ -99,16 +246,86 @@ public:
 
 class GaitControl {
 private:
-    int translationDirection, state, turnDirection;
+    int translationDirection, state, turnDirection = TURN_DIRECTION_NONE;
     float incline = 0.0, speed;
-    vector<Leg> legs;
+    // From the IMU, added to the manual incline, see setMeasuredIncline
+    float measuredIncline = 0.0f;
+    // Continuous command, used with TURN_DIRECTION_CONTINUOUS
+    float velocityMagnitude = 0.0f, turnRate = 0.0f;
+    std::array<Leg, LEG_COUNT> legs;
+    int gaitPattern = GAIT_PATTERN_DEFAULT;
+    int phaseSource = PHASE_SOURCE_OSCILLATOR;
+    bool keyframeCache = true;
+    bool footSpace = false;
+    LegKinematics kinematics;
+    uint32_t unreachableCount = 0;
+    OscillatorBank oscillators;
+    HopfCPG cpg;
+    MotionSequencer sequencer;
+    int legTransitionTask = MOTION_TASK_NONE;
+    // Open and close, run by the sequencer with this as the context
+    static int openSequence(MotionTask *task);
+    static int closeSequence(MotionTask *task);
+    void startLegTransition(MotionStep sequence);
+    void stepLegs(bool open);
+    // Programs the leg offsets of gaitPattern into the oscillators and the CPG
+    void applyGaitPattern();
+    // Foot targets of all legs through one inverse kinematics call
+    void moveFeet(const float *sinPhase, const float *cosPhase, float sinIncline, float cosIncline);
 public:
     /*!
      * Initializes legs and sets their offsets
      * */
     GaitControl();
+    /*!
+     * Same, writing the gait to frame (SERVO_COUNT ticks) and counting its keyframe use
+     * in cacheStats instead of servoPositions and gaitCacheStats, e.g. one per thread for
+     * simulating gaits side by side
+     * */
+    GaitControl(uint16_t *frame, GaitCacheStats *cacheStats);
     void setGaitState(int state);
     int getGaitState();
+    /*!
+     * Switches between PHASE_SOURCE_OSCILLATOR and PHASE_SOURCE_CPG, continuing from
+     * the current phase.
+     * */
+    void setPhaseSource(int source);
+    int getPhaseSource();
+    /*!
+     * Switches to one of the GAIT_PATTERN_* footfall patterns. The oscillators jump to
+     * the new offsets, the CPG couples its way there over a few strides.
+     * */
+    void setGaitPattern(int pattern);
+    int getGaitPattern();
+    /*!
+     * Programs arbitrary leg offsets instead of a pattern's: how far each leg lags the
+     * first one, as a fraction of a stride (see gaitPatternLag). For parameter sweeps,
+     * not part of the snapshot and kept until the next setGaitPattern to another pattern.
+     * */
+    void setPhaseLags(const float *lags);
+    /*!
+     * Plays the oscillator driven gait back from per leg keyframe tables instead of
+     * evaluating it every tick. The CPG is always evaluated live, its amplitude is not
+     * fixed while it converges.
+     * */
+    void setKeyframeCache(bool enabled);
+    bool getKeyframeCache();
+    /*!
+     * Drives the feet along foot space trajectories through LegKinematics instead of
+     * moving the joints sinusoidally. Stride length and height stay degrees, they set
+     * where the ends of the foot path are. Evaluated live with either phase source, the
+     * keyframe cache holds joint space trajectories and is not used.
+     * */
+    void setFootSpace(bool enabled);
+    bool getFootSpace();
+    /*!
+     * Foot targets the legs could not reach since the start, solved for the nearest point
+     * */
+    uint32_t getUnreachableCount();
+    /*!
+     * Forces the keyframes to be rebuilt, needed when the calibration changes
+     * */
+    void invalidateKeyframes();
     /*!
      * Set speed in frequency of oscillations
      * */
@@ -119,8 +336,23 @@ public:
      * @param time is in seconds
      * */
     void updateGait(float deltaTime);
+    /*!
+     * Resumes running motion sequences (open, close), to be called once per tick
+     * before updateGait.
+     * @param nowNanos the tick time, CLOCK_MONOTONIC
+     * @return true if a sequence moved servos, they need to be written out
+     * */
+    bool updateSequences(int64_t nowNanos);
+    /*!
+     * True while legs are opening or closing
+     * */
+    bool isTransitioning();
     void setDirection(int direction);
     
+    /*!
+     * Start opening / closing the legs, the motion runs over the next ticks.
+     * A transition that is still running is replaced.
+     * */
     void openPebble();
     void closePebble();
     
@@ -135,8 +367,50 @@ public:
     
     void incrementIncline();
     void decrementIncline();
+    /*!
+     * Closed loop part of the incline, added to the manual one: the body pitch times
+     * GAIT_INCLINE_PER_RADIAN, clamped to -1 - 1 and kept in GAIT_MEASURED_INCLINE_STEP
+     * steps. Not part of the snapshot, it is measured again after a restart.
+     * */
+    void setMeasuredIncline(float incline);
+    float getMeasuredIncline();
     
     void setTurnDirection(int turn);
+    /*!
+     * Continuous alternative to setDirection / setTurnDirection.
+     * @param velocity -1.0 (full backward) - 1.0 (full forward)
+     * @param turnRate -1.0 (in place left) - 1.0 (in place right)
+     * */
+    void setMotion(float velocity, float turnRate);
+    /*!
+     * Sets the stride length / height (degrees) of every leg
+     * */
+    void setStrideLength(float strideLength);
+    void setStrideHeight(float strideHeight);
+    
+    /*!
+     * Phase of a leg including its offset, 2^32 is one turn
+     * */
+    uint32_t getLegPhase(int leg);
+    float getCurrentStrideLength(int leg);
+    float getCurrentStrideHeight(int leg);
+    float getIncline();
+    /*!
+     * Sets the manual incline, 1 is 45 degrees. incrementIncline / decrementIncline add
+     * 0.1 per leg, so one press moves it by 0.1 * LEG_COUNT.
+     * */
+    void setIncline(float incline);
+    /*!
+     * Servo angles (0 - 180) a leg's Z / X joints are at for a joint angle of 0
+     * */
+    float getLegZCenter(int leg);
+    float getLegXCenter(int leg);
+    
+    void saveSnapshot(GaitSnapshot *snapshot);
+    /*!
+     * Continues from a saved snapshot. Running open / close sequences are not part of it.
+     * */
+    void restoreSnapshot(const GaitSnapshot *snapshot);
 };
 
 
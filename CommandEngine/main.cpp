@@ -1,5 +1,8 @@
 #include "ServoDriver.h"
+#include "ServoCalibration.h"
+#include "ServoFrameWriter.h"
 #include <arpa/inet.h>
+#include <getopt.h>
 #include <math.h>
 #include <netinet/in.h>
 #include <stdio.h>
@@ -9,123 +12,902 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/time.h>
-#include <ctime>
+#include <sys/resource.h>
 #include <unistd.h>
 #include <csignal>
 #include "commands.h"
+#include "CommandReceiver.h"
+#include "ControlLoop.h"
 #include "gait.h"
+#include "Trajectory.h"
+#include "Telemetry.h"
+#include "SessionLog.h"
+#include "EngineState.h"
+#include "ImuSampler.h"
+#include "AttitudeFilter.h"
+#include "IdlePolicy.h"
+#include "LoopTiming.h"
+#ifdef ALLOCATION_GUARD
+#include "AllocationGuard.h"
+#endif
 
 
 #define ROTATION_SPEED 50
 
 
 #define COMMAND_TIMEOUT_SECONDS 1
-#define COMMAND_TIMEOUT_MICROSECONDS 0
-#define COMMAND_SIZE 2
+#define OPTION_UNSET -1
+#define COMMAND_PORT 8080
 
 using namespace std;
 
-void commandInterpreter(uint8_t[], float);
-clock_t timer;
+void commandInterpreter(const CommandFrame *frame);
 GaitControl gaitController;
 CameraServo cameraServo;
+LoopTiming loopTiming;
+SessionLog sessionLog;
+ServoFrameWriter servoWriter;
+EngineState engineState;
+ImuSampler imuSampler;
+AttitudeFilter attitudeFilter;
+IdlePolicy idlePolicy;
 bool keepRunning;
+volatile sig_atomic_t timingDumpRequested = 0;
+// Set by commandInterpreter, printed once the tick is done
+const char *commandMessage = NULL;
 
 void ctrl_c_handler(int signum) {
   keepRunning = false;
 }
 
-int main() {
+/*!
+ * kill -USR1 <pid> prints the loop timing histograms from the control loop
+ * */
+void timing_dump_handler(int signum) {
+  timingDumpRequested = 1;
+}
+
+/*!
+ * Everything that can be set from the command line
+ * */
+struct EngineOptions {
+  ControlLoopConfig loop;
+  int i2cTransport;
+  uint8_t boardAddresses[PCA9685_MAX_BOARDS];
+  int boardCount;
+  bool allCall;
+  bool syncWrites;
+  bool pwmAlign;
+  bool staggerOutputs;
+  uint32_t pwmOscillatorHz;
+  const char *statePath;
+  bool warmStart;
+  bool lockMemory;
+  const char *calibrationPath;
+  // The gait settings are OPTION_UNSET unless given, the gait (or a restored state) keeps its own then
+  int phaseSource;
+  int keyframeCache;
+  int gaitPattern;
+  int footSpace;
+  bool imu;
+  int imuRateHz;
+  // Seconds, 0 never goes idle
+  double idleAfterSeconds;
+  int idleRateHz;
+  bool idleRelease[SERVO_COUNT];
+  bool idleReleaseGiven;
+  bool idleSleep;
+  int telemetryRateHz;
+  const char *recordPath;
+  uint32_t recordCapacity;
+  const char *replayPath;
+  bool printFrames;
+};
+
+void printUsage(const char *programName) {
+  printf("Usage: %s [--rate HZ] [--rt-priority PRIO] [--cpu CORE] [--lock-memory] [--i2c pigpio|dev|sim]\n"
+         "          [--boards ADDR[,ADDR...]] [--allcall] [--sync-i2c] [--pwm-align] [--pwm-oscillator HZ]\n"
+         "          [--stagger] [--state FILE [--warm-start]] [--calibration FILE] [--cpg] [--live-gait]\n"
+         "          [--gait trot|walk|pace|bound] [--foot-space] [--imu [--imu-rate HZ]]\n"
+         "          [--idle-after SECONDS [--idle-rate HZ] [--idle-release CH[,CH...]|all] [--idle-sleep]]\n"
+         "          [--telemetry HZ] [--record FILE [--record-ticks N]] [--replay FILE]\n"
+         "          [--print-frames]\n", programName);
+  printf("  --rate HZ           control loop rate, %d - %d (default %d)\n",
+         CONTROL_LOOP_RATE_MIN_HZ, CONTROL_LOOP_RATE_MAX_HZ, CONTROL_LOOP_RATE_DEFAULT_HZ);
+  printf("  --rt-priority PRIO  run the loop as SCHED_FIFO with this priority (1 - 99)\n");
+  printf("  --cpu CORE          pin the loop to this core\n");
+  printf("  --lock-memory       lock all pages into RAM and prefault the loop's stack\n");
+  printf("  --i2c TRANSPORT     pigpio, dev (/dev/i2c-%d) or sim (simulated PCA9685)\n", PCA9685_I2C_BUS_CHANNEL);
+  printf("  --boards ADDRS      I2C addresses of the PCA9685 boards, up to %d (default 0x%02x and up as needed)\n",
+         PCA9685_MAX_BOARDS, PCA9685_I2C_ADDRESS);
+  printf("  --allcall           configure all boards at once through the ALLCALL address 0x%02x\n",
+         PCA9685_ALLCALL_ADDRESS);
+  printf("  --sync-i2c          write every frame from the loop instead of the servo writer thread\n");
+  printf("  --pwm-align         time every write to end just before a PWM period boundary\n");
+  printf("  --pwm-oscillator HZ measured oscillator frequency of the boards (default %d)\n", FREQUENCY_OSCILLATOR);
+  printf("  --stagger           spread the servo pulse starts over the PWM period\n");
+  printf("  --state FILE        keep the pose and gait state of every tick in FILE\n");
+  printf("  --warm-start        take over boards that are still configured and continue from --state\n");
+  printf("  --calibration FILE  per servo tick range, trim, direction and wiring (see servo_calibration.txt)\n");
+  printf("  --cpg               generate leg phases with the coupled oscillator CPG\n");
+  printf("  --live-gait         evaluate the gait every tick instead of playing back keyframes\n");
+  printf("  --gait PATTERN      footfall pattern: trot, walk, pace or bound (default %s)\n",
+         gaitPatternName(GAIT_PATTERN_DEFAULT));
+  printf("  --foot-space        move the feet along foot space paths through inverse kinematics\n");
+  printf("  --imu               follow the body pitch with the incline, from an MPU-6050 on the servo bus\n");
+  printf("  --imu-rate HZ       IMU samples per second, %d - %d (default %d)\n", IMU_MIN_RATE_HZ, IMU_MAX_RATE_HZ,
+         IMU_DEFAULT_RATE_HZ);
+  printf("  --idle-after SECONDS when stopped this long without commands, stop writing and slow the loop down\n");
+  printf("  --idle-rate HZ      loop rate while idle, %d - %d (default %d), a command wakes it at once\n",
+         IDLE_RATE_MIN_HZ, IDLE_RATE_MAX_HZ, IDLE_DEFAULT_RATE_HZ);
+  printf("  --idle-release CHS  turn these servo channels off while idle, they hold no torque\n");
+  printf("  --idle-sleep        put the boards to sleep while idle, every servo is off\n");
+  printf("  --telemetry HZ      telemetry datagrams per second to the last client, 0 disables (default %d)\n",
+         TELEMETRY_DEFAULT_RATE_HZ);
+  printf("  --record FILE       log every tick's command and servo frame to FILE\n");
+  printf("  --record-ticks N    ticks kept in the log before it wraps (default %d)\n", SESSION_LOG_DEFAULT_CAPACITY);
+  printf("  --replay FILE       TEST_MODE builds: replay a log and verify the servo frames\n");
+  printf("  --print-frames      TEST_MODE builds: print every frame flushed to the servo driver\n");
+}
+
+/*!
+ * Parses a comma separated list of I2C addresses, e.g. "0x40,0x41"
+ * @return false if an address is invalid or there are too many
+ * */
+bool parseBoardAddresses(const char *list, EngineOptions *options) {
+  options->boardCount = 0;
+  while (*list != '\0') {
+    char *end;
+    long address = strtol(list, &end, 0);
+    if (end == list || address < 0x03 || address > 0x77 || address == PCA9685_ALLCALL_ADDRESS ||
+        options->boardCount == PCA9685_MAX_BOARDS) {
+      return false;
+    }
+    options->boardAddresses[options->boardCount++] = address;
+    if (*end == ',') {
+      end++;
+    } else if (*end != '\0') {
+      return false;
+    }
+    list = end;
+  }
+  return options->boardCount > 0;
+}
+
+/*!
+ * Parses a comma separated list of servo channels, e.g. "0,1,8", or "all"
+ * @return false if a channel is out of range
+ * */
+bool parseChannels(const char *list, bool channels[SERVO_COUNT]) {
+  for (int i = 0; i < SERVO_COUNT; i++) {
+    channels[i] = strcmp(list, "all") == 0;
+  }
+  if (channels[0]) {
+    return true;
+  }
+  while (*list != '\0') {
+    char *end;
+    long channel = strtol(list, &end, 0);
+    if (end == list || channel < 0 || channel >= SERVO_COUNT) {
+      return false;
+    }
+    channels[channel] = true;
+    if (*end == ',') {
+      end++;
+    } else if (*end != '\0') {
+      return false;
+    }
+    list = end;
+  }
+  return true;
+}
+
+/*!
+ * Fills options from the command line.
+ * @return false if the arguments were not understood
+ * */
+bool parseArguments(int argc, char *argv[], EngineOptions *options) {
+  static struct option longOptions[] = {
+      {"rate", required_argument, 0, 'r'},
+      {"rt-priority", required_argument, 0, 'p'},
+      {"cpu", required_argument, 0, 'c'},
+      {"lock-memory", no_argument, 0, 'm'},
+      {"i2c", required_argument, 0, 'i'},
+      {"boards", required_argument, 0, 'b'},
+      {"allcall", no_argument, 0, 'a'},
+      {"sync-i2c", no_argument, 0, 's'},
+      {"pwm-align", no_argument, 0, 'A'},
+      {"pwm-oscillator", required_argument, 0, 'O'},
+      {"stagger", no_argument, 0, 'S'},
+      {"state", required_argument, 0, 'x'},
+      {"warm-start", no_argument, 0, 'W'},
+      {"calibration", required_argument, 0, 'k'},
+      {"cpg", no_argument, 0, 'g'},
+      {"live-gait", no_argument, 0, 'l'},
+      {"gait", required_argument, 0, 'w'},
+      {"foot-space", no_argument, 0, 'f'},
+      {"imu", no_argument, 0, 'u'},
+      {"imu-rate", required_argument, 0, 'U'},
+      {"idle-after", required_argument, 0, 'd'},
+      {"idle-rate", required_argument, 0, 'R'},
+      {"idle-release", required_argument, 0, 'e'},
+      {"idle-sleep", no_argument, 0, 'z'},
+      {"telemetry", required_argument, 0, 't'},
+      {"record", required_argument, 0, 'o'},
+      {"record-ticks", required_argument, 0, 'n'},
+      {"replay", required_argument, 0, 'y'},
+      {"print-frames", no_argument, 0, 'P'},
+      {"help", no_argument, 0, 'h'},
+      {0, 0, 0, 0}};
+
+  controlLoopDefaultConfig(&options->loop);
+  options->i2cTransport = I2C_TRANSPORT_DEFAULT;
+  options->boardCount = 0;
+  options->allCall = false;
+  options->syncWrites = false;
+  options->pwmAlign = false;
+  options->staggerOutputs = false;
+  options->pwmOscillatorHz = FREQUENCY_OSCILLATOR;
+  options->statePath = NULL;
+  options->warmStart = false;
+  options->lockMemory = false;
+  options->calibrationPath = NULL;
+  options->phaseSource = OPTION_UNSET;
+  options->keyframeCache = OPTION_UNSET;
+  options->gaitPattern = OPTION_UNSET;
+  options->footSpace = OPTION_UNSET;
+  options->imu = false;
+  options->imuRateHz = IMU_DEFAULT_RATE_HZ;
+  options->idleAfterSeconds = 0;
+  options->idleRateHz = IDLE_DEFAULT_RATE_HZ;
+  options->idleReleaseGiven = false;
+  options->idleSleep = false;
+  options->telemetryRateHz = TELEMETRY_DEFAULT_RATE_HZ;
+  options->recordPath = NULL;
+  options->recordCapacity = SESSION_LOG_DEFAULT_CAPACITY;
+  options->replayPath = NULL;
+  options->printFrames = false;
+
+  int option;
+  while ((option = getopt_long(argc, argv, "r:p:c:mi:b:asAO:Sx:Wk:glw:fuU:d:R:e:zt:o:n:y:Ph", longOptions, NULL)) != -1) {
+    switch (option) {
+    case 'r':
+      options->loop.rateHz = atoi(optarg);
+      break;
+    case 'p':
+      options->loop.realtimePriority = atoi(optarg);
+      break;
+    case 'c':
+      options->loop.cpu = atoi(optarg);
+      break;
+    case 'm':
+      options->lockMemory = true;
+      break;
+    case 'i':
+      if (strcmp(optarg, "pigpio") == 0) {
+        options->i2cTransport = I2C_TRANSPORT_PIGPIO;
+      } else if (strcmp(optarg, "dev") == 0) {
+        options->i2cTransport = I2C_TRANSPORT_LINUX;
+      } else if (strcmp(optarg, "sim") == 0) {
+        options->i2cTransport = I2C_TRANSPORT_SIMULATED;
+      } else {
+        printUsage(argv[0]);
+        return false;
+      }
+      break;
+    case 'b':
+      if (!parseBoardAddresses(optarg, options)) {
+        printUsage(argv[0]);
+        return false;
+      }
+      break;
+    case 'a':
+      options->allCall = true;
+      break;
+    case 's':
+      options->syncWrites = true;
+      break;
+    case 'A':
+      options->pwmAlign = true;
+      break;
+    case 'O':
+      options->pwmOscillatorHz = atoi(optarg);
+      break;
+    case 'S':
+      options->staggerOutputs = true;
+      break;
+    case 'x':
+      options->statePath = optarg;
+      break;
+    case 'W':
+      options->warmStart = true;
+      break;
+    case 'k':
+      options->calibrationPath = optarg;
+      break;
+    case 'g':
+      options->phaseSource = PHASE_SOURCE_CPG;
+      break;
+    case 'l':
+      options->keyframeCache = false;
+      break;
+    case 'w':
+      options->gaitPattern = OPTION_UNSET;
+      for (int pattern = 0; pattern < GAIT_PATTERN_COUNT; pattern++) {
+        if (strcmp(optarg, gaitPatternName(pattern)) == 0) {
+          options->gaitPattern = pattern;
+        }
+      }
+      if (options->gaitPattern == OPTION_UNSET) {
+        printUsage(argv[0]);
+        return false;
+      }
+      break;
+    case 'f':
+      options->footSpace = true;
+      break;
+    case 'u':
+      options->imu = true;
+      break;
+    case 'U':
+      options->imuRateHz = atoi(optarg);
+      break;
+    case 'd':
+      options->idleAfterSeconds = atof(optarg);
+      break;
+    case 'R':
+      options->idleRateHz = atoi(optarg);
+      break;
+    case 'e':
+      if (!parseChannels(optarg, options->idleRelease)) {
+        printUsage(argv[0]);
+        return false;
+      }
+      options->idleReleaseGiven = true;
+      break;
+    case 'z':
+      options->idleSleep = true;
+      break;
+    case 't':
+      options->telemetryRateHz = atoi(optarg);
+      break;
+    case 'o':
+      options->recordPath = optarg;
+      break;
+    case 'n':
+      options->recordCapacity = atoi(optarg);
+      break;
+    case 'y':
+      #ifndef TEST_MODE
+      printf("--replay needs a TEST_MODE build\n");
+      return false;
+      #endif
+      options->replayPath = optarg;
+      break;
+    case 'P':
+      #ifndef TEST_MODE
+      printf("--print-frames needs a TEST_MODE build\n");
+      return false;
+      #endif
+      options->printFrames = true;
+      break;
+    default:
+      printUsage(argv[0]);
+      return false;
+    }
+  }
+  if (options->replayPath != NULL && (options->statePath != NULL || options->warmStart)) {
+    printf("--replay starts from the recorded state, it can not be combined with --state or --warm-start\n");
+    return false;
+  }
+  if (options->pwmAlign && options->syncWrites) {
+    printf("--pwm-align needs the servo writer thread, it can not be combined with --sync-i2c\n");
+    return false;
+  }
+  if (options->imu && options->syncWrites) {
+    printf("--imu reads the sensor on the servo writer thread, it can not be combined with --sync-i2c\n");
+    return false;
+  }
+  if ((options->idleReleaseGiven || options->idleSleep) && options->idleAfterSeconds <= 0) {
+    printf("--idle-release and --idle-sleep need --idle-after\n");
+    return false;
+  }
+  if (options->recordCapacity == 0 || options->pwmOscillatorHz == 0 || options->imuRateHz < IMU_MIN_RATE_HZ ||
+      options->imuRateHz > IMU_MAX_RATE_HZ || options->idleAfterSeconds < 0 || options->idleRateHz < IDLE_RATE_MIN_HZ ||
+      options->idleRateHz > IDLE_RATE_MAX_HZ) {
+    printUsage(argv[0]);
+    return false;
+  }
+  return true;
+}
+
+/*!
+ * The part of a tick that turns a command into servo positions. Everything it reads is
+ * its arguments or state it built itself, time included, so replaying the same
+ * arguments reproduces servoPositions exactly.
+ * @param command the command to apply, NULL if none arrived
+ * @param attitude the IMU estimate, NULL without an IMU
+ * @return true if the frame has to be written out
+ * */
+bool controlStep(int64_t nowNanos, float deltaTime, const CommandFrame *command, const Attitude *attitude) {
+  int64_t phaseStartNanos = monotonicNanos(), phaseEndNanos;
+  if (command != NULL) {
+    commandInterpreter(command);
+  }
+  if (attitude != NULL) {
+    gaitController.setMeasuredIncline(attitude->pitch * GAIT_INCLINE_PER_RADIAN);
+  }
+  phaseEndNanos = monotonicNanos();
+  loopTiming.record(TIMING_PHASE_INTERPRET, phaseEndNanos - phaseStartNanos);
+  phaseStartNanos = phaseEndNanos;
+
+  bool sequenceMoved = gaitController.updateSequences(nowNanos);
+  // Ramps first, the gait owns the leg channels while it is walking
+  bool trajectoryMoved = servoTrajectories.update(nowNanos);
+  gaitController.updateGait(deltaTime);
+  phaseEndNanos = monotonicNanos();
+  loopTiming.record(TIMING_PHASE_GAIT, phaseEndNanos - phaseStartNanos);
+
+  return command != NULL || sequenceMoved || trajectoryMoved || gaitController.getGaitState() == GAIT_STATE_MOVE;
+}
+
+#ifdef TEST_MODE
+/*!
+ * Feeds a recorded session through controlStep as fast as possible and compares every
+ * servo frame with the recorded one.
+ * @return 0 if all frames matched
+ * */
+int replaySession() {
+  const SessionLogHeader *header = sessionLog.getHeader();
+  uint64_t count = sessionLog.getRecordCount();
+  if (count == 0) {
+    printf("Session log is empty\n");
+    return 1;
+  }
+  uint64_t mismatches = 0;
+  CommandFrame frame;
+  int64_t startNanos = monotonicNanos();
+  for (uint64_t i = 0; i < count; i++) {
+    const SessionRecord *record = sessionLog.getRecord(i);
+    const CommandFrame *command = NULL;
+    if (record->flags & SESSION_RECORD_COMMAND) {
+      sessionRecordToFrame(record, &frame);
+      command = &frame;
+    }
+    const Attitude *attitude = NULL;
+    Attitude recordedAttitude;
+    if (record->flags & SESSION_RECORD_ATTITUDE) {
+      recordedAttitude.pitch = record->pitch;
+      recordedAttitude.roll = record->roll;
+      attitude = &recordedAttitude;
+    }
+    bool written = controlStep(record->tickNanos, record->deltaTime, command, attitude);
+    if (written != ((record->flags & SESSION_RECORD_WRITTEN) != 0) ||
+        memcmp(servoPositions, record->servoTicks, sizeof(record->servoTicks)) != 0) {
+      if (mismatches < 10) {
+        printf("Tick %llu differs:", (unsigned long long)i);
+        for (int channel = 0; channel < SERVO_COUNT; channel++) {
+          printf(" %u/%u", servoPositions[channel], record->servoTicks[channel]);
+        }
+        printf("%s\n", written ? " (written)" : "");
+      }
+      mismatches++;
+    }
+  }
+  double replaySeconds = (double)(monotonicNanos() - startNanos) / NANOS_PER_SECOND;
+  double recordedSeconds =
+      (double)(sessionLog.getRecord(count - 1)->tickNanos - sessionLog.getRecord(0)->tickNanos) / NANOS_PER_SECOND;
+  printf("Replayed %llu ticks (%.1f s recorded at %d Hz) in %.3f s, %.0fx real time\n", (unsigned long long)count,
+         recordedSeconds, header->rateHz, replaySeconds, recordedSeconds / replaySeconds);
+  printf("%llu of %llu servo frames differ\n", (unsigned long long)mismatches, (unsigned long long)count);
+  return mismatches == 0 ? 0 : 1;
+}
+#endif
+
+/*!
+ * Continues from the state the previous run saved: the gait and camera carry on where
+ * they were, and the channels whose pulse could not be read back from the boards (all
+ * of them if the boards had to be configured from scratch) are sent the saved pose
+ * instead of the default one.
+ * */
+void restoreEngineState(const EngineStateSlot *saved) {
+  gaitController.restoreSnapshot(&saved->gait);
+  cameraServo.setPosition(saved->cameraPosition);
+  for (int i = 0; i < SERVO_COUNT; i++) {
+    if (!servoDriverIsReadBack(i)) {
+      servoPositions[i] = saved->servoTicks[i];
+    }
+  }
+  if (servoDriverIsWarm() && engineState.isSameBoot() && saved->pwmEpochNanos != 0) {
+    // The boards kept running their PWM periods, so the old epoch still holds
+    servoDriverSetPwmEpochNanos(saved->pwmEpochNanos);
+  }
+  printf("Restored the %s gait state saved %s\n", gaitPatternName(saved->gait.gaitPattern),
+         engineState.isSameBoot() ? "earlier this boot" : "before the last reboot");
+}
+
+/*!
+ * Parks the robot: no more bus traffic or IMU reads, the chosen channels are turned off
+ * or the boards put to sleep. The loop slows down to the idle rate from the next tick.
+ * */
+void enterIdle(int64_t nowNanos, bool syncWrites) {
+  idlePolicy.enter(nowNanos);
+  bool sleepBoards = idlePolicy.getAction() == IDLE_ACTION_SLEEP;
+  if (idlePolicy.getAction() == IDLE_ACTION_RELEASE) {
+    // servoPositions is left alone, the first frame after idle turns the channels back on
+    uint16_t released[SERVO_COUNT];
+    idlePolicy.releaseFrame(servoPositions, released);
+    if (syncWrites) {
+      servoDriverWriteFrame(released);
+    } else {
+      servoWriter.publish(released, nowNanos);
+    }
+  }
+  if (!syncWrites) {
+    servoWriter.setIdle(true, sleepBoards);
+  } else if (sleepBoards) {
+    servoDriverSleep();
+  }
+}
+
+/*!
+ * Back to full rate, the caller writes the frame of this tick
+ * */
+void leaveIdle(int64_t nowNanos, int64_t wakeLatencyNanos, bool syncWrites) {
+  idlePolicy.leave(nowNanos, wakeLatencyNanos);
+  if (!syncWrites) {
+    servoWriter.setIdle(false, false);
+  } else if (idlePolicy.getAction() == IDLE_ACTION_SLEEP) {
+    wakeup();
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int64_t startupNanos = monotonicNanos();
+  EngineOptions options;
+  if (!parseArguments(argc, argv, &options)) {
+    return 1;
+  }
+
   // Register signal for graceful shutdown
   signal(SIGINT, ctrl_c_handler);
+  signal(SIGUSR1, timing_dump_handler);
   gaitController.setSpeed(0.5);
+  if (options.replayPath != NULL) {
+    // Start from the state the recording started in
+    if (sessionLog.openForReplay(options.replayPath) < 0) {
+      return 1;
+    }
+    if (sessionLog.hasWrapped()) {
+      printf("The session log has wrapped, its first ticks are gone and it can not be replayed\n");
+      return 1;
+    }
+    const SessionLogHeader *header = sessionLog.getHeader();
+    options.phaseSource = header->phaseSource;
+    options.keyframeCache = header->keyframeCache;
+    options.gaitPattern = header->gaitPattern;
+    options.footSpace = header->footSpace != 0;
+    servoCalibrationLoadDefaults();
+    for (int i = 0; i < SERVO_COUNT; i++) {
+      servoCalibrationSet(i, header->calibrations[i]);
+    }
+  }
+  if (options.calibrationPath != NULL && options.replayPath == NULL && servoCalibrationLoad(options.calibrationPath) < 0) {
+    return 1;
+  }
   // Initialize driver
+  servoDriverSelectTransport(options.i2cTransport);
+  if (options.boardCount > 0) {
+    servoDriverSetBoards(options.boardAddresses, options.boardCount);
+  }
+  servoDriverUseAllCall(options.allCall);
+  servoDriverStaggerOutputs(options.staggerOutputs);
+  servoDriverWarmStart(options.warmStart);
+  servoDriverPrintFrames(options.printFrames);
+  if (options.statePath != NULL && engineState.open(options.statePath) < 0) {
+    return 1;
+  }
   int servoControllerFd = servoDriverInit(0);
-  #ifndef TEST_MODE
   if (servoControllerFd < 0) {
     perror("Unable to init servo driver, exiting...");
     return 1;
   }
-  #endif
+  // The prescale was picked for the nominal frequency, the period follows the real one
+  setOscillatorFrequency(options.pwmOscillatorHz);
+  if (options.warmStart && engineState.isOpen() && engineState.load() != NULL) {
+    restoreEngineState(engineState.load());
+  }
+  // After the restore, so whatever was given on the command line wins
+  if (options.phaseSource != OPTION_UNSET) {
+    gaitController.setPhaseSource(options.phaseSource);
+  }
+  if (options.keyframeCache != OPTION_UNSET) {
+    gaitController.setKeyframeCache(options.keyframeCache);
+  }
+  if (options.gaitPattern != OPTION_UNSET) {
+    gaitController.setGaitPattern(options.gaitPattern);
+  }
+  if (options.footSpace != OPTION_UNSET) {
+    gaitController.setFootSpace(options.footSpace);
+  }
+  // Nothing to send after a warm start, the boards already show servoPositions
   servoDriverWriteCommands();
+  printf("%s start took %.3f ms\n", servoDriverIsWarm() ? "Warm" : "Cold",
+         (double)(monotonicNanos() - startupNanos) / NANOS_PER_MILLISECOND);
+  // Still standing, the gyro bias is measured now. Not part of the start time, the servos are set by now
+  if (options.imu && options.replayPath == NULL) {
+    if (imuSampler.open(options.i2cTransport, options.imuRateHz) < 0) {
+      return 1;
+    }
+    attitudeFilter.setGyroBias(imuSampler.getGyroBias());
+  }
+
+  #ifdef TEST_MODE
+  if (options.replayPath != NULL) {
+    int result = replaySession();
+    servoDriverDeInit(servoControllerFd);
+    return result;
+  }
+  #endif
+  if (options.recordPath != NULL &&
+      sessionLog.create(options.recordPath, options.recordCapacity, options.loop.rateHz,
+                        gaitController.getPhaseSource(), gaitController.getKeyframeCache(),
+                        gaitController.getGaitPattern(), gaitController.getFootSpace()) < 0) {
+    return 1;
+  }
 
   #ifndef TEST_MODE
-  // Initialize UDP server
-  int socketFileDescriptor = socket(AF_INET, SOCK_DGRAM, 0);
-  // Set timeout in case connection is broken mid command sequence
-  struct timeval timeout;
-  timeout.tv_sec = COMMAND_TIMEOUT_SECONDS;
-  timeout.tv_usec = COMMAND_TIMEOUT_MICROSECONDS;
-  if (setsockopt(socketFileDescriptor, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) {
-    perror("Error setting socket timeout\n");
+  // Initialize UDP server. Datagrams are drained on their own thread and only the
+  // newest command is sampled by the loop on each tick.
+  CommandReceiver commandReceiver;
+  CommandFrame commandFrame, idleFrame;
+  memset(&commandFrame, 0, sizeof(commandFrame));
+  if (commandReceiver.start(COMMAND_PORT) < 0) {
     return 0;
   }
-  
-  struct sockaddr_in server, client;
-  unsigned int clientAddressSize = sizeof(client);
-  uint8_t recvBuffer[COMMAND_SIZE];
-  char receivedByteString[9];
+  // Nothing is sent before the first command tells us where the client is
+  TelemetrySender telemetry;
+  telemetry.start(commandReceiver.getSocket(), options.telemetryRateHz, &gaitController, &loopTiming, &commandReceiver);
+  #endif
 
-  server.sin_addr.s_addr = INADDR_ANY;
-  server.sin_family = AF_INET;
-  server.sin_port = htons(8080);
+  // The receiver thread was created first, so it keeps the default scheduling
+  if (controlLoopApplyScheduling(&options.loop) < 0) {
+    cout << "Continuing with default scheduling\n";
+  }
+  // From here on the writer thread owns the driver
+  if (!options.syncWrites) {
+    if (options.pwmAlign) {
+      servoWriter.alignToPwmPeriod(PWM_SCHEDULE_DEFAULT_GUARD_MICROS * 1000LL);
+    }
+    if (imuSampler.isOpen()) {
+      servoWriter.attachImu(&imuSampler);
+    }
+    servoWriter.start(options.loop.realtimePriority);
+  }
 
-  if (bind(socketFileDescriptor, (struct sockaddr *)&server, sizeof(server)) < 0) {
-    perror("Binding failed\n");
-    return 0;
+  int idleAction = IDLE_ACTION_HOLD;
+  if (options.idleSleep) {
+    idleAction = IDLE_ACTION_SLEEP;
+  } else if (options.idleReleaseGiven) {
+    idleAction = IDLE_ACTION_RELEASE;
+  }
+  idlePolicy.configure((int64_t)(options.idleAfterSeconds * NANOS_PER_SECOND), options.idleRateHz, idleAction);
+  for (int i = 0; options.idleReleaseGiven && i < SERVO_COUNT; i++) {
+    if (options.idleRelease[i]) {
+      idlePolicy.releaseChannel(i);
+    }
   }
-  #endif
 
-  int receivedBytesCount = 0;
-  float deltaTime = 0.0f;
-  timer = clock();
-  cout << "Loop starting...\n";
+  PeriodicTimer timer;
+  timer.start(options.loop.rateHz);
+  int64_t lastTickNanos = monotonicNanos();
+  idlePolicy.noteActivity(lastTickNanos);
+  // Only commands end idle, without a receiver the idle loop just wakes at the idle rate
+  int wakeFd = -1;
+  #ifndef TEST_MODE
+  int64_t lastCommandNanos = lastTickNanos;
+  wakeFd = commandReceiver.getWakeFd();
+  #endif
+  loopTiming.setPeriod(timer.getPeriodNanos());
+  // Last, every thread and mapping exists now and MCL_FUTURE covers whatever comes later
+  if (options.lockMemory) {
+    if (controlLoopLockMemory() < 0) {
+      cout << "Continuing with pageable memory\n";
+    }
+    controlLoopPrefaultStack();
+  }
+  cout << "Loop starting at " << NANOS_PER_SECOND / timer.getPeriodNanos() << " Hz...\n";
+  struct rusage loopStartUsage, loopEndUsage;
+  getrusage(RUSAGE_THREAD, &loopStartUsage);
+  #ifdef ALLOCATION_GUARD
+  allocationGuardArm();
+  #endif
   keepRunning = true;
 
   while (keepRunning) {
+    int64_t nowNanos;
+    if (idlePolicy.isIdle()) {
+      nowNanos = timer.waitIdle(wakeFd, idlePolicy.getPeriodNanos());
+    } else {
+      nowNanos = timer.waitNextTick();
+      loopTiming.record(TIMING_PHASE_WAKEUP_JITTER, nowNanos - timer.getScheduledNanos());
+    }
+    float deltaTime = ((float)(nowNanos - lastTickNanos)) / NANOS_PER_SECOND;
+    lastTickNanos = nowNanos;
+    const CommandFrame *command = NULL;
+    bool active = false;
+    int64_t phaseStartNanos = nowNanos, phaseEndNanos;
+
     #ifndef TEST_MODE
-    //printf("Listening at %d\n", server.sin_port);
-
-    receivedBytesCount = recvfrom(
-        socketFileDescriptor,
-        recvBuffer,
-        2,
-        0,
-        (struct sockaddr *)&client,
-        (socklen_t *)&clientAddressSize);
-    
-    // if (receivedBytesCount > 0) {
-    // }
-    
-    clientAddressSize = sizeof(client);
-    commandInterpreter(recvBuffer, deltaTime);
-    // Clear the receive buffer
-    memset(recvBuffer, 0, sizeof(uint8_t) * COMMAND_SIZE);
-    
+    // Sample the newest command published since the last tick
+    if (commandReceiver.takeLatest(&commandFrame)) {
+      command = &commandFrame;
+      active = true;
+      lastCommandNanos = nowNanos;
+      if (idlePolicy.isIdle()) {
+        leaveIdle(nowNanos, nowNanos - commandFrame.receivedNanos, options.syncWrites);
+        commandReceiver.setWakeOnCommand(false);
+        // The gait carries on from where it stopped, not from the idle stretch
+        deltaTime = (float)timer.getPeriodNanos() / NANOS_PER_SECOND;
+      }
+    } else if (!idlePolicy.isIdle() && nowNanos - lastCommandNanos >= COMMAND_TIMEOUT_SECONDS * NANOS_PER_SECOND) {
+      // Connection lost, behave as if the client released every key
+      static const uint8_t releasedKeys[COMMAND_SIZE] = {};
+      memset(&idleFrame, 0, sizeof(idleFrame));
+      commandDecode(releasedKeys, COMMAND_SIZE, &idleFrame);
+      command = &idleFrame;
+      lastCommandNanos = nowNanos;
+    }
+    phaseEndNanos = monotonicNanos();
+    loopTiming.record(TIMING_PHASE_RECEIVE, phaseEndNanos - phaseStartNanos);
     #else
     // Put testing code here
     gaitController.setDirection(TRANSLATION_DIRECTION_FORWARD);
-    gaitController.updateGait(deltaTime);
-    servoDriverWriteCommands();
-    usleep(200000);
     #endif
-    
-    deltaTime = ((float)(clock() - timer)) / CLOCKS_PER_SEC;
-    timer = clock();
-    
 
-    // for (int i = 0; i < 8; i++) {
-    //   receivedByteString[i] = ((recvBuffer[1] & (0b10000000 >> i)) == 0b10000000 >> i) + '0';
-    // }
+    // Every sample since the last tick goes through the filter, the newest estimate is used
+    const Attitude *attitude = NULL;
+    Attitude attitudeEstimate;
+    if (imuSampler.isOpen()) {
+      phaseStartNanos = monotonicNanos();
+      ImuSample sample;
+      while (imuSampler.take(&sample)) {
+        attitudeFilter.update(&sample);
+      }
+      attitudeEstimate = attitudeFilter.getAttitude();
+      attitude = &attitudeEstimate;
+      loopTiming.record(TIMING_PHASE_IMU, monotonicNanos() - phaseStartNanos);
+    }
+
+    bool writeNeeded = controlStep(nowNanos, deltaTime, command, attitude);
+    phaseStartNanos = phaseEndNanos = monotonicNanos();
+    if (writeNeeded) {
+      // With the writer thread this is only the hand-off, the bus time is in its own stats
+      if (options.syncWrites) {
+        servoDriverWriteCommands();
+      } else {
+        servoWriter.publish(servoPositions, nowNanos);
+      }
+      phaseEndNanos = monotonicNanos();
+      loopTiming.record(TIMING_PHASE_I2C_WRITE, phaseEndNanos - phaseStartNanos);
+    }
+    loopTiming.recordTick(phaseEndNanos - nowNanos);
+    // After the tick is closed, reporting is not part of the control work
+    if (sessionLog.isOpen()) {
+      sessionLog.append(nowNanos, deltaTime, command, attitude, writeNeeded);
+    }
+    if (engineState.isOpen()) {
+      engineState.save(nowNanos, &gaitController, &cameraServo);
+    }
+    if (commandMessage != NULL) {
+      fputs(commandMessage, stdout);
+      commandMessage = NULL;
+    }
+    #ifndef TEST_MODE
+    telemetry.update(nowNanos, &commandFrame);
+    #endif
+
+    // The timeout's idle frame is not activity, whatever it set in motion is
+    active = active || (writeNeeded && command == NULL) || gaitController.getGaitState() == GAIT_STATE_MOVE;
+    if (active) {
+      idlePolicy.noteActivity(nowNanos);
+    } else if (idlePolicy.isQuiet(nowNanos)) {
+      enterIdle(nowNanos, options.syncWrites);
+      #ifndef TEST_MODE
+      commandReceiver.setWakeOnCommand(true);
+      #endif
+    }
 
-    // printf("%s\n", receivedByteString);
+    if (timingDumpRequested) {
+      timingDumpRequested = 0;
+      loopTiming.print(stdout);
+    }
   }
+  #ifdef ALLOCATION_GUARD
+  allocationGuardDisarm();
+  #endif
+  getrusage(RUSAGE_THREAD, &loopEndUsage);
+  int64_t loopEndNanos = monotonicNanos();
   #ifndef TEST_MODE
-  close(socketFileDescriptor);
+  commandReceiver.stop();
+  cout << commandReceiver.getReceivedCount() << " commands received, "
+       << commandReceiver.getSupersededCount() << " superseded before use, "
+       << commandReceiver.getOutOfOrderCount() << " out of order, " << commandReceiver.getStaleCount() << " stale, "
+       << commandReceiver.getLostCount() << " lost, " << commandReceiver.getMalformedCount() << " malformed\n";
+  cout << telemetry.getSentCount() << " telemetry datagrams sent, " << telemetry.getFailedCount() << " failed\n";
+  LatencyHistogram *commandLatency = commandReceiver.getLatency();
+  if (commandLatency->getCount() > 0) {
+    printf("command latency above the fastest datagram (us): p50 %.1f, p99 %.1f, max %.1f\n",
+           commandLatency->getPercentile(0.5) / 1000.0, commandLatency->getPercentile(0.99) / 1000.0,
+           commandLatency->getMax() / 1000.0);
+  }
   #endif
+  if (sessionLog.isOpen()) {
+    cout << sessionLog.getRecordCount() << " ticks recorded to " << options.recordPath << "\n";
+    sessionLog.close();
+  }
+  engineState.close();
+  if (!options.syncWrites) {
+    servoWriter.stop();
+    LatencyHistogram *handoff = servoWriter.getHandoffLatency();
+    LatencyHistogram *flush = servoWriter.getFlushTime();
+    cout << servoWriter.getPublishedCount() << " servo frames published, " << servoWriter.getWrittenCount()
+         << " written, " << servoWriter.getSupersededCount() << " superseded by a newer frame\n";
+    if (flush->getCount() > 0) {
+      printf("servo writer (us): hand-off p50 %.1f, p99 %.1f, max %.1f; flush p50 %.1f, p99 %.1f, max %.1f\n",
+             handoff->getPercentile(0.5) / 1000.0, handoff->getPercentile(0.99) / 1000.0, handoff->getMax() / 1000.0,
+             flush->getPercentile(0.5) / 1000.0, flush->getPercentile(0.99) / 1000.0, flush->getMax() / 1000.0);
+    }
+    if (servoWriter.isAlignedToPwm()) {
+      PwmSchedule *schedule = servoWriter.getPwmSchedule();
+      LatencyHistogram *margin = servoWriter.getBoundaryMargin();
+      printf("PWM period %.1f us: %u writes before the boundary (margin p50 %.1f us, min %.1f us), %u late\n",
+             schedule->getPeriodNanos() / 1000.0, schedule->getOnTimeCount(), margin->getPercentile(0.5) / 1000.0,
+             margin->getMin() / 1000.0, schedule->getLateCount());
+    }
+  }
+  if (idlePolicy.isEnabled()) {
+    LatencyHistogram *wake = idlePolicy.getWakeLatency();
+    printf("Idle %u times, %.1f s in total", idlePolicy.getEntryCount(),
+           (double)idlePolicy.getIdleNanos(loopEndNanos) / NANOS_PER_SECOND);
+    if (wake->getCount() > 0) {
+      printf("; command to the tick applying it (ms) p50 %.2f, max %.2f", wake->getPercentile(0.5) / 1e6,
+             wake->getMax() / 1e6);
+    }
+    printf("\n");
+  }
+  if (imuSampler.isOpen()) {
+    LatencyHistogram *read = imuSampler.getReadTime();
+    Attitude attitude = attitudeFilter.getAttitude();
+    printf("IMU: %u samples, %u dropped on a full ring, %u failed; read (us) p50 %.1f, p99 %.1f, max %.1f\n",
+           imuSampler.getSampleCount(), imuSampler.getDroppedCount(), imuSampler.getFailedCount(),
+           read->getPercentile(0.5) / 1000.0, read->getPercentile(0.99) / 1000.0, read->getMax() / 1000.0);
+    printf("IMU: pitch %.2f, roll %.2f degrees, measured incline %.3f\n", attitude.pitch * 180 / M_PI,
+           attitude.roll * 180 / M_PI, gaitController.getMeasuredIncline());
+    imuSampler.close();
+  }
   // Release i2c channel
   servoDriverDeInit(servoControllerFd);
-  cout << "User interrupt, shutting down...\n";
+  loopTiming.print(stdout);
+  ServoDriverBusStats busStats = servoDriverGetBusStats();
+  cout << "I2C: " << busStats.bytesWritten << " bytes in " << busStats.transactions
+       << " transactions over " << busStats.flushes << " flushes to " << servoDriverGetBoardCount() << " boards";
+  if (busStats.flushes > 0) {
+    cout << ", " << (double)busStats.bytesWritten / busStats.flushes << " bytes and "
+         << (double)busStats.channelsWritten / busStats.flushes << " channels per flush";
+  }
+  cout << "\n";
+  cout << "Gait keyframes: " << gaitCacheStats.playbacks << " played back, " << gaitCacheStats.liveEvaluations
+       << " evaluated live, " << gaitCacheStats.rebuilds << " tables built\n";
+  if (gaitController.getFootSpace()) {
+    cout << "Foot targets out of reach: " << gaitController.getUnreachableCount() << "\n";
+  }
+  cout << "Page faults in the loop: " << loopEndUsage.ru_minflt - loopStartUsage.ru_minflt << " minor, "
+       << loopEndUsage.ru_majflt - loopStartUsage.ru_majflt << " major\n";
+  #ifdef ALLOCATION_GUARD
+  cout << "Allocations after init: " << allocationGuardGetCount() << " (" << allocationGuardGetBytes() << " bytes)\n";
+  #endif
+  cout << "User interrupt, shutting down... (" << timer.getOverrunCount() << " overrun ticks)\n";
   return 0;
 }
 
@@ -143,89 +925,116 @@ bool hasCommand(uint8_t commandByte, uint8_t mask) {
   }
 }
 
+/*!
+ * Walking from the legacy key bits: full speed forward / backward and fixed turns
+ * */
+void legacyMotionInterpreter(const uint8_t commandBytes[]) {
+  // Up down
+  if (hasCommand(commandBytes[0], TRANSLATE_FORWARD)) {
+    gaitController.setDirection(TRANSLATION_DIRECTION_FORWARD);
+    gaitController.accelerate();
+    // cout << "forward\n";
+  } else if (hasCommand(commandBytes[0], TRANSLATE_BACKWARD)) {
+    gaitController.setDirection(TRANSLATION_DIRECTION_BACKWARD);
+    gaitController.accelerate();
+    // cout << "backward\n";
+  } else if (hasCommand(commandBytes[0], TURN_IN_PLACE_LEFT)) {
+    gaitController.setTurnDirection(TURN_DIRECTION_IN_PLACE_LEFT);
+    gaitController.accelerate();
+  } else if (hasCommand(commandBytes[0], TURN_IN_PLACE_RIGHT)) {
+    gaitController.setTurnDirection(TURN_DIRECTION_IN_PLACE_RIGHT);
+    gaitController.accelerate();
+  } else {
+    gaitController.decelerate();
+  }
+  
+  // To turn or not to turn
+  if (hasCommand(commandBytes[0], TRANSLATE_WITH_LEFT)) {
+    gaitController.setTurnDirection(TURN_DIRECTION_LEFT);
+  } else if (hasCommand(commandBytes[0], TRANSLATE_WITH_RIGHT)) {
+    gaitController.setTurnDirection(TURN_DIRECTION_RIGHT);
+  } else {
+    gaitController.setTurnDirection(TURN_DIRECTION_NONE);
+  }
+}
+
+/*!
+ * Walking from the continuous v2 fields
+ * */
+void motionInterpreter(const CommandFrame *frame) {
+  if (frame->strideLength != 0) {
+    gaitController.setStrideLength(frame->strideLength);
+  }
+  if (frame->strideHeight != 0) {
+    gaitController.setStrideHeight(frame->strideHeight);
+  }
+  gaitController.setMotion(frame->velocity, frame->turn);
+  if (frame->velocity != 0 || frame->turn != 0) {
+    gaitController.accelerate();
+  } else {
+    gaitController.decelerate();
+  }
+}
+
 /**
  * The first byte is used to detect mouse click events and the second byte is used to detect keyboard and mouse clicks
+ * Only applies the command, the gait is advanced and written out by the control loop on every tick.
  */
-void commandInterpreter(uint8_t commandBytes[], float dT) {
+void commandInterpreter(const CommandFrame *frame) {
+  const uint8_t *commandBytes = frame->bytes;
 
   //cout << "intr_str\n";
   if (hasCommand(commandBytes[0], CAMERA_TURN_LEFT)) {
     cameraServo.stepLeft();
-    servoDriverWriteCommands();
   } else if (hasCommand(commandBytes[0], CAMERA_TURN_RIGHT)) {
     cameraServo.stepRight();
-    servoDriverWriteCommands();
   }
   
   if (hasCommand(commandBytes[1], OPEN_PEBBLE)) {
     gaitController.openPebble();
     gaitController.setGaitState(GAIT_STATE_STOP);
-    cout << "Open\n";
+    commandMessage = "Open\n";
   }
   else if (hasCommand(commandBytes[1], CLOSE_PEBBLE)) {
     gaitController.closePebble();
     gaitController.setGaitState(GAIT_STATE_STOP);
-    cout << "Close\n";
+    commandMessage = "Close\n";
   }
   else if (hasCommand(commandBytes[1], MOVE_PEBBLE)) {
-    cout << "Move\n";
+    commandMessage = "Move\n";
     gaitController.setGaitState(GAIT_STATE_MOVE);
   }
 
   if (gaitController.getGaitState() == GAIT_STATE_MOVE) {
-    // Up down
-    if (hasCommand(commandBytes[0], TRANSLATE_FORWARD)) {
-      gaitController.setDirection(TRANSLATION_DIRECTION_FORWARD);
-      gaitController.accelerate();
-      // cout << "forward\n";
-    } else if (hasCommand(commandBytes[0], TRANSLATE_BACKWARD)) {
-      gaitController.setDirection(TRANSLATION_DIRECTION_BACKWARD);
-      gaitController.accelerate();
-      // cout << "backward\n";
-    } else if (hasCommand(commandBytes[0], TURN_IN_PLACE_LEFT)) {
-      gaitController.setTurnDirection(TURN_DIRECTION_IN_PLACE_LEFT);
-      gaitController.accelerate();
-    } else if (hasCommand(commandBytes[0], TURN_IN_PLACE_RIGHT)) {
-      gaitController.setTurnDirection(TURN_DIRECTION_IN_PLACE_RIGHT);
-      gaitController.accelerate();
+    if (frame->version == COMMAND_VERSION_2) {
+      motionInterpreter(frame);
     } else {
-      gaitController.decelerate();
+      legacyMotionInterpreter(commandBytes);
     }
-    
-    // To turn or not to turn
-    if (hasCommand(commandBytes[0], TRANSLATE_WITH_LEFT)) {
-      gaitController.setTurnDirection(TURN_DIRECTION_LEFT);
-    } else if (hasCommand(commandBytes[0], TRANSLATE_WITH_RIGHT)) {
-      gaitController.setTurnDirection(TURN_DIRECTION_RIGHT);
-    } else {
-      gaitController.setTurnDirection(TURN_DIRECTION_NONE);
-    }
-    
-    if (hasCommand(commandBytes[1], INCREMENT_STRIDE_HEIGHT)) {
+
+    // A click latched into the same tick as Move shares byte 1 with its 0b11 state
+    // field, which hasCommand would read as Move alone
+    uint8_t adjustments = commandBytes[1] & ~MOVE_PEBBLE;
+    if (hasCommand(adjustments, INCREMENT_STRIDE_HEIGHT)) {
       gaitController.incrementStrideHeight();
     }
-    else if (hasCommand(commandBytes[1], DECREMENT_STRIDE_HEIGHT)) {
+    else if (hasCommand(adjustments, DECREMENT_STRIDE_HEIGHT)) {
       gaitController.decrementStrideHeight();
     }
     
-    if (hasCommand(commandBytes[1], INCREMENT_STRIDE_LENGTH)) {
+    if (hasCommand(adjustments, INCREMENT_STRIDE_LENGTH)) {
       gaitController.incrementStrideLength();
     }
-    else if (hasCommand(commandBytes[1], DECREMENT_STRIDE_LENGTH)) {
+    else if (hasCommand(adjustments, DECREMENT_STRIDE_LENGTH)) {
       gaitController.decrementStrideLength();
     }
     
-    if (hasCommand(commandBytes[1], INCREMENT_INCLINE)) {
+    if (hasCommand(adjustments, INCREMENT_INCLINE)) {
       gaitController.incrementIncline();
     }
-    else if (hasCommand(commandBytes[1], DECREMENT_INCLINE)) {
+    else if (hasCommand(adjustments, DECREMENT_INCLINE)) {
       gaitController.decrementIncline();
     }
-    
-    gaitController.updateGait(dT);
-    
-  
-    servoDriverWriteCommands();
     //cout << "intr_fin\n";
     
   }
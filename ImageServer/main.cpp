@@ -30,6 +30,8 @@
 #define SERVER_PORT 8090
 #define IMAGE_WIDTH 500
 #define IMAGE_HEIGHT 500
+// Largest JPEG frame kept, bigger ones are dropped
+#define IMAGE_BUFFER_SIZE (IMAGE_WIDTH * IMAGE_HEIGHT)
 
 using namespace std;
 
@@ -39,7 +41,9 @@ mutex mainThreadMutex;
 bool quit_camera_thread;
 bool quit_server_thread;
 int bytesUsed;
-uint8_t *dataBuffer;
+// Static instead of malloc'd and locked by imageReader, so copying a frame in never
+// page faults when the robot is short on memory
+uint8_t dataBuffer[IMAGE_BUFFER_SIZE];
 
 struct buffer {
   void* start;
@@ -68,7 +72,10 @@ void map(int fd, uint32_t type, struct buffer* buffer) {
  * Reads image data into dataBuffer in JPEG format
  * */
 int imageReader() {
-  dataBuffer = (uint8_t*)malloc(IMAGE_WIDTH * IMAGE_HEIGHT);
+  if (mlock(dataBuffer, sizeof(dataBuffer)) < 0) {
+    perror("Unable to lock the frame buffer, continuing");
+  }
+  memset(dataBuffer, 0, sizeof(dataBuffer));
   int frameCounter = 0;
   // 1.  Open the device
   int raspiCamFileDescriptor; // A file descriptor to the video device
@@ -150,11 +157,13 @@ int imageReader() {
     encoded_len = buf.bytesused;
     // printf("Bytes captured: %d \n", encoded_len);
     
-    imageBufferMutex.lock();
-    //printf("icb\n");
-    bytesUsed = encoded_len;
-    memcpy(dataBuffer, capture.start, encoded_len);
-    imageBufferMutex.unlock();
+    if (encoded_len <= IMAGE_BUFFER_SIZE) {
+      imageBufferMutex.lock();
+      //printf("icb\n");
+      bytesUsed = encoded_len;
+      memcpy(dataBuffer, capture.start, encoded_len);
+      imageBufferMutex.unlock();
+    }
     //printf("ice\n");
 
     ioctl(raspiCamFileDescriptor, VIDIOC_QBUF, &buf);